@@ -18,9 +18,18 @@ where /Q cl.exe || (
 )
 
 set source_files=Source\main.cpp ^
+    Source\core.cpp ^
+    Source\jobs.cpp ^
+    Source\image.cpp ^
+    Source\texture.cpp ^
+    Source\texture_compression.cpp ^
+    Source\texture_containers.cpp ^
     Source\math.cpp ^
     Source\obj_file.cpp ^
-    Source\mesh.cpp
+    Source\mesh.cpp ^
+    Source\scene.cpp ^
+    Source\culling.cpp ^
+    Source\occlusion.cpp
 
 set compiler_flags= -nologo -Oi -Od -Zi -FC -FoObj\
 set compiler_defines=
@@ -30,7 +39,19 @@ set linker_flags= -incremental:no -opt:ref
 set libs=Kernel32.lib DbgHelp.lib Shell32.lib User32.lib Opengl32.lib Gdi32.lib ^
     Third_Party\glfw-3.4\lib-windows-vc2022\glfw3_mt.lib
 
-if ["%1"]==["-vulkan"] (
+if ["%1"]==["-null"] (
+    echo Compiling for null backend -^> ScopNull.exe
+
+    set output_filename=ScopNull.exe
+    set source_files= %source_files% Source\null_backend.cpp
+    set compiler_defines= %compiler_defines% /DSCOP_BACKEND_NULL
+) else if ["%1"]==["-software"] (
+    echo Compiling for software backend -^> ScopSW.exe
+
+    set output_filename=ScopSW.exe
+    set source_files= %source_files% Source\software_backend.cpp
+    set compiler_defines= %compiler_defines% /DSCOP_BACKEND_SOFTWARE /DSCOP_SOFTWARE_WINDOW
+) else if ["%1"]==["-vulkan"] (
     echo Compiling for Vulkan backend -> ScopVk.exe
 
     set output_filename=ScopVk.exe
@@ -3,13 +3,19 @@
 in vec3 Vertex_Position;
 in vec3 Normal;
 in vec2 Tex_Coords;
+flat in vec3 Color;
 
 out vec4 Frag_Color;
 
-uniform vec3 u_Light_Position;
-uniform vec3 u_Light_Color;
-uniform vec3 u_Model_Color;
-uniform float u_Texture_Alpha;
+// Per draw constants, filled on the CPU. Matrices are row major like Mat4f
+layout (std140, row_major) uniform Draw_Uniforms
+{
+    mat4 u_View_Projection_Matrix;
+    vec3 u_Light_Position;
+    vec3 u_Light_Color;
+    float u_Texture_Alpha;
+};
+
 uniform sampler2D u_Texture;
 
 float Random (float seed)
@@ -19,22 +25,40 @@ float Random (float seed)
 
 void main ()
 {
+#ifdef SCOP_FLAT_SHADING
+    // The plane of the triangle from the screen space derivatives of the position. It always
+    // faces the camera, and the vertices can be shared with neighboring triangles
+    vec3 normal = normalize (cross (dFdx (Vertex_Position), dFdy (Vertex_Position)));
+#else
     vec3 normal = Normal * (float (gl_FrontFacing) * 2 - 1);
     normal = normalize (normal);
+#endif
 
     vec3 vertex_to_light = normalize (u_Light_Position - Vertex_Position);
     float diffuse_factor = max (dot (vertex_to_light, normal), 0.1);
 
-    vec3 texture_color = vec3 (0);
-    if (u_Texture_Alpha != 0)
-        texture_color = texture (u_Texture, Tex_Coords).rgb;
+    // SCOP_TEXTURE and SCOP_RANDOM_COLOR are defined by the renderer, depending on which of
+    // the two is visible with the current u_Texture_Alpha
+    vec3 diffuse = vec3 (1);
 
+#ifdef SCOP_RANDOM_COLOR
     vec3 random_color;
     random_color.r = Random (gl_PrimitiveID);
     random_color.g = Random (random_color.r);
     random_color.b = Random (random_color.g);
 
-    vec3 diffuse = mix (random_color, texture_color, u_Texture_Alpha);
+    diffuse = random_color;
+#endif
+
+#ifdef SCOP_TEXTURE
+    vec3 texture_color = texture (u_Texture, Tex_Coords).rgb;
+
+    #ifdef SCOP_RANDOM_COLOR
+        diffuse = mix (random_color, texture_color, u_Texture_Alpha);
+    #else
+        diffuse = texture_color;
+    #endif
+#endif
 
-    Frag_Color = vec4 (diffuse * u_Light_Color * diffuse_factor, 1);
+    Frag_Color = vec4 (diffuse * u_Light_Color * diffuse_factor * Color, 1);
 }
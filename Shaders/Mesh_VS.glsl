@@ -4,20 +4,48 @@ layout (location = 0) in vec3 v_Position;
 layout (location = 1) in vec3 v_Normal;
 layout (location = 2) in vec2 v_Tex_Coords;
 
-uniform mat4 u_View_Projection_Matrix;
-uniform mat4 u_Model_Matrix;
+// Per instance, the rows of the model and normal matrices
+layout (location = 3) in vec4 v_Model_Matrix_Row0;
+layout (location = 4) in vec4 v_Model_Matrix_Row1;
+layout (location = 5) in vec4 v_Model_Matrix_Row2;
+layout (location = 6) in vec4 v_Model_Matrix_Row3;
+layout (location = 7) in vec3 v_Normal_Matrix_Row0;
+layout (location = 8) in vec3 v_Normal_Matrix_Row1;
+layout (location = 9) in vec3 v_Normal_Matrix_Row2;
+layout (location = 10) in vec3 v_Color;
+
+// Per draw constants, filled on the CPU. Matrices are row major like Mat4f
+layout (std140, row_major) uniform Draw_Uniforms
+{
+    mat4 u_View_Projection_Matrix;
+    vec3 u_Light_Position;
+    vec3 u_Light_Color;
+    float u_Texture_Alpha;
+};
 
 out vec3 Vertex_Position;
 out vec3 Normal;
 out vec2 Tex_Coords;
+flat out vec3 Color;
 
 void main ()
 {
-    vec4 world_position = u_Model_Matrix * vec4 (v_Position, 1);
+    vec4 position = vec4 (v_Position, 1);
+    vec4 world_position = vec4 (
+        dot (v_Model_Matrix_Row0, position),
+        dot (v_Model_Matrix_Row1, position),
+        dot (v_Model_Matrix_Row2, position),
+        dot (v_Model_Matrix_Row3, position)
+    );
+
     gl_Position = u_View_Projection_Matrix * world_position;
 
-    mat3 normal_matrix = transpose (inverse (mat3 (u_Model_Matrix)));
     Vertex_Position = world_position.xyz;
-    Normal = normal_matrix * v_Normal;
+    Normal = vec3 (
+        dot (v_Normal_Matrix_Row0, v_Normal),
+        dot (v_Normal_Matrix_Row1, v_Normal),
+        dot (v_Normal_Matrix_Row2, v_Normal)
+    );
     Tex_Coords = v_Tex_Coords;
+    Color = v_Color;
 }
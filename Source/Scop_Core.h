@@ -7,6 +7,8 @@
 #include <string.h>
 #include <ctype.h>
 
+#include <atomic>
+
 #if defined (__linux__)
 #define SCOP_PLATFORM_LINUX
 #elif defined (_WIN32)
@@ -17,6 +19,18 @@
 #error "Unsupported platform"
 #endif
 
+// Functions using AVX2 intrinsics are compiled for AVX2 one by one with SCOP_TARGET_AVX2,
+// they must only be called when CPUSupportsAVX2 returns true
+#if defined (__x86_64__) || defined (_M_X64)
+#define SCOP_AVX2_AVAILABLE
+
+#if defined (_MSC_VER) && !defined (__clang__)
+#define SCOP_TARGET_AVX2
+#else
+#define SCOP_TARGET_AVX2 __attribute__ ((target ("avx2")))
+#endif
+#endif
+
 typedef  uint8_t  u8;
 typedef   int8_t  s8;
 typedef uint16_t u16;
@@ -185,7 +199,7 @@ T *ArrayPush (Array<T> *arr)
         ArrayReserve (arr, arr->allocated * 2 + 8);
 
     T *ptr = &arr->data[arr->count];
-    *ptr = T{};
+    *ptr = T ();
 
     arr->count += 1;
 
@@ -215,8 +229,95 @@ void ArrayClear (Array<T> *arr)
     arr->count = 0;
 }
 
+template<typename T>
+T *ArrayInsert (Array<T> *arr, s64 index, const T item)
+{
+    Assert (index >= 0 && index <= arr->count);
+
+    ArrayPush (arr);
+    memmove (arr->data + index + 1, arr->data + index, sizeof (T) * (arr->count - 1 - index));
+    arr->data[index] = item;
+
+    return &arr->data[index];
+}
+
+template<typename T>
+void ArrayOrderedRemove (Array<T> *arr, s64 index)
+{
+    Assert (index >= 0 && index < arr->count);
+
+    memmove (arr->data + index, arr->data + index + 1, sizeof (T) * (arr->count - 1 - index));
+    arr->count -= 1;
+}
+
 Result<String> ReadEntireFile (const char *filename);
 
+// The file is written under a temporary name and renamed, readers never see it half written
+bool WriteEntireFile (const char *filename, const void *data, s64 size);
+
+// Succeeds if the directory already exists
+bool MakeDirectory (const char *path);
+
+// Read only view of the contents of a file, which the OS pages in on access
+struct MappedFile
+{
+    void *data;
+    s64 size;
+};
+
+Result<MappedFile> MapFile (const char *filename);
+void UnmapFile (MappedFile *file);
+
+#define Hash_Seed 0xcbf29ce484222325ull
+
+// 64-bit FNV-1a. Chain calls by passing the previous result as the seed
+u64 HashBytes (const void *data, s64 size, u64 seed = Hash_Seed);
+
+// Monotonic clock, only meaningful as a difference between two calls
+f64 GetTimeInSeconds ();
+
+#define Timing_History_Size 256
+
+// The last Timing_History_Size samples of a duration, in seconds
+struct TimingHistory
+{
+    f64 samples[Timing_History_Size];
+    s64 count;
+    s64 next;
+};
+
+void PushTimingSample (TimingHistory *history, f64 seconds);
+f64 GetTimingAverage (const TimingHistory &history);
+f64 GetTimingPercentile (const TimingHistory &history, f64 percentile); // percentile is in [0, 1]
+
+bool CPUSupportsAVX2 ();
+
+// Log lines go to stdout unless redirected, for programs that write their results there
+void SetLogFile (FILE *file);
 void LogMessage (const char *str, ...);
 void LogWarning (const char *str, ...);
 void LogError (const char *str, ...);
+
+// Worker thread pool, see jobs.cpp
+
+typedef void (*JobProc) (void *data);
+typedef void (*ParallelForProc) (s64 index, void *data);
+
+struct JobGroup
+{
+    std::atomic<s64> pending {0};
+};
+
+// A negative worker count spawns one worker per core, minus one for the main thread
+void InitJobSystem (int worker_count = -1);
+void ShutdownJobSystem ();
+int GetWorkerCount ();
+
+void PushJob (JobGroup *group, JobProc proc, void *data);
+bool IsDone (JobGroup *group);
+
+// The calling thread executes queued jobs while it waits
+void WaitForJobs (JobGroup *group);
+
+// Calls proc for every index in [0, count), batch_size indices at a time per worker
+void ParallelFor (s64 count, ParallelForProc proc, void *data, s64 batch_size = 1);
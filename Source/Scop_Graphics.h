@@ -8,8 +8,12 @@
     #include "Scop_Vulkan.h"
 
     #define GLFW_INCLUDE_VULKAN
+#elif defined (SCOP_BACKEND_NULL)
+    #include "Scop_Null.h"
+#elif defined (SCOP_BACKEND_SOFTWARE)
+    #include "Scop_Software.h"
 #else
-    #error No graphics backend is defined. #define either SCOP_BACKEND_OPENGL or SCOP_BACKEND_VULKAN
+    #error No graphics backend is defined. #define either SCOP_BACKEND_OPENGL, SCOP_BACKEND_VULKAN, SCOP_BACKEND_NULL or SCOP_BACKEND_SOFTWARE
 
     #define SCOP_BACKEND_NAME "None"
 #endif
@@ -19,7 +23,9 @@
 #define SCOP_WINDOW_WIDTH 2300
 #define SCOP_WINDOW_HEIGHT 1800
 
+#ifndef SCOP_BACKEND_HEADLESS
 #include <GLFW/glfw3.h>
+#endif
 
 struct Camera
 {
@@ -35,7 +41,10 @@ struct Camera
     Mat4f view_projection_matrix;
 };
 
+#ifndef SCOP_BACKEND_HEADLESS
 extern GLFWwindow *g_main_window;
+#endif
+
 extern Camera g_camera;
 
 struct Vertex
@@ -68,7 +77,6 @@ struct WeldMeshResult
 WeldMeshResult WeldMesh (Vertex *vertices, u32 vertex_count);
 
 void CalculateTangents (Vertex *vertices, s64 vertex_count, u32 *indices, s64 index_count);
-void CalculateNormalsFlat (Vertex *vertices, s64 vertex_count);
 void CalculateNormalsSmooth (Vertex *vertices, s64 vertex_count, u32 *indices, s64 index_count);
 void CalculateBoundingBox (Mesh *mesh);
 void CalculateBasicTexCoords (Mesh *mesh);
@@ -77,11 +85,11 @@ enum LoadMeshFlags
 {
     LoadMesh_NoFlags = 0x00,
     LoadMesh_WeldMesh = 0x01,
-    LoadMesh_CalculateNormalsSmooth = 0x02,
-    LoadMesh_CalculateNormalsFlat = 0x04,
+    LoadMesh_CalculateNormalsSmooth = 0x02, // Flat shading is a render option, see RenderFrameParams
     LoadMesh_IgnoreSuppliedNormals = 0x08,
     LoadMesh_CalculateTangents = 0x10,
     LoadMesh_CalculateTexCoords = 0x20,
+    LoadMesh_NoGfxObjects = 0x40, // For meshes that are only copied somewhere else, like in a scene
 
     LoadMesh_DefaultFlags = LoadMesh_WeldMesh
         | LoadMesh_CalculateNormalsSmooth
@@ -89,22 +97,338 @@ enum LoadMeshFlags
         | LoadMesh_CalculateTexCoords,
 };
 
-bool LoadMeshFromObjFile (const char *filename, Mesh *mesh, LoadMeshFlags flags = LoadMesh_DefaultFlags);
-bool LoadTextureFromFile (const char *filename, GfxTexture *texture, u32 *width, u32 *height);
+// Time spent in each stage of LoadMeshFromObjFile, in seconds
+struct LoadMeshStats
+{
+    s64 file_size;
+    s64 face_count; // Number of triangles after triangulation
+
+    f64 read_time;
+    f64 parse_time;
+    f64 weld_time;
+    f64 normals_time;
+    f64 tex_coords_time;
+    f64 tangents_time;
+    f64 bounds_time;
+};
+
+bool LoadMeshFromObjFile (const char *filename, Mesh *mesh, LoadMeshFlags flags = LoadMesh_DefaultFlags, LoadMeshStats *stats = null);
+bool WritePNGFile (const char *filename, const u8 *rgba, u32 width, u32 height, bool flip_vertically = false);
 
 void DestroyMesh (Mesh *mesh);
 
+// Textures, see texture.cpp
+
+#define Max_Texture_Levels 16
+
+// Block compressed formats encode 4 by 4 texel blocks. Gray images only keep the channels
+// they use and the backends replicate them on sampling
+enum TextureFormat
+{
+    TextureFormat_RGBA8,
+    TextureFormat_BC1, // Opaque RGB, 8 bytes per block
+    TextureFormat_BC3, // RGBA, 16 bytes per block
+    TextureFormat_BC4, // Opaque gray, sampled as (r, r, r, 1), 8 bytes per block
+    TextureFormat_BC5, // Gray and alpha, sampled as (r, r, r, g), 16 bytes per block
+    TextureFormat_BC7, // RGBA, 16 bytes per block
+
+    TextureFormat_Count,
+};
+
+struct TextureLevel
+{
+    u32 width;
+    u32 height;
+    const u8 *data;
+    s64 size; // In bytes
+};
+
+// Pixels of a texture and of its mip levels, level 0 first
+struct TextureData
+{
+    TextureFormat format;
+    int level_count;
+    TextureLevel levels[Max_Texture_Levels];
+    void *memory; // Holds the data of every level, released by FreeTextureData
+};
+
+// Every level down to 1 by 1 from sRGB encoded RGBA8 pixels, with a 2 by 2 box filter
+// applied in linear space. The rows of each level are filtered in parallel
+bool BuildMipChain (const u8 *rgba, u32 width, u32 height, TextureData *result);
+void FreeTextureData (TextureData *data);
+
+s64 GetTextureLevelSize (TextureFormat format, u32 width, u32 height);
+
+// Encodes every level of an RGBA8 texture, the blocks of each level in parallel. See texture_compression.cpp
+bool CompressTextureData (const TextureData &src, TextureFormat format, TextureData *result);
+
+// DDS and KTX2 files hold levels that are ready to upload. The parsed levels point into the
+// contents of the file, which have to outlive them. See texture_containers.cpp
+bool IsTextureContainer (const void *data, s64 size);
+bool ParseTextureContainer (const char *filename, const void *data, s64 size, TextureData *result);
+
+// A load is split in two so that the file can be decoded on a worker thread, while the upload
+// happens on the thread that owns the graphics context
+struct TextureLoad
+{
+    const char *filename;
+    u32 supported_formats; // One bit per TextureFormat, see GetSupportedTextureFormats
+    bool ok;
+    MappedFile file;
+    TextureData data;
+    const char *source; // How the data was obtained, for logging
+    f64 load_time;
+};
+
+u32 GetSupportedTextureFormats ();
+
+// Called from the graphics thread, it asks the backend which formats it supports
+void BeginTextureLoad (TextureLoad *load, const char *filename);
+
+// DDS and KTX2 files are mapped and uploaded from the mapping as they are. Other images are
+// decoded and compressed, and the result is cached on disk, keyed by the contents of the file
+// and the formats the backend supports, so that later loads skip decoding and encoding.
+// Does not call into the backend and can run on any thread
+void LoadTextureData (TextureLoad *load);
+
+// Called from the graphics thread
+bool UploadTextureData (TextureLoad *load, GfxTexture *texture);
+void FreeTextureLoad (TextureLoad *load);
+
+// All of the above on the calling thread
+bool LoadTextureFromFile (const char *filename, GfxTexture *texture, u32 *width, u32 *height);
+
+#ifndef SCOP_BACKEND_HEADLESS
 void GLFWErrorCallback (int code, const char *description);
+#endif
+
+// A point p is inside of plane (a, b, c, d) when a * p.x + b * p.y + c * p.z + d >= 0
+struct Frustum
+{
+    Vec4f planes[6];
+};
+
+// Planes of the clip volume of a matrix, in the space the matrix transforms from.
+// Passing view_projection * model gives the frustum in the model's local space
+Frustum ExtractFrustumPlanes (const Mat4f &m);
+
+// Axis aligned boxes stored as a structure of arrays, so that they are tested 8 at a time
+struct CullBoxes
+{
+    Array<float> min_x, min_y, min_z;
+    Array<float> max_x, max_y, max_z;
+};
+
+void PushCullBox (CullBoxes *boxes, const Vec3f &aabb_min, const Vec3f &aabb_max);
+void SetCullBox (CullBoxes *boxes, s64 index, const Vec3f &aabb_min, const Vec3f &aabb_max);
+void ClearCullBoxes (CullBoxes *boxes);
+void FreeCullBoxes (CullBoxes *boxes);
+
+// Set visible[i] to 1 for every box that may intersect the frustum and to 0 for the others.
+// Returns the number of visible boxes
+s64 CullBoxesAgainstFrustum (const Frustum &frustum, const CullBoxes &boxes, u8 *visible);
+
+void TransformBoundingBox (const Mat4f &m, const Vec3f &aabb_min, const Vec3f &aabb_max, Vec3f *result_min, Vec3f *result_max);
+
+// First fit allocator of element ranges, used to sub-allocate the shared buffers of a scene.
+// Free ranges are kept sorted by offset so that neighbours are merged back when freed
+struct FreeRange
+{
+    s64 offset;
+    s64 size;
+};
+
+struct RangeAllocator
+{
+    s64 capacity;
+    Array<FreeRange> free_ranges;
+};
+
+void InitRangeAllocator (RangeAllocator *allocator, s64 capacity);
+void DestroyRangeAllocator (RangeAllocator *allocator);
+s64 RangeAllocate (RangeAllocator *allocator, s64 size); // Returns -1 if no free range is large enough
+void RangeFree (RangeAllocator *allocator, s64 offset, s64 size);
+void GrowRangeAllocator (RangeAllocator *allocator, s64 new_capacity);
+
+#define Scene_Default_Vertex_Capacity (64 * 1024)
+#define Scene_Default_Index_Capacity (256 * 1024)
 
-bool GfxInitBackend ();
+struct SceneObject
+{
+    bool alive;
+    s64 base_vertex;
+    s64 vertex_count;
+    s64 first_index;
+    s64 index_count;
+
+    // World space, the transform of the object is baked into its vertices
+    Vec3f aabb_min;
+    Vec3f aabb_max;
+};
+
+// Many meshes packed into one vertex buffer and one index buffer, so that the whole scene
+// is drawn with a single vertex array bind and a single multi draw call. The pool grows
+// when an object does not fit
+struct Scene
+{
+    RangeAllocator vertex_allocator;
+    RangeAllocator index_allocator;
+    Array<SceneObject> objects;
+    CullBoxes object_bounds; // Same bounds as objects, for culling
+    s64 alive_object_count;
+    GfxScenePool gfx_pool;
+
+    // Copy of the positions and indices of the pool, for rasterizing occluders on the CPU
+    Array<Vec3f> positions;
+    Array<u32> indices;
+};
+
+void InitScene (Scene *scene, s64 vertex_capacity = Scene_Default_Vertex_Capacity, s64 index_capacity = Scene_Default_Index_Capacity);
+void DestroyScene (Scene *scene);
+s64 AddMeshToScene (Scene *scene, const Mesh *mesh, const Mat4f &transform);
+void RemoveObjectFromScene (Scene *scene, s64 object_index);
+void CalculateSceneBoundingBox (const Scene *scene, Vec3f *aabb_min, Vec3f *aabb_max);
+bool LoadSceneFromFile (const char *filename, Scene *scene);
+
+// Tiles of the occlusion buffer are 8 by 8 pixels with one coverage bit per pixel.
+// z0 is the farthest depth of a layer of occluders that covers the whole tile, anything
+// behind it is hidden. Occluders that only cover part of the tile accumulate in the
+// working layer (coverage, z1) until it is full and replaces the first one
+struct OcclusionTile
+{
+    u64 coverage;
+    float z0;
+    float z1;
+};
+
+struct OcclusionTriangle
+{
+    // Pixels of the occlusion buffer, counter clockwise
+    float x[3];
+    float y[3];
+    float max_z;
+    int min_tile_x, min_tile_y;
+    int max_tile_x, max_tile_y;
+};
+
+// Rasterizes the largest objects of a scene on the CPU into a small depth buffer and tests
+// the bounds of every object against it. The pass runs on the job system between
+// BeginOcclusionCulling and EndOcclusionCulling
+struct OcclusionCuller
+{
+    int width = 0;
+    int height = 0;
+    int tiles_x = 0;
+    int tiles_y = 0;
+    OcclusionTile *tiles = null;
+
+    const Scene *scene = null;
+    Mat4f model_view_projection;
+    Vec3f camera_position; // In the space of the scene
+    Array<s64> occluders;
+    Array<Array<OcclusionTriangle>> occluder_triangles; // One list per occluder
+    Array<u8> occluded; // One flag per object of the scene
+
+    s64 occluder_triangle_count = 0;
+    s64 occluded_count = 0;
+    f64 pass_time = 0;
+    JobGroup group;
+};
+
+void InitOcclusionCuller (OcclusionCuller *culler, int framebuffer_width, int framebuffer_height);
+void DestroyOcclusionCuller (OcclusionCuller *culler);
+void BeginOcclusionCulling (OcclusionCuller *culler, const Scene *scene, const Mat4f &model_view_projection, const Vec3f &camera_position);
+void EndOcclusionCulling (OcclusionCuller *culler);
+
+// Cumulative since GfxInitBackend
+struct GfxStats
+{
+    s64 frame_count;
+    s64 draw_calls;
+    s64 triangles_submitted;
+    s64 mesh_objects_created;
+    s64 mesh_objects_destroyed;
+    s64 textures_created;
+    s64 textures_destroyed;
+    s64 bytes_uploaded;
+
+    // Render state changes issued to the graphics API, and the ones skipped because they
+    // would not have changed anything. Only backends with a state cache count them
+    s64 state_calls_issued;
+    s64 state_calls_elided;
+
+    // Resolution scale of the last frame and the sum over every frame, with dynamic resolution
+    float resolution_scale;
+    f64 resolution_scale_sum;
+};
+
+#define Gfx_Max_Passes 8
+
+// How long each pass of a past frame took to execute, as measured by the backend.
+// For GPU backends the results arrive a few frames late
+struct GfxPassTimings
+{
+    s64 frame_index;
+    int pass_count;
+    const char *pass_names[Gfx_Max_Passes];
+    f64 pass_times[Gfx_Max_Passes]; // In seconds
+};
+
+// Frames are rendered at a fraction of the framebuffer size then scaled up to it. The fraction
+// is adjusted every frame from the measured GPU time, to keep it close to target_frame_time
+struct GfxDynamicResolution
+{
+    float min_scale;
+    float max_scale;
+    f64 target_frame_time; // In seconds
+};
+
+// With an offscreen size there is no visible window: frames are rendered into a target of
+// that size and read back with GfxReadbackFrame
+bool GfxInitBackend (int offscreen_width = 0, int offscreen_height = 0, const GfxDynamicResolution *dynamic_resolution = null);
 void GfxTerminateBackend ();
+
+// Rendering happens on one thread at a time, initially the one that called GfxInitBackend.
+// To hand over, the current thread releases the context and the next one acquires it
+void GfxAcquireContext ();
+void GfxReleaseContext ();
+
+// Only from the thread that called GfxInitBackend, it owns the window
+void GfxGetFramebufferSize (int *width, int *height);
+const GfxStats &GfxGetStats ();
+bool GfxGetPassTimings (GfxPassTimings *timings); // Returns false if no new frame has finished since the last call
 void GfxCreateMeshObjects (Mesh *mesh);
+
+// Creates the GPU objects of the mesh without filling them, GfxStreamMeshObjects then uploads
+// the vertices and the indices a chunk at a time. Returns true once everything is uploaded,
+// until then only the triangles that are complete are drawn. Backends that cannot stream
+// upload whatever is left in one call and return true
+void GfxCreateMeshObjectsStreamed (Mesh *mesh);
+bool GfxStreamMeshObjects (Mesh *mesh, f64 time_budget);
 void GfxDestroyMeshObjects (Mesh *mesh);
-GfxTexture GfxCreateTexture (void *data, u32 width, u32 height);
+bool GfxSupportsTextureFormat (TextureFormat format);
+GfxTexture GfxCreateTexture (const TextureData &data);
 void GfxDestroyTexture (GfxTexture *texture);
 
+void GfxCreateScenePool (GfxScenePool *pool, s64 vertex_capacity, s64 index_capacity);
+void GfxDestroyScenePool (GfxScenePool *pool);
+void GfxResizeScenePool (GfxScenePool *pool, s64 old_vertex_capacity, s64 old_index_capacity, s64 vertex_capacity, s64 index_capacity); // Keeps the contents
+void GfxUploadToScenePool (GfxScenePool *pool, s64 first_vertex, const Vertex *vertices, s64 vertex_count, s64 first_index, const u32 *indices, s64 index_count);
+
+struct RenderInstance
+{
+    Mat4f model_matrix; // Applied before RenderFrameParams.model_matrix
+    Vec3f color;        // Multiplied with RenderFrameParams.model_color
+};
+
 struct RenderFrameParams
 {
+    // Copied from g_camera and GfxGetFramebufferSize by the caller, so that the frame can be
+    // rendered on another thread while the main thread moves the camera
+    Mat4f view_projection_matrix;
+    int framebuffer_width;
+    int framebuffer_height;
+
     Mesh *mesh;
     GfxTexture texture;
     float texture_alpha;
@@ -112,6 +436,29 @@ struct RenderFrameParams
     Mat4f model_matrix;
     Vec3f light_position;
     Vec3f light_color;
+
+    // Light each triangle with the normal of its plane instead of the vertex normals. The
+    // normal is derived when drawing, the vertices stay shared between triangles
+    bool flat_shading;
+
+    // When instances is not null the mesh is drawn once per instance, in a single draw call.
+    // instance_count can be 0, if every instance was culled for example
+    const RenderInstance *instances;
+    s64 instance_count;
+
+    // Drawn instead of mesh when not null, with model_matrix applied to the whole scene.
+    // Instances are ignored. Objects whose flag is 0 in scene_visibility are not drawn
+    const Scene *scene;
+    const u8 *scene_visibility;
 };
 
 void GfxRenderFrame (const RenderFrameParams &params);
+
+// Called once the pixels of a frame queued with GfxReadbackFrame are available, on the thread
+// that renders. Pixels are RGBA8, bottom row first, and are only valid during the call
+typedef void (*GfxReadbackProc) (const u8 *pixels, u32 width, u32 height, void *data);
+
+// Queues a readback of the frame that was just rendered. GPU backends return without waiting
+// and call proc a few frames later. Backends that have no pixels never call proc
+void GfxReadbackFrame (GfxReadbackProc proc, void *data);
+void GfxFlushReadbacks (); // Calls proc for every readback still in flight, waiting for them
@@ -262,6 +262,9 @@ Vec3f Reject (const Vec3f &a, const Vec3f &b);
 
 Mat4f Inverted (const Mat4f &m);
 
+// Transposed inverse of the upper 3x3 part, used to transform normals
+Mat3f NormalMatrix (const Mat4f &m);
+
 Vec3f RightVector (const Mat4f &m);
 Vec3f UpVector (const Mat4f &m);
 Vec3f ForwardVector (const Mat4f &m);
@@ -272,5 +275,9 @@ Mat4f Mat4fLookAt (const Vec3f &position, const Vec3f &target, const Vec3f &up);
 Mat4f Mat4fPerspectiveProjection (float fovy, float aspect, float znear);
 
 Mat4f Mul (const Mat4f &a, const Mat4f &b);
+Vec4f Mul (const Mat4f &m, const Vec4f &v);
+Vec3f Mul (const Mat3f &m, const Vec3f &v);
 
 inline Mat4f operator * (const Mat4f &a, const Mat4f &b) { return Mul (a, b); }
+inline Vec4f operator * (const Mat4f &m, const Vec4f &v) { return Mul (m, v); }
+inline Vec3f operator * (const Mat3f &m, const Vec3f &v) { return Mul (m, v); }
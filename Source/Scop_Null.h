@@ -0,0 +1,18 @@
+#pragma once
+
+#define SCOP_BACKEND_NAME "Null"
+
+// There is no window, no input and nothing is drawn. Every Gfx* call only records statistics
+#define SCOP_BACKEND_HEADLESS
+
+struct GfxMeshObjects
+{
+    u32 id;
+};
+
+struct GfxScenePool
+{
+    u32 id;
+};
+
+typedef u32 GfxTexture;
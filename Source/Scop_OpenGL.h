@@ -15,6 +15,19 @@ struct GfxMeshObjects
         };
         GLuint buffers[2];
     };
+
+    // Bytes of the vertices then of the indices in the buffers, see GfxStreamMeshObjects.
+    // Only whole triangles of the indices uploaded so far are drawn
+    s64 uploaded_size;
+    s64 drawable_index_count;
+};
+
+// Shared vertex and index buffers of a scene, with a vertex array that points into them
+struct GfxScenePool
+{
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
 };
 
 enum GLVertexAttribIndex
@@ -22,6 +35,16 @@ enum GLVertexAttribIndex
     GL_Attrib_Position,
     GL_Attrib_Normal,
     GL_Attrib_Tex_Coords,
+
+    // Per instance, one attribute per matrix row
+    GL_Attrib_Instance_Model_Matrix,
+    GL_Attrib_Instance_Normal_Matrix = GL_Attrib_Instance_Model_Matrix + 4,
+    GL_Attrib_Instance_Color = GL_Attrib_Instance_Normal_Matrix + 3,
+};
+
+enum GLUniformBlockBinding
+{
+    GL_Block_Draw_Uniforms,
 };
 
 typedef GLuint GfxTexture;
@@ -0,0 +1,54 @@
+#pragma once
+
+#define SCOP_BACKEND_NAME "Software"
+
+// Frames are rasterized on the CPU into a memory framebuffer. Unless SCOP_SOFTWARE_WINDOW is
+// defined there is no window: the framebuffer can be read from memory or written to an image file
+#ifndef SCOP_SOFTWARE_WINDOW
+    #define SCOP_BACKEND_HEADLESS
+#endif
+
+struct GfxMeshObjects
+{
+    u32 id;
+};
+
+struct Vertex;
+
+struct GfxScenePool
+{
+    Vertex *vertices;
+    u32 *indices;
+};
+
+struct SwTexture
+{
+    u32 width;
+    u32 height;
+    u32 *pixels; // RGBA8, the first row is at v = 0
+};
+
+typedef SwTexture *GfxTexture;
+
+// Rows are stored bottom to top, like the default OpenGL framebuffer
+struct SwFramebuffer
+{
+    u32 width;
+    u32 height;
+    u32 *color; // RGBA8
+    float *depth;
+};
+
+const SwFramebuffer &SwGetFramebuffer ();
+bool SwWriteFramebufferToFile (const char *filename);
+
+enum SwRasterPath
+{
+    SwRasterPath_Scalar, // Reference path, one pixel at a time
+    SwRasterPath_AVX2,   // Rows of 8 pixels with hierarchical depth rejection, the default when the CPU supports it
+};
+
+// Returns false and keeps the current path if the CPU does not support the requested one
+bool SwSetRasterPath (SwRasterPath path);
+SwRasterPath SwGetRasterPath ();
+const char *SwGetRasterPathName (SwRasterPath path);
@@ -0,0 +1,388 @@
+#include "Scop_Core.h"
+#include "Scop_Math.h"
+#include "Scop_Graphics.h"
+
+// The benchmark links against the null graphics backend and never calls GfxInitBackend,
+// so it runs without a window or a graphics context
+
+enum BenchFaceKind
+{
+    BenchFaces_Triangles,
+    BenchFaces_Quads,
+    BenchFaces_Mixed,
+
+    BenchFaces_Count,
+};
+
+static const char *g_bench_face_kind_names[BenchFaces_Count] = {
+    "triangles",
+    "quads",
+    "mixed",
+};
+
+static const s64 g_bench_face_counts[] = {
+    10000,
+    100000,
+    1000000,
+    10000000,
+    100000000,
+};
+
+struct BenchArguments
+{
+    s64 min_faces = 10000;
+    s64 max_faces = 100000;
+    int runs = 1;
+    bool no_weld = false;
+    bool keep_files = false;
+    const char *directory = ".";
+    const char *output_filename = null;
+};
+
+// Generate a wavy grid so that welding, normals and tangents have shared vertices to work with.
+// Mixed files alternate between quads and pairs of triangles, cycle through the p, p/t and p/t/n
+// index forms and are sprinkled with comments and ignored statements
+static bool GenerateObjFile (const char *filename, s64 face_count, BenchFaceKind kind)
+{
+    FILE *file = fopen (filename, "wb");
+    if (!file)
+        return false;
+
+    defer (fclose (file));
+
+    static char file_buffer[1024 * 1024];
+    setvbuf (file, file_buffer, _IOFBF, sizeof (file_buffer));
+
+    s64 cell_count = 0;
+    switch (kind)
+    {
+    case BenchFaces_Triangles: cell_count = (face_count + 1) / 2; break;
+    case BenchFaces_Quads: cell_count = face_count; break;
+    default: cell_count = (face_count * 2 + 2) / 3; break;
+    }
+
+    s64 cells_x = (s64)ceil (sqrt ((f64)cell_count));
+    s64 cells_y = (cell_count + cells_x - 1) / cells_x;
+    s64 verts_x = cells_x + 1;
+    s64 verts_y = cells_y + 1;
+
+    fprintf (file, "# Synthetic OBJ file generated by ScopBench\n");
+    fprintf (file, "# %ld faces (%s), %ld by %ld grid\n", face_count, g_bench_face_kind_names[kind], cells_x, cells_y);
+    fprintf (file, "o Bench_Grid\n");
+
+    for (s64 y = 0; y < verts_y; y += 1)
+    {
+        for (s64 x = 0; x < verts_x; x += 1)
+        {
+            float u = x / (float)cells_x;
+            float v = y / (float)cells_y;
+            float z = sinf (u * 20) * cosf (v * 20) * 0.05f;
+
+            fprintf (file, "v %f %f %f\n", u * 2 - 1, v * 2 - 1, z);
+        }
+    }
+
+    for (s64 y = 0; y < verts_y; y += 1)
+    {
+        for (s64 x = 0; x < verts_x; x += 1)
+            fprintf (file, "vt %f %f\n", x / (float)cells_x, y / (float)cells_y);
+    }
+
+    for (s64 y = 0; y < verts_y; y += 1)
+    {
+        for (s64 x = 0; x < verts_x; x += 1)
+        {
+            float u = x / (float)cells_x;
+            float v = y / (float)cells_y;
+            Vec3f n = Normalized (Vec3f{-cosf (u * 20) * 0.05f, sinf (v * 20) * 0.05f, 1});
+
+            fprintf (file, "vn %f %f %f\n", n.x, n.y, n.z);
+        }
+    }
+
+    fprintf (file, "s off\n");
+
+    s64 faces_written = 0;
+    for (s64 cell = 0; cell < cell_count && faces_written < face_count; cell += 1)
+    {
+        s64 x = cell % cells_x;
+        s64 y = cell / cells_x;
+
+        s64 corners[4] = {
+            y * verts_x + x + 1,
+            y * verts_x + x + 2,
+            (y + 1) * verts_x + x + 2,
+            (y + 1) * verts_x + x + 1,
+        };
+
+        bool emit_quad = kind == BenchFaces_Quads || (kind == BenchFaces_Mixed && cell % 2 == 0);
+
+        int face_corners[2][4] = {};
+        int face_sizes[2] = {};
+        int faces_in_cell = 0;
+        if (emit_quad)
+        {
+            face_corners[0][0] = 0; face_corners[0][1] = 1; face_corners[0][2] = 2; face_corners[0][3] = 3;
+            face_sizes[0] = 4;
+            faces_in_cell = 1;
+        }
+        else
+        {
+            face_corners[0][0] = 0; face_corners[0][1] = 1; face_corners[0][2] = 2;
+            face_corners[1][0] = 0; face_corners[1][1] = 2; face_corners[1][2] = 3;
+            face_sizes[0] = 3;
+            face_sizes[1] = 3;
+            faces_in_cell = 2;
+        }
+
+        for (int f = 0; f < faces_in_cell && faces_written < face_count; f += 1)
+        {
+            if (kind == BenchFaces_Mixed && faces_written % 64 == 0)
+                fprintf (file, "# Face %ld\n", faces_written);
+
+            int form = kind == BenchFaces_Mixed ? faces_written % 3 : 2;
+
+            fprintf (file, "f");
+            for (int i = 0; i < face_sizes[f]; i += 1)
+            {
+                s64 index = corners[face_corners[f][i]];
+
+                switch (form)
+                {
+                case 0: fprintf (file, " %ld", index); break;
+                case 1: fprintf (file, " %ld/%ld", index, index); break;
+                default: fprintf (file, " %ld/%ld/%ld", index, index, index); break;
+                }
+            }
+            fprintf (file, "\n");
+
+            faces_written += 1;
+        }
+    }
+
+    return !ferror (file);
+}
+
+static void PrintStageJSON (FILE *out, const char *name, f64 seconds, s64 file_size, s64 face_count, bool last = false)
+{
+    f64 mb_per_s = seconds > 0 ? file_size / seconds / 1000000.0 : 0;
+    f64 faces_per_s = seconds > 0 ? face_count / seconds : 0;
+
+    fprintf (out, "        \"%s\": {\"seconds\": %.6f, \"mb_per_s\": %.2f, \"faces_per_s\": %.0f}%s\n",
+        name, seconds, mb_per_s, faces_per_s, last ? "" : ",");
+}
+
+static bool ParseCount (const char *str, s64 *result)
+{
+    char *end;
+    f64 value = strtod (str, &end);
+    if (end == str)
+        return false;
+
+    if (*end == 'K' || *end == 'k')
+    {
+        value *= 1000;
+        end += 1;
+    }
+    else if (*end == 'M' || *end == 'm')
+    {
+        value *= 1000000;
+        end += 1;
+    }
+
+    if (*end != 0 || value < 1)
+        return false;
+
+    *result = (s64)value;
+
+    return true;
+}
+
+static bool ParseBenchArguments (int argc, char **argv, BenchArguments *result)
+{
+    const char *Usage = "Usage: ScopBench [--min-faces N] [--max-faces N] [--runs N] [--no-weld] [--keep-files] [--dir directory] [-o output.json]";
+
+    for (int i = 1; i < argc; i += 1)
+    {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : null;
+
+        if (strcmp (arg, "--no-weld") == 0)
+        {
+            result->no_weld = true;
+            continue;
+        }
+        else if (strcmp (arg, "--keep-files") == 0)
+        {
+            result->keep_files = true;
+            continue;
+        }
+
+        if (!value)
+        {
+            LogError ("Missing value for argument '%s'", arg);
+            LogMessage (Usage);
+            return false;
+        }
+
+        i += 1;
+
+        if (strcmp (arg, "--min-faces") == 0)
+        {
+            if (!ParseCount (value, &result->min_faces))
+            {
+                LogError ("Invalid face count '%s'", value);
+                return false;
+            }
+        }
+        else if (strcmp (arg, "--max-faces") == 0)
+        {
+            if (!ParseCount (value, &result->max_faces))
+            {
+                LogError ("Invalid face count '%s'", value);
+                return false;
+            }
+        }
+        else if (strcmp (arg, "--runs") == 0)
+        {
+            s64 runs;
+            if (!ParseCount (value, &runs))
+            {
+                LogError ("Invalid run count '%s'", value);
+                return false;
+            }
+
+            result->runs = (int)runs;
+        }
+        else if (strcmp (arg, "--dir") == 0)
+        {
+            result->directory = value;
+        }
+        else if (strcmp (arg, "-o") == 0)
+        {
+            result->output_filename = value;
+        }
+        else
+        {
+            LogError ("Unknown argument '%s'", arg);
+            LogMessage (Usage);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main (int argc, char **argv)
+{
+    // The report can go to stdout, it has to stay valid JSON
+    SetLogFile (stderr);
+
+    BenchArguments args = {};
+    if (!ParseBenchArguments (argc, argv, &args))
+        return 1;
+
+    FILE *out = stdout;
+    if (args.output_filename)
+    {
+        out = fopen (args.output_filename, "w");
+        if (!out)
+        {
+            LogError ("Could not open '%s' for writing", args.output_filename);
+            return 1;
+        }
+    }
+
+    defer (if (out != stdout) fclose (out));
+
+    LoadMeshFlags flags = LoadMesh_DefaultFlags;
+    if (args.no_weld)
+        flags = (LoadMeshFlags)(flags & ~LoadMesh_WeldMesh);
+
+    fprintf (out, "{\n");
+    fprintf (out, "  \"benchmark\": \"LoadMeshFromObjFile\",\n");
+    fprintf (out, "  \"weld\": %s,\n", args.no_weld ? "false" : "true");
+    fprintf (out, "  \"runs\": %d,\n", args.runs);
+    fprintf (out, "  \"results\": [");
+
+    bool first_result = true;
+    for (int size_index = 0; size_index < (int)StaticArraySize (g_bench_face_counts); size_index += 1)
+    {
+        s64 face_count = g_bench_face_counts[size_index];
+        if (face_count < args.min_faces || face_count > args.max_faces)
+            continue;
+
+        for (int kind = 0; kind < BenchFaces_Count; kind += 1)
+        {
+            char filename[4096];
+            snprintf (filename, sizeof (filename), "%s/scop_bench_%s_%ld.obj", args.directory, g_bench_face_kind_names[kind], face_count);
+
+            if (!GenerateObjFile (filename, face_count, (BenchFaceKind)kind))
+            {
+                LogError ("Could not generate '%s'", filename);
+                return 1;
+            }
+
+            LoadMeshStats best = {};
+            f64 best_total = FLT_MAX;
+            s64 vertex_count = 0;
+            s64 index_count = 0;
+
+            for (int run = 0; run < args.runs; run += 1)
+            {
+                Mesh mesh;
+                memset (&mesh, 0, sizeof (Mesh));
+
+                LoadMeshStats stats = {};
+                if (!LoadMeshFromObjFile (filename, &mesh, flags, &stats))
+                {
+                    LogError ("Could not load mesh '%s'", filename);
+                    return 1;
+                }
+
+                vertex_count = mesh.vertex_count;
+                index_count = mesh.index_count;
+                DestroyMesh (&mesh);
+
+                f64 total = stats.read_time + stats.parse_time + stats.weld_time + stats.normals_time
+                    + stats.tex_coords_time + stats.tangents_time + stats.bounds_time;
+
+                if (total < best_total)
+                {
+                    best = stats;
+                    best_total = total;
+                }
+            }
+
+            if (!args.keep_files)
+                remove (filename);
+
+            fprintf (out, "%s\n    {\n", first_result ? "" : ",");
+            fprintf (out, "      \"kind\": \"%s\",\n", g_bench_face_kind_names[kind]);
+            fprintf (out, "      \"faces\": %ld,\n", face_count);
+            fprintf (out, "      \"triangles\": %ld,\n", best.face_count);
+            fprintf (out, "      \"file_bytes\": %ld,\n", best.file_size);
+            fprintf (out, "      \"vertices\": %ld,\n", vertex_count);
+            fprintf (out, "      \"indices\": %ld,\n", index_count);
+            fprintf (out, "      \"stages\": {\n");
+            PrintStageJSON (out, "read", best.read_time, best.file_size, face_count);
+            PrintStageJSON (out, "parse", best.parse_time, best.file_size, face_count);
+            PrintStageJSON (out, "weld", best.weld_time, best.file_size, face_count);
+            PrintStageJSON (out, "normals", best.normals_time, best.file_size, face_count);
+            PrintStageJSON (out, "tex_coords", best.tex_coords_time, best.file_size, face_count);
+            PrintStageJSON (out, "tangents", best.tangents_time, best.file_size, face_count);
+            PrintStageJSON (out, "bounds", best.bounds_time, best.file_size, face_count, true);
+            fprintf (out, "      },\n");
+            fprintf (out, "      \"total\": {\"seconds\": %.6f, \"mb_per_s\": %.2f, \"faces_per_s\": %.0f}\n",
+                best_total, best.file_size / best_total / 1000000.0, face_count / best_total);
+            fprintf (out, "    }");
+            fflush (out);
+
+            first_result = false;
+        }
+    }
+
+    fprintf (out, "\n  ]\n}\n");
+
+    return 0;
+}
@@ -0,0 +1,302 @@
+#include "Scop_Core.h"
+
+#if defined (SCOP_PLATFORM_WINDOWS)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#if defined (_MSC_VER) && !defined (__clang__)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static FILE *g_log_file;
+
+void SetLogFile (FILE *file)
+{
+    g_log_file = file;
+}
+
+static FILE *GetLogFile ()
+{
+    return g_log_file ? g_log_file : stdout;
+}
+
+void LogMessage (const char *str, ...)
+{
+    FILE *file = GetLogFile ();
+
+    va_list args;
+    va_start (args, str);
+
+    vfprintf (file, str, args);
+
+    va_end (args);
+
+    fprintf (file, "\n");
+}
+
+void LogWarning (const char *str, ...)
+{
+    FILE *file = GetLogFile ();
+
+    fprintf (file, "\x1b[1;33mWarning: ");
+
+    va_list args;
+    va_start (args, str);
+
+    vfprintf (file, str, args);
+
+    va_end (args);
+
+    fprintf (file, "\x1b[0m\n");
+}
+
+void LogError (const char *str, ...)
+{
+    FILE *file = GetLogFile ();
+
+    fprintf (file, "\x1b[1;31mError: ");
+
+    va_list args;
+    va_start (args, str);
+
+    vfprintf (file, str, args);
+
+    va_end (args);
+
+    fprintf (file, "\x1b[0m\n");
+}
+
+Result<String> ReadEntireFile (const char *filename)
+{
+    FILE *file = fopen (filename, "rb");
+    if (!file)
+        return Result<String>::Bad (false);
+
+    defer (fclose (file));
+
+    fseek (file, 0, SEEK_END);
+    s64 size = ftell (file);
+    rewind (file);
+
+    char *data = (char *)malloc (size + 1);
+    if (!data)
+        return Result<String>::Bad (false);
+
+    s64 number_of_bytes_read = fread (data, 1, size, file);
+    data[number_of_bytes_read] = 0;
+
+    String str = String{number_of_bytes_read, data};
+
+    return Result<String>::Good (str, true);
+}
+
+bool WriteEntireFile (const char *filename, const void *data, s64 size)
+{
+    char temp_filename[4096];
+    snprintf (temp_filename, sizeof (temp_filename), "%s.tmp", filename);
+
+    FILE *file = fopen (temp_filename, "wb");
+    if (!file)
+        return false;
+
+    s64 number_of_bytes_written = fwrite (data, 1, size, file);
+    bool ok = fclose (file) == 0 && number_of_bytes_written == size;
+
+#if defined (SCOP_PLATFORM_WINDOWS)
+    ok = ok && MoveFileExA (temp_filename, filename, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && rename (temp_filename, filename) == 0;
+#endif
+
+    if (!ok)
+        remove (temp_filename);
+
+    return ok;
+}
+
+bool MakeDirectory (const char *path)
+{
+#if defined (SCOP_PLATFORM_WINDOWS)
+    return CreateDirectoryA (path, null) || GetLastError () == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir (path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+Result<MappedFile> MapFile (const char *filename)
+{
+    MappedFile result = {};
+
+#if defined (SCOP_PLATFORM_WINDOWS)
+    HANDLE file = CreateFileA (filename, GENERIC_READ, FILE_SHARE_READ, null, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, null);
+    if (file == INVALID_HANDLE_VALUE)
+        return Result<MappedFile>::Bad (false);
+
+    defer (CloseHandle (file));
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx (file, &size) || size.QuadPart == 0)
+        return Result<MappedFile>::Bad (false);
+
+    // The view keeps a reference to the mapping, which keeps one to the file
+    HANDLE mapping = CreateFileMappingA (file, null, PAGE_READONLY, 0, 0, null);
+    if (!mapping)
+        return Result<MappedFile>::Bad (false);
+
+    defer (CloseHandle (mapping));
+
+    result.data = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!result.data)
+        return Result<MappedFile>::Bad (false);
+
+    result.size = size.QuadPart;
+#else
+    int fd = open (filename, O_RDONLY);
+    if (fd < 0)
+        return Result<MappedFile>::Bad (false);
+
+    // The mapping stays valid after the file is closed
+    defer (close (fd));
+
+    struct stat st;
+    if (fstat (fd, &st) != 0 || st.st_size == 0)
+        return Result<MappedFile>::Bad (false);
+
+    result.data = mmap (null, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (result.data == MAP_FAILED)
+        return Result<MappedFile>::Bad (false);
+
+    result.size = st.st_size;
+#endif
+
+    return Result<MappedFile>::Good (result, true);
+}
+
+void UnmapFile (MappedFile *file)
+{
+    if (!file->data)
+        return;
+
+#if defined (SCOP_PLATFORM_WINDOWS)
+    UnmapViewOfFile (file->data);
+#else
+    munmap (file->data, file->size);
+#endif
+
+    *file = {};
+}
+
+u64 HashBytes (const void *data, s64 size, u64 seed)
+{
+    const u8 *bytes = (const u8 *)data;
+
+    u64 hash = seed;
+    for (s64 i = 0; i < size; i += 1)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+f64 GetTimeInSeconds ()
+{
+#if defined (SCOP_PLATFORM_WINDOWS)
+    static LARGE_INTEGER frequency;
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency (&frequency);
+
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter (&counter);
+
+    return counter.QuadPart / (f64)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+void PushTimingSample (TimingHistory *history, f64 seconds)
+{
+    history->samples[history->next] = seconds;
+    history->next = (history->next + 1) % Timing_History_Size;
+    if (history->count < Timing_History_Size)
+        history->count += 1;
+}
+
+f64 GetTimingAverage (const TimingHistory &history)
+{
+    if (history.count == 0)
+        return 0;
+
+    f64 sum = 0;
+    for (s64 i = 0; i < history.count; i += 1)
+        sum += history.samples[i];
+
+    return sum / history.count;
+}
+
+static int CompareF64 (const void *a, const void *b)
+{
+    f64 x = *(const f64 *)a;
+    f64 y = *(const f64 *)b;
+
+    return (x > y) - (x < y);
+}
+
+f64 GetTimingPercentile (const TimingHistory &history, f64 percentile)
+{
+    if (history.count == 0)
+        return 0;
+
+    f64 sorted[Timing_History_Size];
+    memcpy (sorted, history.samples, sizeof (f64) * history.count);
+    qsort (sorted, history.count, sizeof (f64), CompareF64);
+
+    // Nearest rank, the smallest sample that is greater than or equal to the given fraction of all samples
+    f64 exact_rank = percentile * history.count;
+    s64 rank = (s64)exact_rank;
+    if (rank < exact_rank)
+        rank += 1;
+
+    if (rank < 1)
+        rank = 1;
+    if (rank > history.count)
+        rank = history.count;
+
+    return sorted[rank - 1];
+}
+
+bool CPUSupportsAVX2 ()
+{
+#if !defined (SCOP_AVX2_AVAILABLE)
+    return false;
+#elif defined (_MSC_VER) && !defined (__clang__)
+    int info[4];
+    __cpuid (info, 1);
+
+    // The OS has to save the YMM registers on context switches
+    bool avx = (info[2] & (1 << 28)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!avx || !osxsave || (_xgetbv (0) & 6) != 6)
+        return false;
+
+    __cpuidex (info, 7, 0);
+
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports ("avx2");
+#endif
+}
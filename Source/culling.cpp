@@ -0,0 +1,212 @@
+#include "Scop_Core.h"
+#include "Scop_Math.h"
+#include "Scop_Graphics.h"
+
+#ifdef SCOP_AVX2_AVAILABLE
+    #include <immintrin.h>
+#endif
+
+Frustum ExtractFrustumPlanes (const Mat4f &m)
+{
+    Vec4f r0 = Vec4f{m.r0c0, m.r0c1, m.r0c2, m.r0c3};
+    Vec4f r1 = Vec4f{m.r1c0, m.r1c1, m.r1c2, m.r1c3};
+    Vec4f r2 = Vec4f{m.r2c0, m.r2c1, m.r2c2, m.r2c3};
+    Vec4f r3 = Vec4f{m.r3c0, m.r3c1, m.r3c2, m.r3c3};
+
+    // -w <= x, y, z <= w in clip space. With an infinite projection the far plane
+    // is (0, 0, 0, positive) and never rejects anything
+    Frustum result;
+    result.planes[0] = r3 + r0;
+    result.planes[1] = r3 - r0;
+    result.planes[2] = r3 + r1;
+    result.planes[3] = r3 - r1;
+    result.planes[4] = r3 + r2;
+    result.planes[5] = r3 - r2;
+
+    return result;
+}
+
+void PushCullBox (CullBoxes *boxes, const Vec3f &aabb_min, const Vec3f &aabb_max)
+{
+    ArrayPush (&boxes->min_x, aabb_min.x);
+    ArrayPush (&boxes->min_y, aabb_min.y);
+    ArrayPush (&boxes->min_z, aabb_min.z);
+    ArrayPush (&boxes->max_x, aabb_max.x);
+    ArrayPush (&boxes->max_y, aabb_max.y);
+    ArrayPush (&boxes->max_z, aabb_max.z);
+}
+
+void SetCullBox (CullBoxes *boxes, s64 index, const Vec3f &aabb_min, const Vec3f &aabb_max)
+{
+    boxes->min_x[index] = aabb_min.x;
+    boxes->min_y[index] = aabb_min.y;
+    boxes->min_z[index] = aabb_min.z;
+    boxes->max_x[index] = aabb_max.x;
+    boxes->max_y[index] = aabb_max.y;
+    boxes->max_z[index] = aabb_max.z;
+}
+
+void ClearCullBoxes (CullBoxes *boxes)
+{
+    ArrayClear (&boxes->min_x);
+    ArrayClear (&boxes->min_y);
+    ArrayClear (&boxes->min_z);
+    ArrayClear (&boxes->max_x);
+    ArrayClear (&boxes->max_y);
+    ArrayClear (&boxes->max_z);
+}
+
+void FreeCullBoxes (CullBoxes *boxes)
+{
+    ArrayFree (&boxes->min_x);
+    ArrayFree (&boxes->min_y);
+    ArrayFree (&boxes->min_z);
+    ArrayFree (&boxes->max_x);
+    ArrayFree (&boxes->max_y);
+    ArrayFree (&boxes->max_z);
+}
+
+// The corner of the box that is the furthest along the plane normal is the last one to leave
+// the plane. If it is outside, the whole box is. Picking it only depends on the signs of the
+// plane, so the choice is made once per plane instead of once per box
+struct CullPlaneInputs
+{
+    float a, b, c, d;
+    const float *x;
+    const float *y;
+    const float *z;
+};
+
+static void GetCullPlaneInputs (const Frustum &frustum, const CullBoxes &boxes, CullPlaneInputs *inputs)
+{
+    for (int i = 0; i < 6; i += 1)
+    {
+        const Vec4f &plane = frustum.planes[i];
+
+        inputs[i].a = plane.x;
+        inputs[i].b = plane.y;
+        inputs[i].c = plane.z;
+        inputs[i].d = plane.w;
+        inputs[i].x = plane.x >= 0 ? boxes.max_x.data : boxes.min_x.data;
+        inputs[i].y = plane.y >= 0 ? boxes.max_y.data : boxes.min_y.data;
+        inputs[i].z = plane.z >= 0 ? boxes.max_z.data : boxes.min_z.data;
+    }
+}
+
+static s64 CullBoxesScalar (const CullPlaneInputs *planes, s64 start, s64 end, u8 *visible)
+{
+    s64 visible_count = 0;
+    for (s64 i = start; i < end; i += 1)
+    {
+        bool outside = false;
+        for (int p = 0; p < 6; p += 1)
+        {
+            const CullPlaneInputs &plane = planes[p];
+            float distance = (plane.a * plane.x[i] + plane.b * plane.y[i]) + (plane.c * plane.z[i] + plane.d);
+            outside |= distance < 0;
+        }
+
+        visible[i] = !outside;
+        visible_count += !outside;
+    }
+
+    return visible_count;
+}
+
+#ifdef SCOP_AVX2_AVAILABLE
+
+SCOP_TARGET_AVX2
+static s64 CullBoxesAVX2 (const CullPlaneInputs *planes, s64 count, u8 *visible)
+{
+    s64 visible_count = 0;
+    for (s64 i = 0; i + 8 <= count; i += 8)
+    {
+        __m256 outside = _mm256_setzero_ps ();
+        for (int p = 0; p < 6; p += 1)
+        {
+            const CullPlaneInputs &plane = planes[p];
+
+            __m256 distance = _mm256_add_ps (
+                _mm256_add_ps (
+                    _mm256_mul_ps (_mm256_set1_ps (plane.a), _mm256_loadu_ps (plane.x + i)),
+                    _mm256_mul_ps (_mm256_set1_ps (plane.b), _mm256_loadu_ps (plane.y + i))
+                ),
+                _mm256_add_ps (
+                    _mm256_mul_ps (_mm256_set1_ps (plane.c), _mm256_loadu_ps (plane.z + i)),
+                    _mm256_set1_ps (plane.d)
+                )
+            );
+
+            outside = _mm256_or_ps (outside, _mm256_cmp_ps (distance, _mm256_setzero_ps (), _CMP_LT_OQ));
+        }
+
+        int visible_mask = ~_mm256_movemask_ps (outside) & 0xff;
+        for (int j = 0; j < 8; j += 1)
+        {
+            visible[i + j] = (visible_mask >> j) & 1;
+            visible_count += visible[i + j];
+        }
+    }
+
+    return visible_count;
+}
+
+#endif
+
+s64 CullBoxesAgainstFrustum (const Frustum &frustum, const CullBoxes &boxes, u8 *visible)
+{
+    s64 count = boxes.min_x.count;
+
+    CullPlaneInputs planes[6];
+    GetCullPlaneInputs (frustum, boxes, planes);
+
+    // Boxes that do not fill a group of 8 go through the scalar path, which does the same
+    // operations in the same order
+    s64 simd_count = 0;
+    s64 visible_count = 0;
+
+#ifdef SCOP_AVX2_AVAILABLE
+    static bool avx2_supported = CPUSupportsAVX2 ();
+    if (avx2_supported)
+    {
+        simd_count = count - count % 8;
+        visible_count += CullBoxesAVX2 (planes, simd_count, visible);
+    }
+#endif
+
+    visible_count += CullBoxesScalar (planes, simd_count, count, visible);
+
+    return visible_count;
+}
+
+void TransformBoundingBox (const Mat4f &m, const Vec3f &aabb_min, const Vec3f &aabb_max, Vec3f *result_min, Vec3f *result_max)
+{
+    // Each row of the matrix moves each bound by the smallest and largest of its products
+    // with the box extents (Arvo, Transforming Axis-Aligned Bounding Boxes)
+    const float rows[3][4] = {
+        {m.r0c0, m.r0c1, m.r0c2, m.r0c3},
+        {m.r1c0, m.r1c1, m.r1c2, m.r1c3},
+        {m.r2c0, m.r2c1, m.r2c2, m.r2c3},
+    };
+    const float in_min[3] = {aabb_min.x, aabb_min.y, aabb_min.z};
+    const float in_max[3] = {aabb_max.x, aabb_max.y, aabb_max.z};
+
+    float out_min[3];
+    float out_max[3];
+    for (int i = 0; i < 3; i += 1)
+    {
+        out_min[i] = rows[i][3];
+        out_max[i] = rows[i][3];
+
+        for (int j = 0; j < 3; j += 1)
+        {
+            float a = rows[i][j] * in_min[j];
+            float b = rows[i][j] * in_max[j];
+            out_min[i] += Min (a, b);
+            out_max[i] += Max (a, b);
+        }
+    }
+
+    *result_min = Vec3f{out_min[0], out_min[1], out_min[2]};
+    *result_max = Vec3f{out_max[0], out_max[1], out_max[2]};
+}
@@ -0,0 +1,176 @@
+#include "Scop_Core.h"
+#include "Scop_Graphics.h"
+
+// Minimal PNG writer: 8 bit RGBA, no filtering, zlib stream made of stored (uncompressed) blocks
+
+static u32 g_crc_table[256];
+
+static void InitCRCTable ()
+{
+    if (g_crc_table[1] != 0)
+        return;
+
+    for (u32 n = 0; n < 256; n += 1)
+    {
+        u32 c = n;
+        for (int k = 0; k < 8; k += 1)
+        {
+            if (c & 1)
+                c = 0xedb88320 ^ (c >> 1);
+            else
+                c = c >> 1;
+        }
+
+        g_crc_table[n] = c;
+    }
+}
+
+static u32 UpdateCRC (u32 crc, const u8 *data, s64 size)
+{
+    for (s64 i = 0; i < size; i += 1)
+        crc = g_crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+static void WriteU32BigEndian (u8 *dest, u32 value)
+{
+    dest[0] = (u8)(value >> 24);
+    dest[1] = (u8)(value >> 16);
+    dest[2] = (u8)(value >> 8);
+    dest[3] = (u8)value;
+}
+
+struct PNGWriter
+{
+    FILE *file;
+    u32 chunk_crc;
+    u32 adler_a;
+    u32 adler_b;
+    s64 block_remaining;
+};
+
+static void BeginChunk (PNGWriter *w, const char *type, u32 size)
+{
+    u8 header[8];
+    WriteU32BigEndian (header, size);
+    memcpy (header + 4, type, 4);
+
+    fwrite (header, 1, 8, w->file);
+    w->chunk_crc = UpdateCRC (0xffffffff, header + 4, 4);
+}
+
+static void WriteChunkData (PNGWriter *w, const void *data, s64 size)
+{
+    fwrite (data, 1, size, w->file);
+    w->chunk_crc = UpdateCRC (w->chunk_crc, (const u8 *)data, size);
+}
+
+static void EndChunk (PNGWriter *w)
+{
+    u8 crc[4];
+    WriteU32BigEndian (crc, w->chunk_crc ^ 0xffffffff);
+    fwrite (crc, 1, 4, w->file);
+}
+
+// Write raw scanline bytes to the zlib stream, starting a new stored block every 65535 bytes
+static void WriteDeflateBytes (PNGWriter *w, const u8 *data, s64 size, s64 total_remaining)
+{
+    while (size > 0)
+    {
+        if (w->block_remaining == 0)
+        {
+            u16 block_size = (u16)Min (total_remaining, (s64)65535);
+            u8 header[5];
+            header[0] = total_remaining <= 65535 ? 1 : 0;
+            header[1] = (u8)block_size;
+            header[2] = (u8)(block_size >> 8);
+            header[3] = (u8)~block_size;
+            header[4] = (u8)(~block_size >> 8);
+
+            WriteChunkData (w, header, 5);
+            w->block_remaining = block_size;
+        }
+
+        s64 n = Min (size, w->block_remaining);
+        WriteChunkData (w, data, n);
+
+        for (s64 i = 0; i < n; i += 1)
+        {
+            w->adler_a = (w->adler_a + data[i]) % 65521;
+            w->adler_b = (w->adler_b + w->adler_a) % 65521;
+        }
+
+        data += n;
+        size -= n;
+        total_remaining -= n;
+        w->block_remaining -= n;
+    }
+}
+
+bool WritePNGFile (const char *filename, const u8 *rgba, u32 width, u32 height, bool flip_vertically)
+{
+    InitCRCTable ();
+
+    FILE *file = fopen (filename, "wb");
+    if (!file)
+        return false;
+
+    defer (fclose (file));
+
+    PNGWriter w = {};
+    w.file = file;
+    w.adler_a = 1;
+
+    static const u8 Signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite (Signature, 1, 8, file);
+
+    u8 ihdr[13];
+    WriteU32BigEndian (ihdr + 0, width);
+    WriteU32BigEndian (ihdr + 4, height);
+    ihdr[8] = 8;  // Bit depth
+    ihdr[9] = 6;  // RGBA
+    ihdr[10] = 0; // Deflate
+    ihdr[11] = 0; // Adaptive filtering
+    ihdr[12] = 0; // No interlace
+
+    BeginChunk (&w, "IHDR", 13);
+    WriteChunkData (&w, ihdr, 13);
+    EndChunk (&w);
+
+    s64 row_size = 1 + (s64)width * 4;
+    s64 raw_size = row_size * height;
+    s64 block_count = Max ((raw_size + 65534) / 65535, (s64)1);
+    s64 idat_size = 2 + raw_size + block_count * 5 + 4;
+
+    if (idat_size > 0x7fffffff)
+        return false;
+
+    BeginChunk (&w, "IDAT", (u32)idat_size);
+
+    u8 zlib_header[2] = {0x78, 0x01};
+    WriteChunkData (&w, zlib_header, 2);
+
+    s64 remaining = raw_size;
+    for (u32 y = 0; y < height; y += 1)
+    {
+        u32 src_y = flip_vertically ? height - 1 - y : y;
+
+        u8 filter = 0;
+        WriteDeflateBytes (&w, &filter, 1, remaining);
+        remaining -= 1;
+
+        WriteDeflateBytes (&w, rgba + (s64)src_y * width * 4, (s64)width * 4, remaining);
+        remaining -= (s64)width * 4;
+    }
+
+    u8 adler[4];
+    WriteU32BigEndian (adler, (w.adler_b << 16) | w.adler_a);
+    WriteChunkData (&w, adler, 4);
+    EndChunk (&w);
+
+    BeginChunk (&w, "IEND", 0);
+    EndChunk (&w);
+
+    return !ferror (file);
+}
@@ -0,0 +1,229 @@
+#include "Scop_Core.h"
+#include "Scop_Math.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#define Job_Queue_Capacity 4096
+
+struct Job
+{
+    JobProc proc;
+    void *data;
+    JobGroup *group;
+};
+
+struct JobQueue
+{
+    std::mutex mutex;
+    std::condition_variable has_jobs;
+    std::condition_variable wake_waiters; // A group finished, or a job was queued while someone is waiting
+    s64 waiter_count = 0;
+    Job jobs[Job_Queue_Capacity];
+    s64 head = 0;
+    s64 count = 0;
+    bool quit = false;
+};
+
+static JobQueue g_job_queue;
+static std::thread *g_workers;
+static int g_worker_count;
+
+static void RunJob (const Job &job)
+{
+    job.proc (job.data);
+
+    if (job.group && job.group->pending.fetch_sub (1) == 1)
+    {
+        // Notifying under the lock makes sure a waiter cannot miss it between its check and its wait
+        std::lock_guard<std::mutex> lock (g_job_queue.mutex);
+        if (g_job_queue.waiter_count > 0)
+            g_job_queue.wake_waiters.notify_all ();
+    }
+}
+
+static bool TryPopJob (Job *job)
+{
+    std::lock_guard<std::mutex> lock (g_job_queue.mutex);
+    if (g_job_queue.count == 0)
+        return false;
+
+    *job = g_job_queue.jobs[g_job_queue.head];
+    g_job_queue.head = (g_job_queue.head + 1) % Job_Queue_Capacity;
+    g_job_queue.count -= 1;
+
+    return true;
+}
+
+static void WorkerThreadMain ()
+{
+    while (true)
+    {
+        Job job;
+
+        {
+            std::unique_lock<std::mutex> lock (g_job_queue.mutex);
+            g_job_queue.has_jobs.wait (lock, [] () { return g_job_queue.quit || g_job_queue.count > 0; });
+
+            if (g_job_queue.quit && g_job_queue.count == 0)
+                return;
+
+            job = g_job_queue.jobs[g_job_queue.head];
+            g_job_queue.head = (g_job_queue.head + 1) % Job_Queue_Capacity;
+            g_job_queue.count -= 1;
+        }
+
+        RunJob (job);
+    }
+}
+
+void InitJobSystem (int worker_count)
+{
+    Assert (g_workers == null, "Job system is already initialized");
+
+    if (worker_count < 0)
+    {
+        // Leave one core to the main thread, it helps with the work while waiting
+        worker_count = (int)std::thread::hardware_concurrency () - 1;
+        worker_count = Max (worker_count, 0);
+    }
+
+    g_job_queue.quit = false;
+    g_worker_count = worker_count;
+    if (worker_count == 0)
+        return;
+
+    g_workers = new std::thread[worker_count];
+    for (int i = 0; i < worker_count; i += 1)
+        g_workers[i] = std::thread (WorkerThreadMain);
+}
+
+void ShutdownJobSystem ()
+{
+    {
+        std::lock_guard<std::mutex> lock (g_job_queue.mutex);
+        g_job_queue.quit = true;
+    }
+
+    g_job_queue.has_jobs.notify_all ();
+
+    for (int i = 0; i < g_worker_count; i += 1)
+        g_workers[i].join ();
+
+    delete[] g_workers;
+    g_workers = null;
+    g_worker_count = 0;
+}
+
+int GetWorkerCount ()
+{
+    return g_worker_count;
+}
+
+void PushJob (JobGroup *group, JobProc proc, void *data)
+{
+    Job job = {};
+    job.proc = proc;
+    job.data = data;
+    job.group = group;
+
+    if (group)
+        group->pending.fetch_add (1);
+
+    bool queued = false;
+    if (g_worker_count > 0)
+    {
+        std::lock_guard<std::mutex> lock (g_job_queue.mutex);
+        if (g_job_queue.count < Job_Queue_Capacity)
+        {
+            s64 index = (g_job_queue.head + g_job_queue.count) % Job_Queue_Capacity;
+            g_job_queue.jobs[index] = job;
+            g_job_queue.count += 1;
+            queued = true;
+
+            if (g_job_queue.waiter_count > 0)
+                g_job_queue.wake_waiters.notify_all ();
+        }
+    }
+
+    // Without workers, or when the queue is full, the job runs on the calling thread
+    if (queued)
+        g_job_queue.has_jobs.notify_one ();
+    else
+        RunJob (job);
+}
+
+bool IsDone (JobGroup *group)
+{
+    return group->pending.load () == 0;
+}
+
+void WaitForJobs (JobGroup *group)
+{
+    // Help with any queued job instead of sleeping, the jobs of the group might be behind them
+    while (group->pending.load () > 0)
+    {
+        Job job;
+        if (TryPopJob (&job))
+        {
+            RunJob (job);
+            continue;
+        }
+
+        // Nothing to help with, sleep until the group is done or more jobs are queued
+        std::unique_lock<std::mutex> lock (g_job_queue.mutex);
+        g_job_queue.waiter_count += 1;
+        g_job_queue.wake_waiters.wait (lock, [group] () { return group->pending.load () == 0 || g_job_queue.count > 0; });
+        g_job_queue.waiter_count -= 1;
+    }
+}
+
+struct ParallelForData
+{
+    std::atomic<s64> next;
+    s64 count;
+    s64 batch_size;
+    ParallelForProc proc;
+    void *data;
+};
+
+static void ParallelForJob (void *data)
+{
+    ParallelForData *pf = (ParallelForData *)data;
+
+    while (true)
+    {
+        s64 start = pf->next.fetch_add (pf->batch_size);
+        if (start >= pf->count)
+            break;
+
+        s64 end = Min (start + pf->batch_size, pf->count);
+        for (s64 i = start; i < end; i += 1)
+            pf->proc (i, pf->data);
+    }
+}
+
+void ParallelFor (s64 count, ParallelForProc proc, void *data, s64 batch_size)
+{
+    if (count <= 0)
+        return;
+
+    ParallelForData pf;
+    pf.next.store (0);
+    pf.count = count;
+    pf.batch_size = Max (batch_size, (s64)1);
+    pf.proc = proc;
+    pf.data = data;
+
+    s64 batch_count = (count + pf.batch_size - 1) / pf.batch_size;
+    s64 job_count = Min ((s64)g_worker_count, batch_count - 1);
+
+    JobGroup group;
+    for (s64 i = 0; i < job_count; i += 1)
+        PushJob (&group, ParallelForJob, &pf);
+
+    ParallelForJob (&pf);
+    WaitForJobs (&group);
+}
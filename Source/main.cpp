@@ -2,19 +2,135 @@
 #include "Scop_Math.h"
 #include "Scop_Graphics.h"
 
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#ifndef SCOP_BACKEND_HEADLESS
 GLFWwindow *g_main_window = null;
+#endif
+
 Camera g_camera;
 
 static float g_model_rotation;
 static Vec3f g_model_position;
+static float g_camera_max_distance = 10;
 
 #define Camera_Rotate_Speed 0.1
 #define Camera_Movement_Speed 0.1
 #define Model_Rotate_Speed 0.1
 #define Model_Move_Speed 0.1
 
+// Per frame animation speeds are tuned for updates at this rate, and scaled by the time
+// since the last update, of which at most Max_Update_Delta_Time is accounted for
+#define Update_Reference_Rate 60.0
+#define Max_Update_Delta_Time 0.1
+
+// Distance between the copies of --grid, relative to the widest horizontal extent of the mesh
+#define Grid_Spacing 1.25
+
+// Simulated mouse movement per frame when there is no window to get input from
+#define Headless_Orbit_Delta 10
+#define Headless_Default_Frame_Count 600
+
+// --turntable renders every mesh from this many degrees above, filling the view
+#define Turntable_Pitch 20
+#define Turntable_Fill 0.9
+#define Turntable_Default_Size 512
+
+// Rendered images waiting to be encoded, beyond which rendering waits for the encoders
+#define Turntable_Max_Pending_Images 64
+
+// Meshes at least this large, in bytes, are uploaded over several frames with at most this
+// much time spent uploading per frame, in seconds. --stream streams every mesh
+#define Mesh_Stream_Threshold (256 * 1024 * 1024)
+#define Mesh_Stream_Frame_Budget 0.002
+
+// The texture fades in and out by this fraction of the remaining distance per reference step, and
+// snaps to its target once closer than a step of an 8 bit color channel
+#define Texture_Fade_Speed 0.1
+#define Texture_Fade_Epsilon (1 / 512.0f)
+
+// --dynamic-resolution can render above the framebuffer resolution, up to this scale
+#define Dynamic_Resolution_Max_Scale 2.0
+
+// --on-demand sleeps until an event arrives or for this long, in seconds, when nothing moves
+#define On_Demand_Wait_Timeout 0.5
+
 static Vec2f g_mouse_delta;
 static Vec2f g_mouse_wheel;
+static bool g_window_damaged; // The window has to be redrawn even if nothing changed
+
+// What a frame is drawn with, --on-demand skips the frames that would look like the last one
+struct RedrawState
+{
+    Mat4f view_projection_matrix;
+    Mat4f model_matrix;
+    float texture_alpha;
+    bool flat_shading;
+};
+
+// Rolling CPU timings of the main loop, and backend timings of the passes of GfxRenderFrame.
+// Logged with the T key, or at the end of a run with a fixed frame count
+struct FrameTimings
+{
+    TimingHistory frame;
+    TimingHistory input;
+    TimingHistory camera;
+    TimingHistory submit;
+
+    int pass_count;
+    const char *pass_names[Gfx_Max_Passes];
+    TimingHistory passes[Gfx_Max_Passes];
+};
+
+static FrameTimings g_frame_timings;
+
+// --render-thread hands frames to a render thread. The main thread keeps handling input and
+// moving the camera, at most once every Render_Thread_Update_Interval seconds
+#define Render_Thread_Update_Interval (1 / 240.0)
+
+// Everything a frame is drawn with that the main thread changes from one frame to the next
+struct RenderSnapshot
+{
+    RenderFrameParams params; // Points to the arrays below
+    Array<RenderInstance> instances;
+    Array<u8> scene_visibility;
+};
+
+// Snapshots go through a triple buffer: the main thread owns the slot it writes, the render
+// thread owns the slot it reads, and the third slot is in between. Publishing swaps the
+// written slot with the middle one, reading swaps the middle slot with the read one if it
+// holds a snapshot that was not read yet. Neither side waits for the other and the render
+// thread always gets the latest snapshot, the ones it had no time for are dropped
+#define Render_Snapshot_New 0x4
+
+struct RenderThread
+{
+    RenderSnapshot snapshots[3];
+    int write_slot;
+    int read_slot;
+    std::atomic<int> middle_slot;
+
+    // Only to sleep while there is nothing new to render, snapshots do not need the lock
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+
+    std::atomic<bool> quit;
+    std::atomic<bool> log_timings_requested;
+    std::atomic<bool> mesh_streaming;
+    std::atomic<s64> rendered_frame_count;
+
+    Mesh *streamed_mesh;
+    const char *streamed_mesh_name;
+
+    // Render thread side of g_frame_timings: time between rendered frames, submit and passes
+    FrameTimings timings;
+
+    std::thread thread;
+};
+
+static RenderThread g_render_thread;
 
 struct ProgramArguments
 {
@@ -22,63 +138,118 @@ struct ProgramArguments
     const char *texture_filename = null;
     Vec3f light_position = Vec3f{10,10,10};
     Vec3f light_color = Vec3f{1,1,1};
+    int grid_size = 0; // Draw grid_size by grid_size instances of the mesh when not 0
+    bool scene = false; // mesh_filename is a scene file listing many meshes, see LoadSceneFromFile
+    bool no_cull = false;
+    bool no_occlusion = false;
+    bool flat_shading = false; // Toggled with F when there is a window
+    bool stream_mesh = false;
+    bool on_demand = false; // Only redraw when something changed, sleep otherwise
+    bool render_thread = false;
+
+    // Used when target_frame_time is not 0, see GfxDynamicResolution
+    GfxDynamicResolution dynamic_resolution = {0, 0, 0};
+
+    // When turntable_angle_count is not 0 every positional argument is a mesh, each one is
+    // rendered offscreen from that many angles around it and written to output_dir
+    int turntable_angle_count = 0;
+    int output_width = 0;
+    int output_height = 0;
+    const char *output_dir = ".";
+    char **turntable_mesh_filenames = null;
+    int turntable_mesh_count = 0;
+
+#ifdef SCOP_BACKEND_HEADLESS
+    int frame_count = Headless_Default_Frame_Count;
+#else
+    int frame_count = 0; // 0 means run until the window is closed
+#endif
+
+#ifdef SCOP_BACKEND_SOFTWARE
+    const char *output_filename = null;
+    const char *raster_path_name = null;
+#endif
 };
 
-static void UpdateInput ()
+// Waits for at most wait_timeout seconds for events, 0 only polls
+static void UpdateInput (f64 wait_timeout)
 {
     g_mouse_wheel = Vec2f{};
 
+#ifdef SCOP_BACKEND_HEADLESS
+    // Pretend the user is dragging the camera around the model
+    if (wait_timeout > 0)
+        std::this_thread::sleep_for (std::chrono::duration<f64> (wait_timeout));
+
+    g_mouse_delta = Vec2f{Headless_Orbit_Delta, 0};
+#else
+
     double x, y;
     glfwGetCursorPos (g_main_window, &x, &y);
 
-    glfwPollEvents ();
+    if (wait_timeout > 0)
+        glfwWaitEventsTimeout (wait_timeout);
+    else
+        glfwPollEvents ();
 
     double new_x, new_y;
     glfwGetCursorPos (g_main_window, &new_x, &new_y);
 
     g_mouse_delta.x = (float)(new_x - x);
     g_mouse_delta.y = (float)(new_y - y);
+#endif
+}
+
+static void UpdateCameraMatrices ()
+{
+    Mat4f rotation_matrix = Mat4fRotate (Vec3f{0,1,0}, ToRads (g_camera.yaw_pitch.x))
+        * Mat4fRotate (Vec3f{1,0,0}, ToRads (g_camera.yaw_pitch.y));
+
+    g_camera.position =
+        g_camera.target
+        + ForwardVector (rotation_matrix) * g_camera.distance_from_target
+        + Vec3f{g_camera.offset.x, g_camera.offset.y, 0};
+
+    Mat4f transform = Mat4fTranslate (g_camera.position) * rotation_matrix;
+
+    int width, height;
+    GfxGetFramebufferSize (&width, &height);
+
+    g_camera.view_matrix = Inverted (transform);
+    g_camera.projection_matrix = Mat4fPerspectiveProjection (70, width / (float)height, 0.1);
+    g_camera.view_projection_matrix = g_camera.projection_matrix * g_camera.view_matrix;
 }
 
 static void UpdateCamera ()
 {
     Vec2f mouse_input = Vec2f{};
 
+#ifdef SCOP_BACKEND_HEADLESS
+    mouse_input = g_mouse_delta;
+#else
     if (glfwGetMouseButton (g_main_window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS)
     {
         glfwSetInputMode (g_main_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
         mouse_input = g_mouse_delta;
     }
+#endif
 
     g_camera.distance_from_target = Clamp (
         g_camera.distance_from_target - g_mouse_wheel.y * 0.5,
-        1, 10
+        1, g_camera_max_distance
     );
 
     g_camera.yaw_pitch.x += mouse_input.x * Camera_Rotate_Speed;
     g_camera.yaw_pitch.y += mouse_input.y * Camera_Rotate_Speed;
     g_camera.yaw_pitch.y = Clamp (g_camera.yaw_pitch.y, -90, 90);
 
-    Mat4f rotation_matrix = Mat4fRotate (Vec3f{0,1,0}, ToRads (g_camera.yaw_pitch.x))
-        * Mat4fRotate (Vec3f{1,0,0}, ToRads (g_camera.yaw_pitch.y));
-
-    g_camera.position =
-        g_camera.target
-        + ForwardVector (rotation_matrix) * g_camera.distance_from_target
-        + Vec3f{g_camera.offset.x, g_camera.offset.y, 0};
-
-    Mat4f transform = Mat4fTranslate (g_camera.position) * rotation_matrix;
-
-    int width, height;
-    glfwGetFramebufferSize (g_main_window, &width, &height);
-
-    g_camera.view_matrix = Inverted (transform);
-    g_camera.projection_matrix = Mat4fPerspectiveProjection (70, width / (float)height, 0.1);
-    g_camera.view_projection_matrix = g_camera.projection_matrix * g_camera.view_matrix;
+    UpdateCameraMatrices ();
 }
 
-static void UpdateModelTransform ()
+#ifndef SCOP_BACKEND_HEADLESS
+
+static void UpdateModelTransform (float update_steps)
 {
     Vec2f mouse_input = Vec2f{};
     if (glfwGetMouseButton (g_main_window, GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS)
@@ -100,7 +271,7 @@ static void UpdateModelTransform ()
 
     move_input = Normalized (move_input);
 
-    g_model_position += move_input * Model_Move_Speed;
+    g_model_position += move_input * (Model_Move_Speed * update_steps);
 }
 
 static void GLFWScrollCallback (GLFWwindow *window, double x, double y)
@@ -110,6 +281,216 @@ static void GLFWScrollCallback (GLFWwindow *window, double x, double y)
     g_mouse_wheel.y += (float)y;
 }
 
+// The contents of the window were lost, for example when it was uncovered or resized
+static void GLFWWindowRefreshCallback (GLFWwindow *window)
+{
+    (void)window;
+    g_window_damaged = true;
+}
+
+#endif
+
+static void LogTimingHistory (const char *name, const TimingHistory &history)
+{
+    // With a render thread each thread only records its own part of the frame
+    if (history.count == 0)
+        return;
+
+    LogMessage ("  %-8s avg %7.3f ms, p99 %7.3f ms", name,
+        GetTimingAverage (history) * 1000, GetTimingPercentile (history, 0.99) * 1000);
+}
+
+static void LogFrameTimings (const FrameTimings &timings, const char *title = "CPU timings")
+{
+    LogMessage ("%s over the last %ld frames:", title, timings.frame.count);
+    LogTimingHistory ("Frame", timings.frame);
+    LogTimingHistory ("Input", timings.input);
+    LogTimingHistory ("Camera", timings.camera);
+    LogTimingHistory ("Submit", timings.submit);
+
+    if (timings.pass_count > 0)
+    {
+        LogMessage ("%s pass timings over the last %ld frames:", SCOP_BACKEND_NAME, timings.passes[0].count);
+        for (int i = 0; i < timings.pass_count; i += 1)
+            LogTimingHistory (timings.pass_names[i], timings.passes[i]);
+    }
+}
+
+static void CollectPassTimings (FrameTimings *timings)
+{
+    GfxPassTimings pass_timings;
+    if (!GfxGetPassTimings (&pass_timings))
+        return;
+
+    // The set of passes can change from one frame to the next, start over when it does
+    bool same_passes = pass_timings.pass_count == timings->pass_count;
+    for (int i = 0; same_passes && i < pass_timings.pass_count; i += 1)
+        same_passes = strcmp (pass_timings.pass_names[i], timings->pass_names[i]) == 0;
+
+    if (!same_passes)
+    {
+        timings->pass_count = pass_timings.pass_count;
+        for (int i = 0; i < pass_timings.pass_count; i += 1)
+        {
+            timings->pass_names[i] = pass_timings.pass_names[i];
+            timings->passes[i].count = 0;
+            timings->passes[i].next = 0;
+        }
+    }
+
+    for (int i = 0; i < pass_timings.pass_count; i += 1)
+        PushTimingSample (&timings->passes[i], pass_timings.pass_times[i]);
+}
+
+// Copy the params and the arrays they point to, the mesh, scene and texture do not change
+// while the render thread runs
+static void PublishRenderSnapshot (RenderThread *thread, const RenderFrameParams &params)
+{
+    RenderSnapshot *snapshot = &thread->snapshots[thread->write_slot];
+    snapshot->params = params;
+
+    ArrayClear (&snapshot->instances);
+    if (params.instances)
+    {
+        ArrayReserve (&snapshot->instances, Max (params.instance_count, (s64)1));
+        memcpy (snapshot->instances.data, params.instances, sizeof (RenderInstance) * params.instance_count);
+        snapshot->instances.count = params.instance_count;
+
+        snapshot->params.instances = snapshot->instances.data;
+    }
+
+    ArrayClear (&snapshot->scene_visibility);
+    if (params.scene && params.scene_visibility)
+    {
+        s64 object_count = params.scene->objects.count;
+        ArrayReserve (&snapshot->scene_visibility, Max (object_count, (s64)1));
+        memcpy (snapshot->scene_visibility.data, params.scene_visibility, object_count);
+        snapshot->scene_visibility.count = object_count;
+
+        snapshot->params.scene_visibility = snapshot->scene_visibility.data;
+    }
+
+    int previous = thread->middle_slot.exchange (thread->write_slot | Render_Snapshot_New, std::memory_order_acq_rel);
+    thread->write_slot = previous & ~Render_Snapshot_New;
+
+    // Locking orders the notification after the render thread either saw the new snapshot
+    // or started waiting, so that it cannot be missed
+    {
+        std::lock_guard<std::mutex> lock (thread->wake_mutex);
+    }
+    thread->wake.notify_one ();
+}
+
+static bool HasNewRenderSnapshot (RenderThread *thread)
+{
+    return (thread->middle_slot.load (std::memory_order_acquire) & Render_Snapshot_New) != 0;
+}
+
+// Returns null if nothing was published since the last call
+static RenderSnapshot *AcquireRenderSnapshot (RenderThread *thread)
+{
+    if (!HasNewRenderSnapshot (thread))
+        return null;
+
+    int previous = thread->middle_slot.exchange (thread->read_slot, std::memory_order_acq_rel);
+    thread->read_slot = previous & ~Render_Snapshot_New;
+
+    return &thread->snapshots[thread->read_slot];
+}
+
+static void RenderThreadMain ()
+{
+    RenderThread *thread = &g_render_thread;
+
+    GfxAcquireContext ();
+
+    f64 frame_start = 0;
+    while (true)
+    {
+        RenderSnapshot *snapshot = AcquireRenderSnapshot (thread);
+        if (!snapshot)
+        {
+            // The last published snapshot is rendered before quitting
+            if (thread->quit.load ())
+                break;
+
+            std::unique_lock<std::mutex> lock (thread->wake_mutex);
+            while (!HasNewRenderSnapshot (thread) && !thread->quit.load ())
+                thread->wake.wait (lock);
+
+            continue;
+        }
+
+        s64 frame_index = thread->rendered_frame_count.load ();
+
+        f64 submit_start = GetTimeInSeconds ();
+        if (frame_index > 0)
+            PushTimingSample (&thread->timings.frame, submit_start - frame_start);
+        frame_start = submit_start;
+
+        if (thread->mesh_streaming.load ())
+        {
+            bool done = GfxStreamMeshObjects (thread->streamed_mesh, Mesh_Stream_Frame_Budget);
+            if (done)
+            {
+                LogMessage ("Streamed mesh '%s' in %ld frames", thread->streamed_mesh_name, frame_index + 1);
+                thread->mesh_streaming.store (false);
+            }
+        }
+
+        GfxRenderFrame (snapshot->params);
+        PushTimingSample (&thread->timings.submit, GetTimeInSeconds () - submit_start);
+
+        CollectPassTimings (&thread->timings);
+
+        if (thread->log_timings_requested.exchange (false))
+            LogFrameTimings (thread->timings, "Render thread timings");
+
+        thread->rendered_frame_count.store (frame_index + 1);
+    }
+
+    GfxReleaseContext ();
+}
+
+// The backend context moves to the render thread until StopRenderThread
+static void StartRenderThread (Mesh *streamed_mesh, const char *streamed_mesh_name, bool mesh_streaming)
+{
+    RenderThread *thread = &g_render_thread;
+
+    thread->write_slot = 0;
+    thread->read_slot = 1;
+    thread->middle_slot.store (2);
+    thread->quit.store (false);
+    thread->log_timings_requested.store (false);
+    thread->mesh_streaming.store (mesh_streaming);
+    thread->rendered_frame_count.store (0);
+    thread->streamed_mesh = streamed_mesh;
+    thread->streamed_mesh_name = streamed_mesh_name;
+
+    GfxReleaseContext ();
+    thread->thread = std::thread (RenderThreadMain);
+}
+
+static void StopRenderThread ()
+{
+    RenderThread *thread = &g_render_thread;
+
+    {
+        std::lock_guard<std::mutex> lock (thread->wake_mutex);
+        thread->quit.store (true);
+    }
+    thread->wake.notify_one ();
+
+    thread->thread.join ();
+    GfxAcquireContext ();
+
+    for (int i = 0; i < 3; i += 1)
+    {
+        ArrayFree (&thread->snapshots[i].instances);
+        ArrayFree (&thread->snapshots[i].scene_visibility);
+    }
+}
+
 static bool ParseFloat (const char *str, float *result)
 {
     *result = 0.0f;
@@ -124,19 +505,233 @@ static bool ParseFloat (const char *str, float *result)
     return true;
 }
 
+static bool ParseInt (const char *str, int *result)
+{
+    *result = 0;
+
+    char *end;
+    long i = strtol (str, &end, 10);
+    if (end != str + strlen (str))
+        return false;
+
+    *result = (int)i;
+
+    return true;
+}
+
 static bool ParseProgramArguments (int argc, char **argv, ProgramArguments *result)
 {
-    const char *Usage = "Usage: ScopGL mesh_filename [texture_filename] [light_x light_y light_z] [light_r light_g light_b]";
+#ifdef SCOP_BACKEND_SOFTWARE
+    const char *Usage = "Usage: Scop [--frames N] [--grid N] [--scene] [--no-cull] [--no-occlusion] [--flat] [--stream] [--on-demand] [--render-thread] [--dynamic-resolution min_scale max_scale target_ms] [--output image.png] [--raster scalar|avx2] mesh_filename [texture_filename] [light_x light_y light_z] [light_r light_g light_b]\n"
+        "       Scop --turntable N [--size width height] [--output-dir directory] [--flat] [--raster scalar|avx2] mesh_filename...";
+#else
+    const char *Usage = "Usage: Scop [--frames N] [--grid N] [--scene] [--no-cull] [--no-occlusion] [--flat] [--stream] [--on-demand] [--render-thread] [--dynamic-resolution min_scale max_scale target_ms] mesh_filename [texture_filename] [light_x light_y light_z] [light_r light_g light_b]\n"
+        "       Scop --turntable N [--size width height] [--output-dir directory] [--flat] mesh_filename...";
+#endif
+
+    argc -= 1;
+    argv += 1;
 
-    if (argc <= 1)
+    // Options come before the positional arguments
+    while (argc > 0 && strncmp (*argv, "--", 2) == 0)
+    {
+        if (strcmp (*argv, "--frames") == 0)
+        {
+            if (argc < 2 || !ParseInt (argv[1], &result->frame_count) || result->frame_count < 0)
+            {
+                LogError ("Invalid argument for --frames");
+                return false;
+            }
+
+            argc -= 2;
+            argv += 2;
+        }
+        else if (strcmp (*argv, "--grid") == 0)
+        {
+            if (argc < 2 || !ParseInt (argv[1], &result->grid_size) || result->grid_size < 1)
+            {
+                LogError ("Invalid argument for --grid");
+                return false;
+            }
+
+            argc -= 2;
+            argv += 2;
+        }
+        else if (strcmp (*argv, "--scene") == 0)
+        {
+            result->scene = true;
+            argc -= 1;
+            argv += 1;
+        }
+        else if (strcmp (*argv, "--no-cull") == 0)
+        {
+            result->no_cull = true;
+            argc -= 1;
+            argv += 1;
+        }
+        else if (strcmp (*argv, "--no-occlusion") == 0)
+        {
+            result->no_occlusion = true;
+            argc -= 1;
+            argv += 1;
+        }
+        else if (strcmp (*argv, "--flat") == 0)
+        {
+            result->flat_shading = true;
+            argc -= 1;
+            argv += 1;
+        }
+        else if (strcmp (*argv, "--stream") == 0)
+        {
+            result->stream_mesh = true;
+            argc -= 1;
+            argv += 1;
+        }
+        else if (strcmp (*argv, "--on-demand") == 0)
+        {
+            result->on_demand = true;
+            argc -= 1;
+            argv += 1;
+        }
+        else if (strcmp (*argv, "--render-thread") == 0)
+        {
+            result->render_thread = true;
+            argc -= 1;
+            argv += 1;
+        }
+        else if (strcmp (*argv, "--dynamic-resolution") == 0)
+        {
+            GfxDynamicResolution *settings = &result->dynamic_resolution;
+
+            float target_ms = 0;
+            if (argc < 4
+            || !ParseFloat (argv[1], &settings->min_scale) || !ParseFloat (argv[2], &settings->max_scale)
+            || !ParseFloat (argv[3], &target_ms)
+            || settings->min_scale <= 0 || settings->min_scale > settings->max_scale
+            || settings->max_scale > Dynamic_Resolution_Max_Scale || target_ms <= 0)
+            {
+                LogError ("Invalid arguments for --dynamic-resolution, scales must be in (0, %g] and the target time positive",
+                    Dynamic_Resolution_Max_Scale);
+                return false;
+            }
+
+            settings->target_frame_time = target_ms / 1000.0;
+            argc -= 4;
+            argv += 4;
+        }
+        else if (strcmp (*argv, "--turntable") == 0)
+        {
+            if (argc < 2 || !ParseInt (argv[1], &result->turntable_angle_count) || result->turntable_angle_count < 1)
+            {
+                LogError ("Invalid argument for --turntable");
+                return false;
+            }
+
+            argc -= 2;
+            argv += 2;
+        }
+        else if (strcmp (*argv, "--size") == 0)
+        {
+            if (argc < 3
+            || !ParseInt (argv[1], &result->output_width) || result->output_width < 1
+            || !ParseInt (argv[2], &result->output_height) || result->output_height < 1)
+            {
+                LogError ("Invalid arguments for --size");
+                return false;
+            }
+
+            argc -= 3;
+            argv += 3;
+        }
+        else if (strcmp (*argv, "--output-dir") == 0)
+        {
+            if (argc < 2)
+            {
+                LogError ("Missing directory for --output-dir");
+                return false;
+            }
+
+            result->output_dir = argv[1];
+            argc -= 2;
+            argv += 2;
+        }
+#ifdef SCOP_BACKEND_SOFTWARE
+        else if (strcmp (*argv, "--output") == 0)
+        {
+            if (argc < 2)
+            {
+                LogError ("Missing filename for --output");
+                return false;
+            }
+
+            result->output_filename = argv[1];
+            argc -= 2;
+            argv += 2;
+        }
+        else if (strcmp (*argv, "--raster") == 0)
+        {
+            if (argc < 2)
+            {
+                LogError ("Missing rasterization path for --raster");
+                return false;
+            }
+
+            result->raster_path_name = argv[1];
+            argc -= 2;
+            argv += 2;
+        }
+#endif
+        else
+        {
+            LogError ("Unknown option '%s'", *argv);
+            LogMessage (Usage);
+            return false;
+        }
+    }
+
+    if (argc == 0)
     {
         LogError ("Missing mesh argument");
         LogMessage (Usage);
         return false;
     }
 
-    argc -= 1;
-    argv += 1;
+    if (result->scene && result->grid_size > 0)
+    {
+        LogError ("--grid cannot be used with --scene");
+        return false;
+    }
+
+    if (result->turntable_angle_count > 0)
+    {
+#ifdef SCOP_BACKEND_NULL
+        LogError ("--turntable needs a backend that produces pixels, the %s backend does not", SCOP_BACKEND_NAME);
+        return false;
+#endif
+
+        if (result->scene || result->grid_size > 0)
+        {
+            LogError ("--turntable cannot be used with --scene or --grid");
+            return false;
+        }
+
+        if (result->output_width == 0)
+        {
+            result->output_width = Turntable_Default_Size;
+            result->output_height = Turntable_Default_Size;
+        }
+
+        result->turntable_mesh_filenames = argv;
+        result->turntable_mesh_count = argc;
+
+        return true;
+    }
+
+    if (result->output_width > 0)
+    {
+        LogError ("--size can only be used with --turntable");
+        return false;
+    }
 
     result->mesh_filename = *argv;
     argc -= 1;
@@ -227,9 +822,288 @@ static bool ParseProgramArguments (int argc, char **argv, ProgramArguments *resu
     return true;
 }
 
+struct TurntableBatch
+{
+    JobGroup png_jobs;
+    std::atomic<s64> images_written {0};
+    std::atomic<s64> images_failed {0};
+};
+
+struct TurntableImage
+{
+    TurntableBatch *batch;
+    char filename[4096];
+    u8 *pixels;
+    u32 width;
+    u32 height;
+};
+
+static void WriteTurntableImageJob (void *data)
+{
+    TurntableImage *image = (TurntableImage *)data;
+
+    if (WritePNGFile (image->filename, image->pixels, image->width, image->height, true))
+    {
+        image->batch->images_written += 1;
+    }
+    else
+    {
+        LogError ("Could not write '%s'", image->filename);
+        image->batch->images_failed += 1;
+    }
+
+    free (image->pixels);
+    free (image);
+}
+
+// Runs on the render thread once the pixels are back, encoding happens on the workers
+static void TurntableReadbackProc (const u8 *pixels, u32 width, u32 height, void *data)
+{
+    TurntableImage *image = (TurntableImage *)data;
+
+    image->pixels = (u8 *)malloc ((size_t)width * height * 4);
+    Assert (image->pixels != null);
+    memcpy (image->pixels, pixels, (size_t)width * height * 4);
+    image->width = width;
+    image->height = height;
+
+    PushJob (&image->batch->png_jobs, WriteTurntableImageJob, image);
+}
+
+// Image files are named after the mesh file, without its directory and extension
+static void GetTurntableImageFilename (const char *output_dir, const char *mesh_filename, int angle_index, char *result, s64 size)
+{
+    const char *name = mesh_filename;
+    for (const char *c = mesh_filename; *c; c += 1)
+    {
+        if (*c == '/' || *c == '\\')
+            name = c + 1;
+    }
+
+    const char *extension = strrchr (name, '.');
+    int name_length = extension ? (int)(extension - name) : (int)strlen (name);
+
+    snprintf (result, size, "%s/%.*s_%03d.png", output_dir, name_length, name, angle_index);
+}
+
+static int RenderTurntables (const ProgramArguments &args)
+{
+    TurntableBatch batch;
+
+    int width, height;
+    GfxGetFramebufferSize (&width, &height);
+
+    // Distance at which the bounding sphere of a mesh fills Turntable_Fill of the narrowest field of view
+    float half_fov_y = ToRads (70) * 0.5f;
+    float half_fov_x = atanf (tanf (half_fov_y) * width / (float)height);
+    float half_fov = Min (half_fov_x, half_fov_y);
+
+    s64 image_count = 0;
+    int failed_mesh_count = 0;
+    f64 start_time = GetTimeInSeconds ();
+
+    for (int mesh_index = 0; mesh_index < args.turntable_mesh_count; mesh_index += 1)
+    {
+        const char *mesh_filename = args.turntable_mesh_filenames[mesh_index];
+
+        Mesh mesh;
+        memset (&mesh, 0, sizeof (Mesh));
+
+        if (!LoadMeshFromObjFile (mesh_filename, &mesh))
+        {
+            LogError ("Could not load mesh '%s'", mesh_filename);
+            failed_mesh_count += 1;
+            continue;
+        }
+
+        defer (DestroyMesh (&mesh));
+
+        Vec3f center = (mesh.aabb_min + mesh.aabb_max) * 0.5;
+        float radius = Max (Length (mesh.aabb_max - mesh.aabb_min) * 0.5f, 0.001f);
+
+        g_camera.target = Vec3f{0,0,0};
+        g_camera.offset = Vec2f{};
+        g_camera.distance_from_target = radius / (sinf (half_fov) * Turntable_Fill);
+
+        for (int angle_index = 0; angle_index < args.turntable_angle_count; angle_index += 1)
+        {
+            g_camera.yaw_pitch = Vec2f{360.0f * angle_index / args.turntable_angle_count, -Turntable_Pitch};
+            UpdateCameraMatrices ();
+
+            RenderInstance instance;
+            instance.model_matrix = Mat4fTranslate (Vec3f{});
+            instance.color = Vec3f{1, 1, 1};
+
+            RenderFrameParams params;
+            memset (&params, 0, sizeof (params));
+            params.view_projection_matrix = g_camera.view_projection_matrix;
+            params.framebuffer_width = width;
+            params.framebuffer_height = height;
+            params.mesh = &mesh;
+            params.model_color = Vec3f{1, 1, 1};
+            params.model_matrix = Mat4fTranslate (-center);
+            params.light_position = args.light_position;
+            params.light_color = args.light_color;
+            params.flat_shading = args.flat_shading;
+            params.instances = &instance;
+            params.instance_count = 1;
+
+            GfxRenderFrame (params);
+
+            TurntableImage *image = (TurntableImage *)malloc (sizeof (TurntableImage));
+            Assert (image != null);
+            memset (image, 0, sizeof (TurntableImage));
+            image->batch = &batch;
+            GetTurntableImageFilename (args.output_dir, mesh_filename, angle_index, image->filename, sizeof (image->filename));
+
+            GfxReadbackFrame (TurntableReadbackProc, image);
+            image_count += 1;
+
+            // Keep the memory held by images waiting to be encoded bounded
+            if (batch.png_jobs.pending.load () > Turntable_Max_Pending_Images)
+                WaitForJobs (&batch.png_jobs);
+        }
+    }
+
+    GfxFlushReadbacks ();
+    WaitForJobs (&batch.png_jobs);
+
+    f64 elapsed = GetTimeInSeconds () - start_time;
+
+    LogMessage ("Wrote %ld images of %d meshes to '%s' in %.3f s (%.3f ms per image)",
+        batch.images_written.load (), args.turntable_mesh_count - failed_mesh_count, args.output_dir,
+        elapsed, image_count > 0 ? elapsed * 1000 / image_count : 0.0);
+
+    if (failed_mesh_count > 0 || batch.images_failed.load () > 0 || batch.images_written.load () != image_count)
+        return 1;
+
+    return 0;
+}
+
+// Startup steps, some of which run on worker threads at the same time. A step is only written
+// by the thread that runs it, and the timeline is logged once they are all done
+enum StartupStep
+{
+    Startup_Arguments,
+    Startup_Backend_Init,
+    Startup_Mesh_Parse,
+    Startup_Texture_Load,
+    Startup_Mesh_Upload,
+    Startup_Texture_Upload,
+
+    Startup_Step_Count,
+};
+
+static const char *const Startup_Step_Names[Startup_Step_Count] = {
+    "Arguments", "Backend init", "Mesh parse", "Texture load", "Mesh upload", "Texture upload",
+};
+
+#define Startup_Timeline_Width 40
+
+struct StartupTimeline
+{
+    f64 origin;
+    f64 start[Startup_Step_Count];
+    f64 end[Startup_Step_Count];
+    bool done[Startup_Step_Count];
+};
+
+static StartupTimeline g_startup_timeline;
+
+static void BeginStartupStep (StartupStep step)
+{
+    g_startup_timeline.start[step] = GetTimeInSeconds ();
+}
+
+static void EndStartupStep (StartupStep step)
+{
+    g_startup_timeline.end[step] = GetTimeInSeconds ();
+    g_startup_timeline.done[step] = true;
+}
+
+static void LogStartupTimeline ()
+{
+    const StartupTimeline &timeline = g_startup_timeline;
+
+    f64 total = GetTimeInSeconds () - timeline.origin;
+    LogMessage ("Startup took %.3f ms:", total * 1000);
+
+    for (int i = 0; i < Startup_Step_Count; i += 1)
+    {
+        if (!timeline.done[i])
+            continue;
+
+        f64 start = timeline.start[i] - timeline.origin;
+        f64 end = timeline.end[i] - timeline.origin;
+
+        // Steps that overlap have bars that overlap
+        char bar[Startup_Timeline_Width + 1];
+        int first = Clamp ((int)(start / total * Startup_Timeline_Width), 0, Startup_Timeline_Width - 1);
+        int last = Clamp ((int)(end / total * Startup_Timeline_Width), first, Startup_Timeline_Width - 1);
+        for (int j = 0; j < Startup_Timeline_Width; j += 1)
+            bar[j] = j >= first && j <= last ? '#' : '.';
+        bar[Startup_Timeline_Width] = 0;
+
+        LogMessage ("  %-14s %9.3f ms -> %9.3f ms |%s|", Startup_Step_Names[i], start * 1000, end * 1000, bar);
+    }
+}
+
+struct MeshLoadJob
+{
+    const char *filename;
+    Mesh mesh;
+    bool ok;
+};
+
+static void LoadMeshJob (void *data)
+{
+    MeshLoadJob *job = (MeshLoadJob *)data;
+
+    BeginStartupStep (Startup_Mesh_Parse);
+    job->ok = LoadMeshFromObjFile (job->filename, &job->mesh, (LoadMeshFlags)(LoadMesh_DefaultFlags | LoadMesh_NoGfxObjects));
+    EndStartupStep (Startup_Mesh_Parse);
+}
+
+static void LoadTextureJob (void *data)
+{
+    BeginStartupStep (Startup_Texture_Load);
+    LoadTextureData ((TextureLoad *)data);
+    EndStartupStep (Startup_Texture_Load);
+}
+
 int main (int argc, char **argv)
 {
-    bool gfx_ok = GfxInitBackend ();
+    g_startup_timeline.origin = GetTimeInSeconds ();
+
+    InitJobSystem ();
+    defer (ShutdownJobSystem ());
+
+    // Arguments come first, they decide whether the backend renders offscreen
+    ProgramArguments args = {};
+
+    BeginStartupStep (Startup_Arguments);
+    if (!ParseProgramArguments (argc, argv, &args))
+        return 1;
+    EndStartupStep (Startup_Arguments);
+
+    // A single mesh is parsed on a worker thread while the backend creates the window and the
+    // context, only its GPU objects wait for the backend. Scenes create GPU objects as they load
+    MeshLoadJob mesh_load;
+    memset (&mesh_load, 0, sizeof (MeshLoadJob));
+    JobGroup mesh_jobs;
+    if (!args.scene && args.turntable_angle_count == 0)
+    {
+        mesh_load.filename = args.mesh_filename;
+        PushJob (&mesh_jobs, LoadMeshJob, &mesh_load);
+    }
+
+    defer (WaitForJobs (&mesh_jobs); free (mesh_load.mesh.vertices); free (mesh_load.mesh.indices));
+
+    BeginStartupStep (Startup_Backend_Init);
+    const GfxDynamicResolution *dynamic_resolution = args.dynamic_resolution.target_frame_time > 0 ? &args.dynamic_resolution : null;
+    bool gfx_ok = GfxInitBackend (args.output_width, args.output_height, dynamic_resolution);
+    EndStartupStep (Startup_Backend_Init);
+
     if (!gfx_ok)
     {
         LogError ("Could not initialize %s graphics backend", SCOP_BACKEND_NAME);
@@ -238,193 +1112,558 @@ int main (int argc, char **argv)
 
     defer (GfxTerminateBackend ());
 
+#ifndef SCOP_BACKEND_HEADLESS
     if (glfwRawMouseMotionSupported ())
         glfwSetInputMode (g_main_window, GLFW_RAW_MOUSE_MOTION, GLFW_TRUE);
 
     glfwSetScrollCallback (g_main_window, GLFWScrollCallback);
+    glfwSetWindowRefreshCallback (g_main_window, GLFWWindowRefreshCallback);
+#endif
 
-    ProgramArguments args = {};
+#ifdef SCOP_BACKEND_SOFTWARE
+    if (args.raster_path_name)
+    {
+        SwRasterPath path = SwRasterPath_Scalar;
+        if (strcmp (args.raster_path_name, "scalar") == 0)
+        {
+            path = SwRasterPath_Scalar;
+        }
+        else if (strcmp (args.raster_path_name, "avx2") == 0)
+        {
+            path = SwRasterPath_AVX2;
+        }
+        else
+        {
+            LogError ("Unknown rasterization path '%s', expected scalar or avx2", args.raster_path_name);
+            return 1;
+        }
 
-    if (!ParseProgramArguments (argc, argv, &args))
-        return 1;
+        if (!SwSetRasterPath (path))
+        {
+            LogError ("Rasterization path '%s' is not supported by this CPU", args.raster_path_name);
+            return 1;
+        }
+    }
+#endif
+
+    if (args.turntable_angle_count > 0)
+        return RenderTurntables (args);
+
+    // The texture can only start once the backend tells which formats it supports, it is
+    // decoded on a worker thread while the mesh finishes loading
+    TextureLoad texture_load;
+    JobGroup texture_jobs;
+    if (args.texture_filename)
+    {
+        BeginTextureLoad (&texture_load, args.texture_filename);
+        PushJob (&texture_jobs, LoadTextureJob, &texture_load);
+    }
+
+    defer (if (args.texture_filename) { WaitForJobs (&texture_jobs); FreeTextureLoad (&texture_load); });
+
+    Mesh mesh;
+    memset(&mesh, 0, sizeof (Mesh));
+
+    // All the meshes of a scene share one vertex and index buffer and are drawn with a single call
+    Scene scene;
+    memset (&scene, 0, sizeof (Scene));
+
+    Vec3f center;
+    bool mesh_streaming = false;
+    g_camera.target = Vec3f{0,0,0};
+    g_camera.distance_from_target = 3;
+
+    if (args.scene)
+    {
+        if (!LoadSceneFromFile (args.mesh_filename, &scene))
+        {
+            LogError ("Could not load scene '%s'", args.mesh_filename);
+            return 1;
+        }
+
+        Vec3f aabb_min, aabb_max;
+        CalculateSceneBoundingBox (&scene, &aabb_min, &aabb_max);
+
+        center = (aabb_min + aabb_max) * 0.5;
+        if (scene.alive_object_count == 0)
+            center = Vec3f{};
+
+        Vec3f extents = aabb_max - aabb_min;
+        float size = scene.alive_object_count > 0 ? Max (Max (extents.x, extents.y), extents.z) : 0;
+        g_camera.distance_from_target = Max (3.0f, size);
+        g_camera_max_distance = Max (10.0f, size * 2);
+    }
+    else
+    {
+        WaitForJobs (&mesh_jobs);
+
+        if (!mesh_load.ok)
+        {
+            LogError ("Could not load mesh '%s'", args.mesh_filename);
+            return 1;
+        }
+
+        // The mesh now owns the vertices and indices
+        mesh = mesh_load.mesh;
+        memset (&mesh_load.mesh, 0, sizeof (Mesh));
+
+        // Large meshes are uploaded by the main loop a bit every frame, instead of stalling here
+        s64 mesh_size = sizeof (Vertex) * mesh.vertex_count + sizeof (u32) * mesh.index_count;
+        mesh_streaming = args.stream_mesh || mesh_size >= Mesh_Stream_Threshold;
+
+        BeginStartupStep (Startup_Mesh_Upload);
+        if (mesh_streaming)
+            GfxCreateMeshObjectsStreamed (&mesh);
+        else
+            GfxCreateMeshObjects (&mesh);
+        EndStartupStep (Startup_Mesh_Upload);
+
+        center = (mesh.aabb_min + mesh.aabb_max) * 0.5;
+    }
+
+    defer (DestroyMesh (&mesh));
+    defer (if (args.scene) DestroyScene (&scene));
 
     GfxTexture texture = 0;
     if (args.texture_filename)
     {
-        if (!LoadTextureFromFile (args.texture_filename, &texture, null, null))
+        WaitForJobs (&texture_jobs);
+
+        BeginStartupStep (Startup_Texture_Upload);
+        bool texture_ok = UploadTextureData (&texture_load, &texture);
+        EndStartupStep (Startup_Texture_Upload);
+
+        if (!texture_ok)
         {
             LogError ("Could not load texture '%s'", args.texture_filename);
             return 1;
         }
+
+        FreeTextureLoad (&texture_load);
     }
 
+    LogStartupTimeline ();
+
     defer (GfxDestroyTexture (&texture));
 
-    Mesh mesh;
-    memset(&mesh, 0, sizeof (Mesh));
-    if (!LoadMeshFromObjFile (args.mesh_filename, &mesh))
+    // Copies of the mesh laid out on the XZ plane, drawn with a single instanced draw call
+    Array<RenderInstance> instances = {};
+    defer (ArrayFree (&instances));
+
+    if (args.grid_size > 0)
     {
-        LogError ("Could not load mesh '%s'", args.mesh_filename);
-        return 1;
+        Vec3f extents = mesh.aabb_max - mesh.aabb_min;
+        float spacing = Max (Max (extents.x, extents.z), 0.001f) * Grid_Spacing;
+        float grid_width = spacing * (args.grid_size - 1);
+
+        ArrayReserve (&instances, (s64)args.grid_size * args.grid_size);
+        for (int z = 0; z < args.grid_size; z += 1)
+        {
+            for (int x = 0; x < args.grid_size; x += 1)
+            {
+                RenderInstance *instance = ArrayPush (&instances);
+                instance->model_matrix = Mat4fTranslate (Vec3f{x * spacing - grid_width * 0.5f, 0, z * spacing - grid_width * 0.5f});
+                instance->color = Vec3f{1, 1, 1};
+            }
+        }
+
+        g_camera.distance_from_target = Max (3.0f, grid_width);
+        g_camera_max_distance = Max (10.0f, grid_width * 2);
+    }
+    else if (!args.scene)
+    {
+        RenderInstance *instance = ArrayPush (&instances);
+        instance->model_matrix = Mat4fTranslate (Vec3f{});
+        instance->color = Vec3f{1, 1, 1};
     }
 
-    defer (DestroyMesh (&mesh));
+    // Bounds of the instances relative to the model matrix, culled against the frustum every
+    // frame along with the objects of the scene. The surviving instances are compacted
+    CullBoxes instance_bounds = {};
+    defer (FreeCullBoxes (&instance_bounds));
 
-    Vec3f center = (mesh.aabb_min + mesh.aabb_max) * 0.5;
-    g_camera.target = Vec3f{0,0,0};
-    g_camera.distance_from_target = 3;
+    for (s64 i = 0; i < instances.count; i += 1)
+    {
+        Vec3f aabb_min, aabb_max;
+        TransformBoundingBox (instances[i].model_matrix, mesh.aabb_min, mesh.aabb_max, &aabb_min, &aabb_max);
+        PushCullBox (&instance_bounds, aabb_min, aabb_max);
+    }
+
+    Array<RenderInstance> visible_instances = {};
+    defer (ArrayFree (&visible_instances));
+    ArrayReserve (&visible_instances, Max (instances.count, (s64)1));
+
+    Array<u8> visibility = {};
+    defer (ArrayFree (&visibility));
+
+    s64 cull_tested_count = 0;
+    s64 cull_visible_count = 0;
+    f64 cull_time = 0;
+
+    // Objects of a scene that pass frustum culling are then tested against the biggest ones
+    bool occlusion_culling = args.scene && !args.no_cull && !args.no_occlusion;
+    OcclusionCuller occlusion_culler;
+    if (occlusion_culling)
+    {
+        int width, height;
+        GfxGetFramebufferSize (&width, &height);
+        InitOcclusionCuller (&occlusion_culler, width, height);
+    }
+
+    defer (if (occlusion_culling) DestroyOcclusionCuller (&occlusion_culler));
+
+    s64 occlusion_occluder_count = 0;
+    s64 occlusion_occluder_triangle_count = 0;
+    s64 occlusion_tested_count = 0;
+    s64 occlusion_culled_count = 0;
+    f64 occlusion_pass_time = 0;
+    f64 occlusion_wait_time = 0;
 
     bool space_pressed_last_frame = false;
     bool space_pressed_this_frame = false;
+#ifndef SCOP_BACKEND_HEADLESS
+    bool t_pressed_last_frame = false;
+    bool t_pressed_this_frame = false;
+    bool f_pressed_last_frame = false;
+    bool f_pressed_this_frame = false;
+#endif
+
+    bool flat_shading = args.flat_shading;
 
     float timer = 0;
     float texture_alpha = 0;
     bool show_texture = true;
-    while (!glfwWindowShouldClose (g_main_window))
-    {
-        UpdateInput ();
 
+    // Nothing has been drawn yet, the first frame is always a change
+    RedrawState last_redraw_state;
+    memset (&last_redraw_state, 0, sizeof (last_redraw_state));
+    bool animating = true;
+    s64 skipped_frame_count = 0;
+
+    if (args.render_thread)
+        StartRenderThread (&mesh, args.mesh_filename, mesh_streaming);
+
+    int frame_index = 0;
+    f64 frame_loop_start = GetTimeInSeconds ();
+    f64 frame_start = frame_loop_start;
+#ifndef SCOP_BACKEND_HEADLESS
+    f64 last_update_time = frame_loop_start;
+#endif
+
+    // With --on-demand, frames skipped because nothing changed count towards --frames too,
+    // otherwise a static window would never get to the end
+    while (args.frame_count == 0 || frame_index + skipped_frame_count < args.frame_count)
+    {
+#ifndef SCOP_BACKEND_HEADLESS
+        if (glfwWindowShouldClose (g_main_window))
+            break;
+#endif
+
+        // Polling keeps going while something moves, a held key does not send events
+        bool wait_for_events = args.on_demand && !animating;
+
+        f64 input_start = GetTimeInSeconds ();
+        if (frame_index > 0 && !wait_for_events)
+            PushTimingSample (&g_frame_timings.frame, input_start - frame_start);
+
+        // Without vsync to pace it, the main thread sleeps until its next update
+        f64 wait_timeout = 0;
+        if (wait_for_events)
+            wait_timeout = On_Demand_Wait_Timeout;
+        else if (args.render_thread && frame_index > 0)
+            wait_timeout = Max (frame_start + Render_Thread_Update_Interval - input_start, 0.0);
+
+        UpdateInput (wait_timeout);
+
+        // Time spent asleep is not part of any frame, nor of the input timings
+        f64 input_end = GetTimeInSeconds ();
+        frame_start = wait_timeout > 0 ? input_end : input_start;
+        if (wait_timeout == 0)
+            PushTimingSample (&g_frame_timings.input, input_end - input_start);
+
+        // The loop runs at vsync, or faster with a render thread. Headless frames, and the first
+        // update after sleeping on events, count as one reference step
+        f64 update_delta_time = 1 / Update_Reference_Rate;
+#ifndef SCOP_BACKEND_HEADLESS
+        if (frame_index > 0 && !wait_for_events)
+            update_delta_time = Min (input_end - last_update_time, (f64)Max_Update_Delta_Time);
+        last_update_time = input_end;
+#endif
+
+        float update_steps = (float)(update_delta_time * Update_Reference_Rate);
+
+#ifndef SCOP_BACKEND_HEADLESS
         space_pressed_last_frame = space_pressed_this_frame;
         space_pressed_this_frame = glfwGetKey (g_main_window, GLFW_KEY_SPACE) == GLFW_PRESS;
 
+        t_pressed_last_frame = t_pressed_this_frame;
+        t_pressed_this_frame = glfwGetKey (g_main_window, GLFW_KEY_T) == GLFW_PRESS;
+        if (!t_pressed_last_frame && t_pressed_this_frame)
+        {
+            if (args.render_thread)
+            {
+                LogFrameTimings (g_frame_timings, "Main thread timings");
+                g_render_thread.log_timings_requested.store (true);
+            }
+            else
+            {
+                LogFrameTimings (g_frame_timings);
+            }
+        }
+
+        // Switching only changes how the mesh is drawn, nothing is reloaded
+        f_pressed_last_frame = f_pressed_this_frame;
+        f_pressed_this_frame = glfwGetKey (g_main_window, GLFW_KEY_F) == GLFW_PRESS;
+        if (!f_pressed_last_frame && f_pressed_this_frame)
+            flat_shading = !flat_shading;
+
         if (glfwGetMouseButton (g_main_window, GLFW_MOUSE_BUTTON_LEFT) != GLFW_PRESS
         && glfwGetMouseButton (g_main_window, GLFW_MOUSE_BUTTON_RIGHT) != GLFW_PRESS)
             glfwSetInputMode (g_main_window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 
-        UpdateModelTransform ();
-        UpdateCamera ();
-
-        if (!space_pressed_last_frame && space_pressed_this_frame)
-            show_texture = !show_texture;
+        UpdateModelTransform (update_steps);
+#endif
 
-        if (show_texture)
-            texture_alpha = Lerp (texture_alpha, 1, 0.1);
-        else
-            texture_alpha = Lerp (texture_alpha, 0, 0.1);
+        if (args.render_thread)
+            mesh_streaming = g_render_thread.mesh_streaming.load ();
 
-        RenderFrameParams params;
-        memset (&params, 0, sizeof (params));
-        params.mesh = &mesh;
-        params.texture = texture;
-        params.texture_alpha = texture ? texture_alpha : 0.0f;
-        params.model_color = Vec3f{1, 1, 1};
+        f64 camera_start = GetTimeInSeconds ();
+        UpdateCamera ();
+        PushTimingSample (&g_frame_timings.camera, GetTimeInSeconds () - camera_start);
 
-        params.model_matrix = Mat4fTranslate (g_model_position)
+        Mat4f model_matrix = Mat4fTranslate (g_model_position)
             * Mat4fRotate (Vec3f{0,1,0}, ToRads (g_model_rotation))
             * Mat4fTranslate (-center);
-        params.light_position = args.light_position;
-        params.light_color = args.light_color;
 
-        GfxRenderFrame (params);
+        if (!space_pressed_last_frame && space_pressed_this_frame)
+            show_texture = !show_texture;
 
-        timer += 1 / 60.0f;
-    }
+        float target_texture_alpha = show_texture ? 1 : 0;
+        texture_alpha = Lerp (texture_alpha, target_texture_alpha, 1 - powf (1 - Texture_Fade_Speed, update_steps));
+        if (Abs (texture_alpha - target_texture_alpha) < Texture_Fade_Epsilon)
+            texture_alpha = target_texture_alpha;
 
-    return 0;
-}
+        RedrawState redraw_state;
+        memset (&redraw_state, 0, sizeof (redraw_state));
+        redraw_state.view_projection_matrix = g_camera.view_projection_matrix;
+        redraw_state.model_matrix = model_matrix;
+        redraw_state.texture_alpha = texture ? texture_alpha : 0.0f;
+        redraw_state.flat_shading = flat_shading;
 
-void GLFWErrorCallback (int code, const char *description)
-{
-    (void)code;
-    if (description)
-        LogError ("GLFW: %s", description);
-}
+        bool changed = frame_index == 0 || g_window_damaged || mesh_streaming
+            || memcmp (&redraw_state, &last_redraw_state, sizeof (redraw_state)) != 0;
 
-void LogMessage (const char *str, ...)
-{
-    va_list args;
-    va_start (args, str);
+        animating = changed || (texture && texture_alpha != target_texture_alpha);
 
-    vprintf (str, args);
+        if (args.on_demand && !changed)
+        {
+            skipped_frame_count += 1;
+            continue;
+        }
 
-    va_end (args);
+        last_redraw_state = redraw_state;
+        g_window_damaged = false;
 
-    printf ("\n");
-}
+        // The occlusion pass only needs the camera and the model transform, it runs on the
+        // workers while the rest of the frame is prepared
+        if (occlusion_culling)
+        {
+            Vec4f camera_position = Inverted (model_matrix)
+                * Vec4f{g_camera.position.x, g_camera.position.y, g_camera.position.z, 1};
 
-void LogWarning (const char *str, ...)
-{
-    printf ("\x1b[1;33mWarning: ");
+            BeginOcclusionCulling (&occlusion_culler, &scene, g_camera.view_projection_matrix * model_matrix,
+                Vec3f{camera_position.x, camera_position.y, camera_position.z});
+        }
 
-    va_list args;
-    va_start (args, str);
+        int framebuffer_width, framebuffer_height;
+        GfxGetFramebufferSize (&framebuffer_width, &framebuffer_height);
 
-    vprintf (str, args);
+        RenderFrameParams params;
+        memset (&params, 0, sizeof (params));
+        params.view_projection_matrix = g_camera.view_projection_matrix;
+        params.framebuffer_width = framebuffer_width;
+        params.framebuffer_height = framebuffer_height;
+        params.mesh = args.scene ? null : &mesh;
+        params.scene = args.scene ? &scene : null;
+        params.texture = texture;
+        params.texture_alpha = texture ? texture_alpha : 0.0f;
+        params.model_color = Vec3f{1, 1, 1};
 
-    va_end (args);
+        params.model_matrix = model_matrix;
+        params.light_position = args.light_position;
+        params.light_color = args.light_color;
+        params.flat_shading = flat_shading;
+        params.instances = instances.data;
+        params.instance_count = instances.count;
 
-    printf ("\x1b[0m\n");
-}
+        if (!args.no_cull)
+        {
+            f64 cull_start = GetTimeInSeconds ();
+
+            // Test the bounds in model space rather than transforming every box to world space
+            Frustum frustum = ExtractFrustumPlanes (g_camera.view_projection_matrix * params.model_matrix);
+
+            if (args.scene)
+            {
+                ArrayReserve (&visibility, scene.objects.count);
+                cull_visible_count += CullBoxesAgainstFrustum (frustum, scene.object_bounds, visibility.data);
+                cull_tested_count += scene.alive_object_count;
+
+                params.scene_visibility = visibility.data;
+            }
+            else
+            {
+                ArrayReserve (&visibility, instances.count);
+                CullBoxesAgainstFrustum (frustum, instance_bounds, visibility.data);
+
+                ArrayClear (&visible_instances);
+                for (s64 i = 0; i < instances.count; i += 1)
+                {
+                    if (visibility.data[i])
+                        ArrayPush (&visible_instances, instances[i]);
+                }
+
+                cull_tested_count += instances.count;
+                cull_visible_count += visible_instances.count;
+
+                params.instances = visible_instances.data;
+                params.instance_count = visible_instances.count;
+            }
+
+            cull_time += GetTimeInSeconds () - cull_start;
+        }
 
-void LogError (const char *str, ...)
-{
-    printf ("\x1b[1;31mError: ");
+        if (occlusion_culling)
+        {
+            f64 wait_start = GetTimeInSeconds ();
+            EndOcclusionCulling (&occlusion_culler);
+            occlusion_wait_time += GetTimeInSeconds () - wait_start;
+
+            for (s64 i = 0; i < scene.objects.count; i += 1)
+            {
+                if (!visibility.data[i] || !scene.objects[i].alive)
+                    continue;
+
+                occlusion_tested_count += 1;
+                if (occlusion_culler.occluded[i])
+                {
+                    visibility.data[i] = 0;
+                    occlusion_culled_count += 1;
+                }
+            }
+
+            occlusion_occluder_count += occlusion_culler.occluders.count;
+            occlusion_occluder_triangle_count += occlusion_culler.occluder_triangle_count;
+            occlusion_pass_time += occlusion_culler.pass_time;
+        }
 
-    va_list args;
-    va_start (args, str);
+        if (args.render_thread)
+        {
+            PublishRenderSnapshot (&g_render_thread, params);
+        }
+        else
+        {
+            if (mesh_streaming)
+            {
+                mesh_streaming = !GfxStreamMeshObjects (&mesh, Mesh_Stream_Frame_Budget);
+                if (!mesh_streaming)
+                    LogMessage ("Streamed mesh '%s' in %d frames", args.mesh_filename, frame_index + 1);
+            }
+
+            f64 submit_start = GetTimeInSeconds ();
+            GfxRenderFrame (params);
+            PushTimingSample (&g_frame_timings.submit, GetTimeInSeconds () - submit_start);
+
+            CollectPassTimings (&g_frame_timings);
+        }
 
-    vprintf (str, args);
+        timer += 1 / 60.0f;
+        frame_index += 1;
+    }
 
-    va_end (args);
+    if (args.render_thread)
+        StopRenderThread ();
 
-    printf ("\x1b[0m\n");
-}
+    if (args.frame_count > 0 && frame_index > 0)
+    {
+        f64 elapsed = GetTimeInSeconds () - frame_loop_start;
+        const GfxStats &stats = GfxGetStats ();
 
-Result<String> ReadEntireFile (const char *filename)
-{
-    FILE *file = fopen (filename, "rb");
-    if (!file)
-        return Result<String>::Bad (false);
+        s64 loop_frame_count = frame_index + skipped_frame_count;
 
-    defer (fclose (file));
+        LogMessage ("Ran %ld frames in %.3f s (%.3f ms per frame), %ld draw calls, %ld triangles submitted, %ld bytes uploaded",
+            loop_frame_count, elapsed, elapsed * 1000 / loop_frame_count,
+            stats.draw_calls, stats.triangles_submitted, stats.bytes_uploaded);
 
-    fseek (file, 0, SEEK_END);
-    s64 size = ftell (file);
-    rewind (file);
+        // The per frame averages below are over the drawn frames only
+        if (args.on_demand)
+            LogMessage ("Drew %d of them, skipped %ld where nothing changed", frame_index, skipped_frame_count);
 
-    char *data = (char *)malloc (size + 1);
-    if (!data)
-        return Result<String>::Bad (false);
+        if (stats.resolution_scale_sum > 0)
+        {
+            LogMessage ("Dynamic resolution: average scale %.3f, last scale %.3f",
+                stats.resolution_scale_sum / stats.frame_count, stats.resolution_scale);
+        }
 
-    s64 number_of_bytes_read = fread (data, 1, size, file);
-    data[number_of_bytes_read] = 0;
+        if (args.render_thread)
+        {
+            LogMessage ("Render thread drew %ld of the %d published frames",
+                g_render_thread.rendered_frame_count.load (), frame_index);
+        }
 
-    String str = String{number_of_bytes_read, data};
+        if (cull_tested_count > 0)
+        {
+            LogMessage ("Frustum culling per frame: %.1f objects tested, %.1f drawn, %.1f culled, %.3f ms",
+                cull_tested_count / (f64)frame_index, cull_visible_count / (f64)frame_index,
+                (cull_tested_count - cull_visible_count) / (f64)frame_index, cull_time * 1000 / frame_index);
+        }
 
-    return Result<String>::Good (str, true);
-}
+        if (occlusion_culling)
+        {
+            LogMessage ("Occlusion culling per frame: %.1f occluders (%.0f triangles), %.1f objects tested, %.1f culled, %.3f ms pass, %.3f ms waited",
+                occlusion_occluder_count / (f64)frame_index, occlusion_occluder_triangle_count / (f64)frame_index,
+                occlusion_tested_count / (f64)frame_index, occlusion_culled_count / (f64)frame_index,
+                occlusion_pass_time * 1000 / frame_index, occlusion_wait_time * 1000 / frame_index);
+        }
 
-bool LoadTextureFromFile (const char *filename, GfxTexture *texture, u32 *width, u32 *height)
-{
-    *texture = 0;
-    if (width)
-        *width = 0;
-    if (height)
-        *height = 0;
+        if (stats.state_calls_issued + stats.state_calls_elided > 0)
+        {
+            LogMessage ("State calls per frame: %.1f issued, %.1f elided",
+                stats.state_calls_issued / (f64)stats.frame_count, stats.state_calls_elided / (f64)stats.frame_count);
+        }
 
-    int x, y;
-    u8 *pixels = stbi_load (filename, &x, &y, null, 4);
-    if (!pixels)
-    {
-        return false;
+        if (args.render_thread)
+        {
+            LogFrameTimings (g_frame_timings, "Main thread timings");
+            LogFrameTimings (g_render_thread.timings, "Render thread timings");
+        }
+        else
+        {
+            LogFrameTimings (g_frame_timings);
+        }
     }
 
-    defer (stbi_image_free (pixels));
-
-    GfxTexture result = GfxCreateTexture (pixels, x, y);
-    if (!result)
-        return false;
-
-    *texture = result;
-    if (width)
-        *width = x;
-    if (height)
-        *height = y;
+#ifdef SCOP_BACKEND_SOFTWARE
+    if (args.output_filename)
+    {
+        if (!SwWriteFramebufferToFile (args.output_filename))
+        {
+            LogError ("Could not write last frame to '%s'", args.output_filename);
+            return 1;
+        }
 
-    LogMessage ("Loaded texture %s, %u by %u px", filename, x, y);
+        LogMessage ("Wrote last frame to '%s'", args.output_filename);
+    }
+#endif
 
-    return true;
+    return 0;
 }
 
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
+#ifndef SCOP_BACKEND_HEADLESS
+void GLFWErrorCallback (int code, const char *description)
+{
+    (void)code;
+    if (description)
+        LogError ("GLFW: %s", description);
+}
+#endif
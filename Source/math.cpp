@@ -448,6 +448,30 @@ Mat4f Inverted (const Mat4f &m)
     };
 }
 
+Mat3f NormalMatrix (const Mat4f &m)
+{
+    // The inverse transpose is the cofactor matrix divided by the determinant
+    Vec3f a = Vec3f{m.r0c0, m.r1c0, m.r2c0};
+    Vec3f b = Vec3f{m.r0c1, m.r1c1, m.r2c1};
+    Vec3f c = Vec3f{m.r0c2, m.r1c2, m.r2c2};
+
+    Vec3f bc = Cross (b, c);
+    Vec3f ca = Cross (c, a);
+    Vec3f ab = Cross (a, b);
+
+    float det = Dot (a, bc);
+    if (det == 0)
+        return Mat3f{};
+
+    float inv_det = 1 / det;
+
+    return Mat3f{
+        bc.x * inv_det, ca.x * inv_det, ab.x * inv_det,
+        bc.y * inv_det, ca.y * inv_det, ab.y * inv_det,
+        bc.z * inv_det, ca.z * inv_det, ab.z * inv_det
+    };
+}
+
 Vec3f RightVector (const Mat4f &m)
 {
     return Normalized (Vec3f{m.r0c0, m.r1c0, m.r2c0});
@@ -588,3 +612,22 @@ Mat4f Mul (const Mat4f &a, const Mat4f &b)
 
     return result;
 }
+
+Vec4f Mul (const Mat4f &m, const Vec4f &v)
+{
+    return Vec4f{
+        m.r0c0 * v.x + m.r0c1 * v.y + m.r0c2 * v.z + m.r0c3 * v.w,
+        m.r1c0 * v.x + m.r1c1 * v.y + m.r1c2 * v.z + m.r1c3 * v.w,
+        m.r2c0 * v.x + m.r2c1 * v.y + m.r2c2 * v.z + m.r2c3 * v.w,
+        m.r3c0 * v.x + m.r3c1 * v.y + m.r3c2 * v.z + m.r3c3 * v.w
+    };
+}
+
+Vec3f Mul (const Mat3f &m, const Vec3f &v)
+{
+    return Vec3f{
+        m.r0c0 * v.x + m.r0c1 * v.y + m.r0c2 * v.z,
+        m.r1c0 * v.x + m.r1c1 * v.y + m.r1c2 * v.z,
+        m.r2c0 * v.x + m.r2c1 * v.y + m.r2c2 * v.z
+    };
+}
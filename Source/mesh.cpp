@@ -73,26 +73,6 @@ WeldMeshResult WeldMesh (Vertex *vertices, u32 vertex_count)
     return result;
 }
 
-void CalculateNormalsFlat (Vertex *vertices, s64 vertex_count)
-{
-    Assert (vertex_count % 3 == 0, "Vertices must form triangles");
-
-    s64 tri_count = vertex_count / 3;
-    for (int i = 0; i < tri_count; i += 1)
-    {
-        Vertex *v = vertices + i * 3;
-
-        Vec3f delta12 = v[2].position - v[1].position;
-        Vec3f delta10 = v[0].position - v[1].position;
-        Vec3f normal = Cross (delta12, delta10);
-        normal = Normalized (normal);
-
-        v[0].normal = normal;
-        v[1].normal = normal;
-        v[2].normal = normal;
-    }
-}
-
 void CalculateNormalsSmooth (Vertex *vertices, s64 vertex_count, u32 *indices, s64 index_count)
 {
     Assert (index_count % 3 == 0, "Vertices must form triangles");
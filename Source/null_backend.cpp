@@ -0,0 +1,174 @@
+#include "Scop_Core.h"
+#include "Scop_Graphics.h"
+
+static GfxStats g_stats;
+static u32 g_next_object_id = 1;
+static int g_offscreen_width;
+static int g_offscreen_height;
+
+bool GfxInitBackend (int offscreen_width, int offscreen_height, const GfxDynamicResolution *dynamic_resolution)
+{
+    memset (&g_stats, 0, sizeof (g_stats));
+
+    if (dynamic_resolution)
+        LogWarning ("Dynamic resolution is not supported by the %s backend", SCOP_BACKEND_NAME);
+
+    if (offscreen_width > 0 && offscreen_height > 0)
+    {
+        g_offscreen_width = offscreen_width;
+        g_offscreen_height = offscreen_height;
+    }
+
+    return true;
+}
+
+void GfxTerminateBackend ()
+{
+}
+
+void GfxAcquireContext ()
+{
+}
+
+void GfxReleaseContext ()
+{
+}
+
+void GfxGetFramebufferSize (int *width, int *height)
+{
+    *width = g_offscreen_width > 0 ? g_offscreen_width : SCOP_WINDOW_WIDTH;
+    *height = g_offscreen_height > 0 ? g_offscreen_height : SCOP_WINDOW_HEIGHT;
+}
+
+const GfxStats &GfxGetStats ()
+{
+    return g_stats;
+}
+
+bool GfxGetPassTimings (GfxPassTimings *)
+{
+    return false;
+}
+
+void GfxCreateMeshObjects (Mesh *mesh)
+{
+    mesh->gfx_objects.id = g_next_object_id;
+    g_next_object_id += 1;
+
+    g_stats.mesh_objects_created += 1;
+    g_stats.bytes_uploaded += sizeof (Vertex) * mesh->vertex_count + sizeof (u32) * mesh->index_count;
+}
+
+// The mesh is read in place, there is nothing to stream
+void GfxCreateMeshObjectsStreamed (Mesh *mesh)
+{
+    GfxCreateMeshObjects (mesh);
+}
+
+bool GfxStreamMeshObjects (Mesh *, f64)
+{
+    return true;
+}
+
+void GfxDestroyMeshObjects (Mesh *mesh)
+{
+    if (mesh->gfx_objects.id)
+        g_stats.mesh_objects_destroyed += 1;
+
+    mesh->gfx_objects.id = 0;
+}
+
+void GfxCreateScenePool (GfxScenePool *pool, s64 vertex_capacity, s64 index_capacity)
+{
+    (void)vertex_capacity;
+    (void)index_capacity;
+
+    pool->id = g_next_object_id;
+    g_next_object_id += 1;
+
+    g_stats.mesh_objects_created += 1;
+}
+
+void GfxDestroyScenePool (GfxScenePool *pool)
+{
+    if (pool->id)
+        g_stats.mesh_objects_destroyed += 1;
+
+    pool->id = 0;
+}
+
+void GfxResizeScenePool (GfxScenePool *pool, s64 old_vertex_capacity, s64 old_index_capacity, s64 vertex_capacity, s64 index_capacity)
+{
+    (void)pool;
+    (void)old_vertex_capacity;
+    (void)old_index_capacity;
+    (void)vertex_capacity;
+    (void)index_capacity;
+}
+
+void GfxUploadToScenePool (GfxScenePool *pool, s64 first_vertex, const Vertex *vertices, s64 vertex_count, s64 first_index, const u32 *indices, s64 index_count)
+{
+    (void)pool;
+    (void)first_vertex;
+    (void)vertices;
+    (void)first_index;
+    (void)indices;
+
+    g_stats.bytes_uploaded += sizeof (Vertex) * vertex_count + sizeof (u32) * index_count;
+}
+
+// Every format is accepted, so that headless runs go through the texture encoder
+bool GfxSupportsTextureFormat (TextureFormat format)
+{
+    return format >= 0 && format < TextureFormat_Count;
+}
+
+GfxTexture GfxCreateTexture (const TextureData &data)
+{
+    g_stats.textures_created += 1;
+    for (int i = 0; i < data.level_count; i += 1)
+        g_stats.bytes_uploaded += data.levels[i].size;
+
+    GfxTexture result = g_next_object_id;
+    g_next_object_id += 1;
+
+    return result;
+}
+
+void GfxDestroyTexture (GfxTexture *texture)
+{
+    if (*texture)
+        g_stats.textures_destroyed += 1;
+
+    *texture = 0;
+}
+
+void GfxRenderFrame (const RenderFrameParams &params)
+{
+    g_stats.frame_count += 1;
+    g_stats.draw_calls += 1;
+
+    if (params.scene)
+    {
+        for (s64 i = 0; i < params.scene->objects.count; i += 1)
+        {
+            bool visible = !params.scene_visibility || params.scene_visibility[i];
+            if (params.scene->objects[i].alive && visible)
+                g_stats.triangles_submitted += params.scene->objects[i].index_count / 3;
+        }
+    }
+    else
+    {
+        s64 instance_count = params.instances ? params.instance_count : 1;
+        g_stats.triangles_submitted += params.mesh->index_count / 3 * instance_count;
+    }
+}
+
+// Nothing is rasterized, there are no pixels to read back
+void GfxReadbackFrame (GfxReadbackProc, void *)
+{
+}
+
+void GfxFlushReadbacks ()
+{
+}
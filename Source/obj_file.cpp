@@ -147,8 +147,16 @@ struct OBJQuadFace
     OBJIndex indices[4];
 };
 
-bool LoadMeshFromObjFile (const char *filename, Mesh *mesh, LoadMeshFlags flags)
+bool LoadMeshFromObjFile (const char *filename, Mesh *mesh, LoadMeshFlags flags, LoadMeshStats *stats)
 {
+    LoadMeshStats local_stats = {};
+    if (!stats)
+        stats = &local_stats;
+
+    memset (stats, 0, sizeof (LoadMeshStats));
+
+    f64 stage_start = GetTimeInSeconds ();
+
     auto read_result = ReadEntireFile (filename);
     if (!read_result.ok)
     {
@@ -158,6 +166,10 @@ bool LoadMeshFromObjFile (const char *filename, Mesh *mesh, LoadMeshFlags flags)
     String file_contents = read_result.value;
     defer (free (file_contents.data));
 
+    stats->file_size = file_contents.length;
+    stats->read_time = GetTimeInSeconds () - stage_start;
+    stage_start = GetTimeInSeconds ();
+
     Parser parser {};
     ParserInit (&parser, file_contents);
 
@@ -394,12 +406,11 @@ bool LoadMeshFromObjFile (const char *filename, Mesh *mesh, LoadMeshFlags flags)
         }
     }
 
+    stats->face_count = faces.count;
+    stats->parse_time = GetTimeInSeconds () - stage_start;
+    stage_start = GetTimeInSeconds ();
+
     bool has_normals = normals.count != 0;
-    if (normals.count == 0 && (flags & LoadMesh_CalculateNormalsFlat))
-    {
-        CalculateNormalsFlat (vertices, vertex_count);
-        has_normals = true;
-    }
 
     if (flags & LoadMesh_WeldMesh)
     {
@@ -443,12 +454,18 @@ bool LoadMeshFromObjFile (const char *filename, Mesh *mesh, LoadMeshFlags flags)
         }
     }
 
+    stats->weld_time = GetTimeInSeconds () - stage_start;
+    stage_start = GetTimeInSeconds ();
+
     if (normals.count == 0 && (flags & LoadMesh_CalculateNormalsSmooth))
     {
         CalculateNormalsSmooth (mesh->vertices, mesh->vertex_count, mesh->indices, mesh->index_count);
         has_normals = true;
     }
 
+    stats->normals_time = GetTimeInSeconds () - stage_start;
+    stage_start = GetTimeInSeconds ();
+
     bool has_tex_coords = tex_coords.count > 0;
     if (tex_coords.count == 0 && flags & LoadMesh_CalculateTexCoords)
     {
@@ -456,14 +473,23 @@ bool LoadMeshFromObjFile (const char *filename, Mesh *mesh, LoadMeshFlags flags)
         has_tex_coords = true;
     }
 
+    stats->tex_coords_time = GetTimeInSeconds () - stage_start;
+    stage_start = GetTimeInSeconds ();
+
     if (has_tex_coords && has_normals && (flags & LoadMesh_CalculateTangents))
     {
         CalculateTangents (mesh->vertices, mesh->vertex_count, mesh->indices, mesh->index_count);
     }
 
+    stats->tangents_time = GetTimeInSeconds () - stage_start;
+    stage_start = GetTimeInSeconds ();
+
     CalculateBoundingBox (mesh);
 
-    GfxCreateMeshObjects (mesh);
+    stats->bounds_time = GetTimeInSeconds () - stage_start;
+
+    if (!(flags & LoadMesh_NoGfxObjects))
+        GfxCreateMeshObjects (mesh);
 
     LogMessage ("Loaded mesh '%s', %ld vertices, %ld indices", filename, mesh->vertex_count, mesh->index_count);
 
@@ -0,0 +1,425 @@
+#include "Scop_Core.h"
+#include "Scop_Math.h"
+#include "Scop_Graphics.h"
+
+#ifdef SCOP_AVX2_AVAILABLE
+    #include <immintrin.h>
+#endif
+
+// Masked software occlusion culling, after Hasselgren et al. (Masked Software Occlusion Culling).
+// Depth is the window depth of the main pass, 0 is near and 1 is far. Occluders only add
+// coverage where they cover a pixel center, and use their farthest depth. The buffer is much
+// coarser than the framebuffer, so an object seen only through a gap between occluders that
+// misses every pixel center, up to a buffer pixel wide, can be culled. Requiring whole pixels
+// to be covered would avoid that, but it also drops the pixels along every edge shared by two
+// triangles, and dense occluders would then almost never fill a tile
+
+#define Occlusion_Tile_Size 8
+#define Occlusion_Buffer_Width 256
+#define Occlusion_Max_Occluders 16
+#define Occlusion_Max_Occluder_Triangles 16384 // For all the occluders of a pass
+#define Occlusion_Near_W 0.001f
+
+static_assert (Occlusion_Tile_Size * Occlusion_Tile_Size == 64, "Tile coverage is a 64 bit mask");
+
+void InitOcclusionCuller (OcclusionCuller *culler, int framebuffer_width, int framebuffer_height)
+{
+    float aspect = framebuffer_width > 0 ? framebuffer_height / (float)framebuffer_width : 1;
+
+    culler->tiles_x = Occlusion_Buffer_Width / Occlusion_Tile_Size;
+    culler->tiles_y = Max ((int)ceilf (culler->tiles_x * aspect), 1);
+    culler->width = culler->tiles_x * Occlusion_Tile_Size;
+    culler->height = culler->tiles_y * Occlusion_Tile_Size;
+    culler->tiles = (OcclusionTile *)malloc (sizeof (OcclusionTile) * culler->tiles_x * culler->tiles_y);
+    Assert (culler->tiles != null);
+
+    for (int i = 0; i < Occlusion_Max_Occluders; i += 1)
+        ArrayPush (&culler->occluder_triangles);
+}
+
+void DestroyOcclusionCuller (OcclusionCuller *culler)
+{
+    WaitForJobs (&culler->group);
+
+    for (s64 i = 0; i < culler->occluder_triangles.count; i += 1)
+        ArrayFree (&culler->occluder_triangles[i]);
+
+    ArrayFree (&culler->occluder_triangles);
+    ArrayFree (&culler->occluders);
+    ArrayFree (&culler->occluded);
+
+    free (culler->tiles);
+    culler->tiles = null;
+}
+
+// The biggest objects relative to their distance to the camera hide the most. They are
+// picked in that order until the triangle budget runs out
+static void SelectOccluders (OcclusionCuller *culler)
+{
+    const Scene *scene = culler->scene;
+
+    float scores[Occlusion_Max_Occluders];
+    ArrayClear (&culler->occluders);
+
+    for (s64 i = 0; i < scene->objects.count; i += 1)
+    {
+        const SceneObject &object = scene->objects[i];
+        if (!object.alive || object.index_count / 3 > Occlusion_Max_Occluder_Triangles)
+            continue;
+
+        Vec3f extents = object.aabb_max - object.aabb_min;
+        Vec3f to_center = (object.aabb_min + object.aabb_max) * 0.5f - culler->camera_position;
+        float size_sqrd = Dot (extents, extents);
+        float distance_sqrd = Max (Dot (to_center, to_center), 0.0001f);
+        float score = size_sqrd / distance_sqrd;
+
+        // Insertion into the list of the best scores so far, sorted by decreasing score
+        s64 index = culler->occluders.count;
+        while (index > 0 && scores[index - 1] < score)
+            index -= 1;
+
+        if (index >= Occlusion_Max_Occluders)
+            continue;
+
+        if (culler->occluders.count < Occlusion_Max_Occluders)
+            ArrayPush (&culler->occluders);
+
+        for (s64 j = culler->occluders.count - 1; j > index; j -= 1)
+        {
+            culler->occluders[j] = culler->occluders[j - 1];
+            scores[j] = scores[j - 1];
+        }
+
+        culler->occluders[index] = i;
+        scores[index] = score;
+    }
+
+    s64 triangle_count = 0;
+    s64 selected_count = 0;
+    for (s64 i = 0; i < culler->occluders.count; i += 1)
+    {
+        s64 object_triangle_count = scene->objects[culler->occluders[i]].index_count / 3;
+        if (triangle_count + object_triangle_count > Occlusion_Max_Occluder_Triangles)
+            continue;
+
+        culler->occluders[selected_count] = culler->occluders[i];
+        selected_count += 1;
+        triangle_count += object_triangle_count;
+    }
+
+    culler->occluders.count = selected_count;
+}
+
+static void SetupOccluder (s64 occluder_index, void *data)
+{
+    OcclusionCuller *culler = (OcclusionCuller *)data;
+    const Scene *scene = culler->scene;
+    const SceneObject &object = scene->objects[culler->occluders[occluder_index]];
+    Array<OcclusionTriangle> *triangles = &culler->occluder_triangles[occluder_index];
+
+    ArrayClear (triangles);
+
+    float width = (float)culler->width;
+    float height = (float)culler->height;
+
+    for (s64 t = 0; t < object.index_count / 3; t += 1)
+    {
+        OcclusionTriangle tri;
+
+        bool clipped = false;
+        float max_z = 0;
+        for (int i = 0; i < 3; i += 1)
+        {
+            u32 index = scene->indices[object.first_index + t * 3 + i];
+            const Vec3f &p = scene->positions[object.base_vertex + index];
+            Vec4f clip = culler->model_view_projection * Vec4f{p.x, p.y, p.z, 1};
+
+            // Clipping would only make the occluder smaller, dropping the triangle is simpler
+            if (clip.w < Occlusion_Near_W)
+            {
+                clipped = true;
+                break;
+            }
+
+            float inv_w = 1 / clip.w;
+            tri.x[i] = (clip.x * inv_w * 0.5f + 0.5f) * width;
+            tri.y[i] = (clip.y * inv_w * 0.5f + 0.5f) * height;
+            max_z = Max (max_z, clip.z * inv_w * 0.5f + 0.5f);
+        }
+
+        if (clipped)
+            continue;
+
+        float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+        if (!(area != 0))
+            continue;
+
+        if (area < 0)
+        {
+            float tmp;
+            tmp = tri.x[1]; tri.x[1] = tri.x[2]; tri.x[2] = tmp;
+            tmp = tri.y[1]; tri.y[1] = tri.y[2]; tri.y[2] = tmp;
+        }
+
+        float min_x = Min (tri.x[0], Min (tri.x[1], tri.x[2]));
+        float min_y = Min (tri.y[0], Min (tri.y[1], tri.y[2]));
+        float max_x = Max (tri.x[0], Max (tri.x[1], tri.x[2]));
+        float max_y = Max (tri.y[0], Max (tri.y[1], tri.y[2]));
+
+        if (max_x < 0 || max_y < 0 || min_x >= width || min_y >= height)
+            continue;
+
+        tri.max_z = max_z;
+        tri.min_tile_x = (int)Max (min_x, 0.0f) / Occlusion_Tile_Size;
+        tri.min_tile_y = (int)Max (min_y, 0.0f) / Occlusion_Tile_Size;
+        tri.max_tile_x = (int)Min (max_x, width - 1) / Occlusion_Tile_Size;
+        tri.max_tile_y = (int)Min (max_y, height - 1) / Occlusion_Tile_Size;
+
+        ArrayPush (triangles, tri);
+    }
+}
+
+// Edge i goes from vertex i to vertex i + 1, E(x, y) = a * x + b * y + c is positive on the
+// inside of a counter clockwise triangle
+struct OcclusionEdges
+{
+    float a[3];
+    float b[3];
+    float c[3];
+};
+
+static void SetupOcclusionEdges (const OcclusionTriangle &tri, OcclusionEdges *edges)
+{
+    for (int i = 0; i < 3; i += 1)
+    {
+        int j = (i + 1) % 3;
+
+        edges->a[i] = tri.y[i] - tri.y[j];
+        edges->b[i] = tri.x[j] - tri.x[i];
+        edges->c[i] = -(edges->a[i] * tri.x[i] + edges->b[i] * tri.y[i]);
+    }
+}
+
+// Pixel centers strictly inside the triangle, bit x + y * 8 of the mask
+static u64 ComputeTileCoverage (const OcclusionEdges &edges, int tile_x, int tile_y)
+{
+    float x0 = tile_x * Occlusion_Tile_Size + 0.5f;
+    float y0 = tile_y * Occlusion_Tile_Size + 0.5f;
+
+    u64 coverage = 0;
+    for (int y = 0; y < Occlusion_Tile_Size; y += 1)
+    {
+        for (int x = 0; x < Occlusion_Tile_Size; x += 1)
+        {
+            bool inside = true;
+            for (int i = 0; i < 3; i += 1)
+                inside &= edges.a[i] * (x0 + x) + (edges.b[i] * (y0 + y) + edges.c[i]) > 0;
+
+            coverage |= (u64)inside << (y * Occlusion_Tile_Size + x);
+        }
+    }
+
+    return coverage;
+}
+
+#ifdef SCOP_AVX2_AVAILABLE
+
+// One row of 8 pixels per register, same operations as ComputeTileCoverage
+SCOP_TARGET_AVX2
+static u64 ComputeTileCoverageAVX2 (const OcclusionEdges &edges, int tile_x, int tile_y)
+{
+    float x0 = tile_x * Occlusion_Tile_Size + 0.5f;
+    float y0 = tile_y * Occlusion_Tile_Size + 0.5f;
+
+    __m256 px = _mm256_add_ps (_mm256_set1_ps (x0), _mm256_setr_ps (0, 1, 2, 3, 4, 5, 6, 7));
+    __m256 zero = _mm256_setzero_ps ();
+
+    __m256 ax[3];
+    for (int i = 0; i < 3; i += 1)
+        ax[i] = _mm256_mul_ps (_mm256_set1_ps (edges.a[i]), px);
+
+    u64 coverage = 0;
+    for (int y = 0; y < Occlusion_Tile_Size; y += 1)
+    {
+        __m256 inside = _mm256_castsi256_ps (_mm256_set1_epi32 (-1));
+        for (int i = 0; i < 3; i += 1)
+        {
+            __m256 e = _mm256_add_ps (ax[i], _mm256_set1_ps (edges.b[i] * (y0 + y) + edges.c[i]));
+            inside = _mm256_and_ps (inside, _mm256_cmp_ps (e, zero, _CMP_GT_OQ));
+        }
+
+        coverage |= (u64)_mm256_movemask_ps (inside) << (y * Occlusion_Tile_Size);
+    }
+
+    return coverage;
+}
+
+#endif
+
+static bool g_occlusion_use_avx2;
+
+static void UpdateOcclusionTile (OcclusionTile *tile, u64 coverage, float max_z)
+{
+    // The triangle is behind the full layer, it cannot hide anything more
+    if (coverage == 0 || max_z >= tile->z0)
+        return;
+
+    tile->coverage |= coverage;
+    tile->z1 = Max (tile->z1, max_z);
+
+    if (tile->coverage == ~(u64)0)
+    {
+        tile->z0 = tile->z1;
+        tile->z1 = 0;
+        tile->coverage = 0;
+    }
+}
+
+// Every row of tiles walks all the occluder triangles in the same order, so rows can be
+// rasterized in parallel and the result does not depend on the number of threads
+static void RasterizeOcclusionRow (s64 tile_y, void *data)
+{
+    OcclusionCuller *culler = (OcclusionCuller *)data;
+    OcclusionTile *row = culler->tiles + tile_y * culler->tiles_x;
+
+    for (int x = 0; x < culler->tiles_x; x += 1)
+    {
+        row[x].coverage = 0;
+        row[x].z0 = 1;
+        row[x].z1 = 0;
+    }
+
+    for (s64 o = 0; o < culler->occluders.count; o += 1)
+    {
+        const Array<OcclusionTriangle> &triangles = culler->occluder_triangles[o];
+        for (s64 t = 0; t < triangles.count; t += 1)
+        {
+            const OcclusionTriangle &tri = triangles.data[t];
+            if (tile_y < tri.min_tile_y || tile_y > tri.max_tile_y)
+                continue;
+
+            OcclusionEdges edges;
+            SetupOcclusionEdges (tri, &edges);
+
+            for (int x = tri.min_tile_x; x <= tri.max_tile_x; x += 1)
+            {
+                u64 coverage;
+#ifdef SCOP_AVX2_AVAILABLE
+                if (g_occlusion_use_avx2)
+                    coverage = ComputeTileCoverageAVX2 (edges, x, (int)tile_y);
+                else
+#endif
+                    coverage = ComputeTileCoverage (edges, x, (int)tile_y);
+
+                UpdateOcclusionTile (&row[x], coverage, tri.max_z);
+            }
+        }
+    }
+}
+
+// An object is hidden if its nearest depth is behind the full layer of every tile its
+// screen rectangle touches
+static bool IsBoxOccluded (const OcclusionCuller *culler, const Vec3f &aabb_min, const Vec3f &aabb_max)
+{
+    float min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX;
+    float max_x = -FLT_MAX, max_y = -FLT_MAX;
+
+    for (int i = 0; i < 8; i += 1)
+    {
+        Vec4f corner = Vec4f{
+            (i & 1) ? aabb_max.x : aabb_min.x,
+            (i & 2) ? aabb_max.y : aabb_min.y,
+            (i & 4) ? aabb_max.z : aabb_min.z,
+            1
+        };
+        Vec4f clip = culler->model_view_projection * corner;
+
+        // The box crosses the near plane, the camera might be inside of it
+        if (clip.w < Occlusion_Near_W)
+            return false;
+
+        float inv_w = 1 / clip.w;
+        float x = (clip.x * inv_w * 0.5f + 0.5f) * culler->width;
+        float y = (clip.y * inv_w * 0.5f + 0.5f) * culler->height;
+        float z = clip.z * inv_w * 0.5f + 0.5f;
+
+        min_x = Min (min_x, x);
+        min_y = Min (min_y, y);
+        min_z = Min (min_z, z);
+        max_x = Max (max_x, x);
+        max_y = Max (max_y, y);
+    }
+
+    if (max_x < 0 || max_y < 0 || min_x >= culler->width || min_y >= culler->height)
+        return false; // Left to frustum culling
+
+    int tile_x0 = (int)Max (min_x, 0.0f) / Occlusion_Tile_Size;
+    int tile_y0 = (int)Max (min_y, 0.0f) / Occlusion_Tile_Size;
+    int tile_x1 = (int)Min (max_x, culler->width - 1.0f) / Occlusion_Tile_Size;
+    int tile_y1 = (int)Min (max_y, culler->height - 1.0f) / Occlusion_Tile_Size;
+
+    for (int y = tile_y0; y <= tile_y1; y += 1)
+    {
+        for (int x = tile_x0; x <= tile_x1; x += 1)
+        {
+            if (min_z < culler->tiles[y * culler->tiles_x + x].z0)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+static void TestOccludee (s64 object_index, void *data)
+{
+    OcclusionCuller *culler = (OcclusionCuller *)data;
+    const SceneObject &object = culler->scene->objects[object_index];
+
+    culler->occluded[object_index] = object.alive && IsBoxOccluded (culler, object.aabb_min, object.aabb_max);
+}
+
+static void OcclusionPassJob (void *data)
+{
+    OcclusionCuller *culler = (OcclusionCuller *)data;
+
+    f64 start = GetTimeInSeconds ();
+
+    SelectOccluders (culler);
+    ParallelFor (culler->occluders.count, SetupOccluder, culler, 1);
+
+    culler->occluder_triangle_count = 0;
+    for (s64 i = 0; i < culler->occluders.count; i += 1)
+        culler->occluder_triangle_count += culler->occluder_triangles[i].count;
+
+    ParallelFor (culler->tiles_y, RasterizeOcclusionRow, culler, 1);
+
+    s64 object_count = culler->scene->objects.count;
+    ArrayReserve (&culler->occluded, object_count);
+    culler->occluded.count = object_count;
+    ParallelFor (object_count, TestOccludee, culler, 64);
+
+    culler->occluded_count = 0;
+    for (s64 i = 0; i < object_count; i += 1)
+        culler->occluded_count += culler->occluded[i];
+
+    culler->pass_time = GetTimeInSeconds () - start;
+}
+
+void BeginOcclusionCulling (OcclusionCuller *culler, const Scene *scene, const Mat4f &model_view_projection, const Vec3f &camera_position)
+{
+    Assert (IsDone (&culler->group), "The previous occlusion pass was not ended");
+
+    static bool avx2_supported = CPUSupportsAVX2 ();
+    g_occlusion_use_avx2 = avx2_supported;
+
+    culler->scene = scene;
+    culler->model_view_projection = model_view_projection;
+    culler->camera_position = camera_position;
+
+    PushJob (&culler->group, OcclusionPassJob, culler);
+}
+
+void EndOcclusionCulling (OcclusionCuller *culler)
+{
+    WaitForJobs (&culler->group);
+}
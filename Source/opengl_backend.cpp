@@ -1,7 +1,317 @@
 #include "Scop_Core.h"
 #include "Scop_Graphics.h"
 
-static GLuint g_shader;
+// Same layout as the Draw_Uniforms block of the mesh shaders (std140, row major)
+struct GLDrawUniforms
+{
+    Mat4f view_projection_matrix;
+    Vec3f light_position;
+    float pad0;
+    Vec3f light_color;
+    float texture_alpha;
+};
+
+static_assert (sizeof (GLDrawUniforms) == 96, "GLDrawUniforms does not match the std140 layout of Draw_Uniforms");
+
+// Contents of the instance buffer, read with an attribute divisor of 1
+struct GLInstance
+{
+    Mat4f model_matrix;
+    Vec3f normal_matrix_rows[3];
+    Vec3f color;
+};
+
+// Bound objects and fixed function state as last set through the GLState functions below.
+// The element array buffer is not tracked, it is part of the vertex array object
+struct GLStateCache
+{
+    GLuint program;
+    GLuint vertex_array;
+    GLuint array_buffer;
+    GLuint uniform_buffer;
+    GLuint texture_2d;
+    bool depth_test;
+    GLenum depth_func;
+    float clear_color[4];
+    GLint viewport[4];
+};
+
+enum GLTimerPass
+{
+    GL_Timer_Pass_Clear,
+    GL_Timer_Pass_Draw,
+    GL_Timer_Pass_Resolve,
+    GL_Timer_Pass_Count,
+};
+
+static const char *const GL_Timer_Pass_Names[GL_Timer_Pass_Count] = {"Clear", "Draw", "Resolve"};
+
+static_assert (GL_Timer_Pass_Count <= Gfx_Max_Passes, "Too many timer passes");
+
+// Query results are read back this many frames after being issued, by which point the GPU
+// is usually done with them and reading does not stall
+#define GL_Timer_Frame_Latency 4
+
+struct GLTimerFrame
+{
+    GLuint queries[GL_Timer_Pass_Count];
+    s64 frame_index;
+    float resolution_scale;
+    bool pending;
+};
+
+#define GL_Offscreen_Samples 4
+
+// Frames are rendered multisampled, then resolved into a single sampled copy that is read
+// back, or with dynamic resolution stretched to the framebuffer
+struct GLOffscreenTarget
+{
+    int width;
+    int height;
+    GLuint framebuffer;
+    GLuint color_renderbuffer;
+    GLuint depth_renderbuffer;
+    GLuint resolve_framebuffer;
+    GLuint resolve_renderbuffer;
+};
+
+// With dynamic resolution the scale moves this fraction of the way to the one that would hit
+// the target each time the GPU time of a frame is known. Smaller changes than the step are
+// ignored, so that the scale does not jitter around the target
+#define GL_Resolution_Scale_Rate 0.3f
+#define GL_Resolution_Scale_Step 0.02f
+
+// glReadPixels into a pixel buffer object returns right away, the copy happens on the GPU.
+// The buffer is mapped once its fence has signaled, a few readbacks later
+#define GL_Readback_Ring_Size 3
+
+struct GLReadback
+{
+    GLuint pixel_buffer;
+    GLsync fence;
+    GfxReadbackProc proc;
+    void *data;
+};
+
+// Streamed meshes are copied through a ring of staging segments into their buffers. The fence
+// of a segment signals once the copy out of it has executed and it can be written again
+#define GL_Stream_Segment_Size (8 * 1024 * 1024)
+#define GL_Stream_Segment_Count 4
+
+struct GLStreamRing
+{
+    GLuint buffer;
+    GLsync fences[GL_Stream_Segment_Count];
+    int next_segment;
+    u8 *mapped; // Persistent mapping of the whole ring, null when mapped per chunk
+};
+
+// Uniforms and instances are written to a different region of their buffer each frame, the
+// GPU may still be reading the regions of the GL_Frames_In_Flight - 1 previous frames.
+// With buffer storage the buffer stays mapped and a fence per frame guards its regions,
+// otherwise the single region is orphaned and the driver does the renaming
+#define GL_Frames_In_Flight 3
+#define GL_Instance_Region_Initial_Count 1024
+
+struct GLDynamicBuffer
+{
+    GLuint buffer;
+    GLenum target;
+    s64 region_size;
+    u8 *mapped; // Null when orphaning
+};
+
+// Program binaries are core in 4.1 and not part of the 3.3 loader, the entry points are
+// fetched at startup when the context has them (ARB_get_program_binary)
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+
+typedef void (APIENTRYP GLGetProgramBinaryProc) (GLuint program, GLsizei buf_size, GLsizei *length, GLenum *binary_format, void *binary);
+typedef void (APIENTRYP GLProgramBinaryProc) (GLuint program, GLenum binary_format, const void *binary, GLsizei length);
+typedef void (APIENTRYP GLProgramParameteriProc) (GLuint program, GLenum pname, GLint value);
+
+// Buffer storage is core in 4.4 and not part of the 3.3 loader (ARB_buffer_storage)
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+
+typedef void (APIENTRYP GLBufferStorageProc) (GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+// S3TC and BPTC are extensions of the 3.3 loader, BPTC is core in 4.2
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+
+#define GL_Program_Cache_Dir "Cache"
+#define GL_Program_Cache_Magic 0x42505053 // "SPPB"
+#define GL_Program_Cache_Version 1
+
+// Header of a program binary cache file, followed by the binary
+struct GLProgramCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 binary_format;
+    u32 binary_size;
+};
+
+static GLGetProgramBinaryProc g_glGetProgramBinary;
+static GLProgramBinaryProc g_glProgramBinary;
+static GLProgramParameteriProc g_glProgramParameteri;
+static GLBufferStorageProc g_glBufferStorage;
+
+// Shader variants are compiled from the same sources with a #define per feature, and only
+// when first needed. The index of a variant is its set of features
+enum GLShaderFeature
+{
+    GL_Shader_Texture = 0x1,      // Samples the texture
+    GL_Shader_Random_Color = 0x2, // Colors each primitive randomly, blended with the texture if both are set
+    GL_Shader_Flat_Shading = 0x4, // Normal of the plane of the triangle instead of the vertex normal
+};
+
+#define GL_Shader_Feature_Count 3
+#define GL_Shader_Variant_Count (1 << GL_Shader_Feature_Count)
+
+static const char *const GL_Shader_Feature_Defines[GL_Shader_Feature_Count] = {"SCOP_TEXTURE", "SCOP_RANDOM_COLOR", "SCOP_FLAT_SHADING"};
+
+#define GL_Shader_Fallback_Features (GL_Shader_Texture | GL_Shader_Random_Color)
+
+static String g_vs_source;
+static String g_fs_source;
+static GLuint g_shader_variants[GL_Shader_Variant_Count];
+static bool g_shader_variant_failed[GL_Shader_Variant_Count];
+static GLDynamicBuffer g_draw_uniforms_buffer;
+static GLDynamicBuffer g_instance_buffer;
+static GLsync g_frame_fences[GL_Frames_In_Flight];
+static Array<GLInstance> g_instances;
+static Array<GLsizei> g_multi_draw_counts;
+static Array<void *> g_multi_draw_offsets;
+static Array<GLint> g_multi_draw_base_vertices;
+static GLStateCache g_state;
+static GfxStats g_stats;
+static GLTimerFrame g_timer_frames[GL_Timer_Frame_Latency];
+static GfxPassTimings g_pass_timings;
+static bool g_has_new_pass_timings;
+static bool g_offscreen;
+static GLOffscreenTarget g_offscreen_target;
+static GLReadback g_readbacks[GL_Readback_Ring_Size];
+static s64 g_readbacks_queued;
+static s64 g_readbacks_completed;
+static GLStreamRing g_stream_ring;
+static bool g_dynamic_resolution;
+static GfxDynamicResolution g_dynamic_resolution_settings;
+static float g_resolution_scale;
+
+// Allocated at max_scale of the framebuffer, a frame only uses the part its scale covers so
+// that changing the scale never reallocates
+static GLOffscreenTarget g_scaled_target;
+static int g_scaled_target_framebuffer_width;
+static int g_scaled_target_framebuffer_height;
+
+static void ResetStateCache ()
+{
+    // Initial values of a new context, except the viewport that we always set before drawing
+    memset (&g_state, 0, sizeof (g_state));
+    g_state.depth_func = GL_LESS;
+}
+
+// Count a state change and tell whether the GL call should be issued
+static bool StateChanged (bool changed)
+{
+    if (changed)
+        g_stats.state_calls_issued += 1;
+    else
+        g_stats.state_calls_elided += 1;
+
+    return changed;
+}
+
+static void GLStateUseProgram (GLuint program)
+{
+    if (StateChanged (g_state.program != program))
+    {
+        glUseProgram (program);
+        g_state.program = program;
+    }
+}
+
+static void GLStateBindVertexArray (GLuint vertex_array)
+{
+    if (StateChanged (g_state.vertex_array != vertex_array))
+    {
+        glBindVertexArray (vertex_array);
+        g_state.vertex_array = vertex_array;
+    }
+}
+
+static void GLStateBindBuffer (GLenum target, GLuint buffer)
+{
+    GLuint *bound = null;
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER: bound = &g_state.array_buffer; break;
+    case GL_UNIFORM_BUFFER: bound = &g_state.uniform_buffer; break;
+    default: Panic ("Buffer target %x is not tracked by the state cache", target);
+    }
+
+    if (StateChanged (*bound != buffer))
+    {
+        glBindBuffer (target, buffer);
+        *bound = buffer;
+    }
+}
+
+static void GLStateBindTexture2D (GLuint texture)
+{
+    if (StateChanged (g_state.texture_2d != texture))
+    {
+        glBindTexture (GL_TEXTURE_2D, texture);
+        g_state.texture_2d = texture;
+    }
+}
+
+static void GLStateSetDepthTest (bool enabled)
+{
+    if (StateChanged (g_state.depth_test != enabled))
+    {
+        if (enabled)
+            glEnable (GL_DEPTH_TEST);
+        else
+            glDisable (GL_DEPTH_TEST);
+
+        g_state.depth_test = enabled;
+    }
+}
+
+static void GLStateDepthFunc (GLenum func)
+{
+    if (StateChanged (g_state.depth_func != func))
+    {
+        glDepthFunc (func);
+        g_state.depth_func = func;
+    }
+}
+
+static void GLStateClearColor (float r, float g, float b, float a)
+{
+    float *c = g_state.clear_color;
+    if (StateChanged (c[0] != r || c[1] != g || c[2] != b || c[3] != a))
+    {
+        glClearColor (r, g, b, a);
+        c[0] = r; c[1] = g; c[2] = b; c[3] = a;
+    }
+}
+
+static void GLStateViewport (GLint x, GLint y, GLint width, GLint height)
+{
+    GLint *v = g_state.viewport;
+    if (StateChanged (v[0] != x || v[1] != y || v[2] != width || v[3] != height))
+    {
+        glViewport (x, y, width, height);
+        v[0] = x; v[1] = y; v[2] = width; v[3] = height;
+    }
+}
 
 static bool CheckShader (GLuint shader, const char *desc)
 {
@@ -57,224 +367,1490 @@ static bool CheckShaderProgram (GLuint shader, const char *desc)
     return true;
 }
 
-static GLuint CreateShaderProgram (const char *vs_filename, const char *fs_filename)
+static bool HasGLExtension (const char *name)
 {
-    auto vs_read_res = ReadEntireFile (vs_filename);
-    if (!vs_read_res.ok)
+    GLint count = 0;
+    glGetIntegerv (GL_NUM_EXTENSIONS, &count);
+
+    for (GLint i = 0; i < count; i += 1)
     {
-        LogError ("Could not read file '%s'", vs_filename);
-        return 0;
+        const char *extension = (const char *)glGetStringi (GL_EXTENSIONS, i);
+        if (extension && strcmp (extension, name) == 0)
+            return true;
     }
 
-    String vs_source = vs_read_res.value;
-    defer (free (vs_source.data));
+    return false;
+}
+
+static void LoadProgramBinaryFunctions ()
+{
+    bool supported = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 1)
+        || HasGLExtension ("GL_ARB_get_program_binary");
 
-    auto fs_read_res = ReadEntireFile (fs_filename);
-    if (!fs_read_res.ok)
+    // Some drivers expose the functions but no format to save binaries in
+    GLint format_count = 0;
+    if (supported)
+        glGetIntegerv (GL_NUM_PROGRAM_BINARY_FORMATS, &format_count);
+
+    if (!supported || format_count == 0)
     {
-        LogError ("Could not read file '%s'", fs_filename);
-        return 0;
+        LogMessage ("Program binaries are not supported, shaders will be compiled at every launch");
+        return;
     }
 
-    String fs_source = fs_read_res.value;
-    defer (free (fs_source.data));
-
-    GLuint vs = glCreateShader (GL_VERTEX_SHADER);
-    defer (glDeleteShader (vs));
+    g_glGetProgramBinary = (GLGetProgramBinaryProc)glfwGetProcAddress ("glGetProgramBinary");
+    g_glProgramBinary = (GLProgramBinaryProc)glfwGetProcAddress ("glProgramBinary");
+    g_glProgramParameteri = (GLProgramParameteriProc)glfwGetProcAddress ("glProgramParameteri");
 
-    glShaderSource (vs, 1, &vs_source.data, null);
-    glCompileShader (vs);
+    if (!g_glGetProgramBinary || !g_glProgramBinary || !g_glProgramParameteri)
+    {
+        g_glGetProgramBinary = null;
+        g_glProgramBinary = null;
+        g_glProgramParameteri = null;
+    }
+}
 
-    if (!CheckShader (vs, "Could not compile vertex shader"))
-        return 0;
+static void LoadBufferStorageFunction ()
+{
+    bool supported = GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4)
+        || HasGLExtension ("GL_ARB_buffer_storage");
 
-    GLuint fs = glCreateShader (GL_FRAGMENT_SHADER);
-    defer (glDeleteShader (fs));
+    if (supported)
+        g_glBufferStorage = (GLBufferStorageProc)glfwGetProcAddress ("glBufferStorage");
 
-    glShaderSource (fs, 1, &fs_source.data, null);
-    glCompileShader (fs);
+    if (g_glBufferStorage)
+        LogMessage ("Per-frame buffers are persistently mapped");
+    else
+        LogMessage ("Buffer storage is not supported, per-frame buffers are orphaned every frame");
+}
 
-    if (!CheckShader (fs, "Could not compile fragment shader"))
-        return 0;
+static bool WaitForFence (GLsync *fence)
+{
+    if (!*fence)
+        return true;
 
-    GLuint program = glCreateProgram ();
+    // Flushing makes sure the fence gets submitted, otherwise it could never signal
+    GLenum status = glClientWaitSync (*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    while (status == GL_TIMEOUT_EXPIRED)
+        status = glClientWaitSync (*fence, 0, 1000000000);
 
-    glAttachShader (program, vs);
-    glAttachShader (program, fs);
-    glLinkProgram (program);
+    glDeleteSync (*fence);
+    *fence = null;
 
-    if (!CheckShaderProgram (program, "Could not link shader program"))
+    if (status == GL_WAIT_FAILED)
     {
-        glDeleteProgram (program);
+        LogError ("Could not wait for a GPU fence");
+        return false;
+    }
 
-        return 0;
+    return true;
+}
+
+// Returns the persistent mapping, or null if the buffer is a mutable one of mutable_size bytes instead
+static u8 *CreateStreamingBuffer (GLuint *buffer, GLenum target, s64 persistent_size, s64 mutable_size)
+{
+    glGenBuffers (1, buffer);
+    glBindBuffer (target, *buffer);
+
+    if (g_glBufferStorage)
+    {
+        // Coherent, writes are visible to the GPU without flushing the mapped range
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        g_glBufferStorage (target, persistent_size, null, flags);
+        u8 *mapped = (u8 *)glMapBufferRange (target, 0, persistent_size, flags);
+        if (mapped)
+            return mapped;
+
+        // Immutable storage cannot be respecified, start over with a mutable buffer
+        glDeleteBuffers (1, buffer);
+        glGenBuffers (1, buffer);
+        glBindBuffer (target, *buffer);
     }
 
-    return program;
+    glBufferData (target, mutable_size, null, GL_STREAM_DRAW);
+
+    return null;
 }
 
-bool GfxInitBackend ()
+static void CreateDynamicBuffer (GLDynamicBuffer *dynamic, GLenum target, s64 region_size)
 {
-    glfwInit ();
+    dynamic->target = target;
+    dynamic->region_size = region_size;
+    dynamic->mapped = CreateStreamingBuffer (&dynamic->buffer, target, region_size * GL_Frames_In_Flight, region_size);
 
-    glfwSetErrorCallback (GLFWErrorCallback);
+    if (target == GL_ARRAY_BUFFER)
+        g_state.array_buffer = dynamic->buffer;
+    else if (target == GL_UNIFORM_BUFFER)
+        g_state.uniform_buffer = dynamic->buffer;
 
-    glfwWindowHint (GLFW_CLIENT_API, GLFW_OPENGL_API);
-    glfwWindowHint (GLFW_SAMPLES, 4);
-    glfwWindowHint (GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint (GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint (GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
-    glfwWindowHint (GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (g_glBufferStorage && !dynamic->mapped)
+        LogWarning ("Could not persistently map a per-frame buffer, it will be orphaned every frame");
+}
 
-    char window_title[100];
-    snprintf (window_title, sizeof (window_title), "Scop (%s)", SCOP_BACKEND_NAME);
+static void DestroyDynamicBuffer (GLDynamicBuffer *dynamic)
+{
+    // Deleting bound or mapped buffers unbinds and unmaps them
+    if (g_state.array_buffer == dynamic->buffer)
+        g_state.array_buffer = 0;
+    if (g_state.uniform_buffer == dynamic->buffer)
+        g_state.uniform_buffer = 0;
+
+    glDeleteBuffers (1, &dynamic->buffer);
+    memset (dynamic, 0, sizeof (*dynamic));
+}
 
-    g_main_window = glfwCreateWindow (SCOP_WINDOW_WIDTH, SCOP_WINDOW_HEIGHT, window_title, null, null);
-    if (!g_main_window)
+// Copy this frame's data to the current region of the buffer and return its offset
+static s64 WriteDynamicBuffer (GLDynamicBuffer *dynamic, const void *data, s64 size)
+{
+    if (!dynamic->mapped)
     {
-        LogError ("Could not create GLFW window");
-        return false;
-    }
+        // Respecifying the whole buffer lets the driver hand out new storage instead of
+        // waiting for the previous frame to be done with it
+        GLStateBindBuffer (dynamic->target, dynamic->buffer);
+        glBufferData (dynamic->target, size, data, GL_STREAM_DRAW);
 
-    glfwMakeContextCurrent (g_main_window);
+        return 0;
+    }
 
-    int ok = gladLoadGLLoader ((GLADloadproc) glfwGetProcAddress);
-    if (!ok)
+    if (size > dynamic->region_size)
     {
-        LogError ("Failed to initialize OpenGL context");
-        return false;
-    }
+        // Every region moves, none of them can be in use
+        for (int i = 0; i < GL_Frames_In_Flight; i += 1)
+            WaitForFence (&g_frame_fences[i]);
 
-    LogMessage ("OpenGL verson: %d.%d", GLVersion.major, GLVersion.minor);
+        s64 region_size = dynamic->region_size;
+        while (region_size < size)
+            region_size *= 2;
 
-    g_shader = CreateShaderProgram ("Shaders/Mesh_VS.glsl", "Shaders/Mesh_FS.glsl");
-    if (!g_shader)
-        return false;
+        GLenum target = dynamic->target;
+        DestroyDynamicBuffer (dynamic);
+        CreateDynamicBuffer (dynamic, target, region_size);
+
+        if (!dynamic->mapped)
+            return WriteDynamicBuffer (dynamic, data, size);
+    }
 
-    glfwSwapInterval (1);
+    s64 offset = dynamic->region_size * (g_stats.frame_count % GL_Frames_In_Flight);
+    memcpy (dynamic->mapped + offset, data, size);
 
-    return true;
+    return offset;
 }
 
-void GfxTerminateBackend ()
+// Binaries are only valid for the driver that produced them, which is part of the key
+static u64 GetProgramCacheKey (const String &vs_source, const String &fs_source, const char *defines)
 {
-    glfwDestroyWindow (g_main_window);
-    g_main_window = null;
+    const char *driver_strings[] = {
+        (const char *)glGetString (GL_VENDOR),
+        (const char *)glGetString (GL_RENDERER),
+        (const char *)glGetString (GL_VERSION),
+    };
+
+    u64 key = HashBytes (vs_source.data, vs_source.length);
+    key = HashBytes (fs_source.data, fs_source.length, key);
+    key = HashBytes (defines, strlen (defines), key);
+    for (int i = 0; i < (int)StaticArraySize (driver_strings); i += 1)
+    {
+        if (driver_strings[i])
+            key = HashBytes (driver_strings[i], strlen (driver_strings[i]) + 1, key);
+    }
 
-    glfwTerminate ();
+    return key;
 }
 
-void GfxCreateMeshObjects (Mesh *mesh)
+static void GetProgramCacheFilename (u64 key, char *result, s64 size)
 {
-    glGenVertexArrays (1, &mesh->gfx_objects.vao);
-    glGenBuffers (2, mesh->gfx_objects.buffers);
+    snprintf (result, size, GL_Program_Cache_Dir "/program_%016llx.bin", (unsigned long long)key);
+}
 
-    glBindVertexArray (mesh->gfx_objects.vao);
+// Returns 0 if there is no usable cached binary, including when the driver rejects it
+static GLuint LoadCachedProgram (u64 key)
+{
+    if (!g_glProgramBinary)
+        return 0;
 
-    glBindBuffer (GL_ARRAY_BUFFER, mesh->gfx_objects.vbo);
-    glBufferData (GL_ARRAY_BUFFER, sizeof (Vertex) * mesh->vertex_count, mesh->vertices, GL_STATIC_DRAW);
+    char filename[256];
+    GetProgramCacheFilename (key, filename, sizeof (filename));
 
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, mesh->gfx_objects.ibo);
-    glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (u32) * mesh->index_count, mesh->indices, GL_STATIC_DRAW);
+    auto read_res = ReadEntireFile (filename);
+    if (!read_res.ok)
+        return 0;
 
-    glEnableVertexAttribArray (GL_Attrib_Position);
-    glVertexAttribPointer (GL_Attrib_Position, 3, GL_FLOAT, GL_FALSE, sizeof (Vertex), (void *)offsetof (Vertex, position));
+    String contents = read_res.value;
+    defer (free (contents.data));
 
-    glEnableVertexAttribArray (GL_Attrib_Normal);
-    glVertexAttribPointer (GL_Attrib_Normal, 3, GL_FLOAT, GL_FALSE, sizeof (Vertex), (void *)offsetof (Vertex, normal));
+    GLProgramCacheHeader header;
+    if (contents.length < (s64)sizeof (header))
+        return 0;
 
-    glEnableVertexAttribArray (GL_Attrib_Tex_Coords);
-    glVertexAttribPointer (GL_Attrib_Tex_Coords, 2, GL_FLOAT, GL_FALSE, sizeof (Vertex), (void *)offsetof (Vertex, tex_coords));
+    memcpy (&header, contents.data, sizeof (header));
+    if (header.magic != GL_Program_Cache_Magic || header.version != GL_Program_Cache_Version
+    || header.key != key || header.binary_size != contents.length - sizeof (header))
+    {
+        LogWarning ("Ignoring invalid program cache file '%s'", filename);
+        return 0;
+    }
 
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer (GL_ARRAY_BUFFER, 0);
-    glBindVertexArray (0);
-}
+    GLuint program = glCreateProgram ();
+    g_glProgramBinary (program, header.binary_format, contents.data + sizeof (header), header.binary_size);
 
-void GfxDestroyMeshObjects (Mesh *mesh)
-{
-    glDeleteBuffers (2, mesh->gfx_objects.buffers);
-    glDeleteVertexArrays (1, &mesh->gfx_objects.vao);
+    // Drivers reject binaries after an update, among other reasons
+    GLint status = 0;
+    glGetProgramiv (program, GL_LINK_STATUS, &status);
+    if (!status)
+    {
+        LogMessage ("Cached program binary '%s' was rejected by the driver, compiling from source", filename);
+        glDeleteProgram (program);
 
-    mesh->gfx_objects.vao = 0;
-    mesh->gfx_objects.vbo = 0;
-    mesh->gfx_objects.ibo = 0;
+        return 0;
+    }
+
+    return program;
 }
 
-GfxTexture GfxCreateTexture (void *data, u32 width, u32 height)
+static void SaveCachedProgram (GLuint program, u64 key)
 {
-    GLuint tex;
-    glGenTextures (1, &tex);
-    glBindTexture (GL_TEXTURE_2D, tex);
-    glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    if (!g_glGetProgramBinary)
+        return;
 
-    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    GLint length = 0;
+    glGetProgramiv (program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
 
-    glBindTexture (GL_TEXTURE_2D, 0);
+    u8 *contents = (u8 *)malloc (sizeof (GLProgramCacheHeader) + length);
+    Assert (contents != null);
+    defer (free (contents));
 
-    return tex;
+    GLProgramCacheHeader header;
+    header.magic = GL_Program_Cache_Magic;
+    header.version = GL_Program_Cache_Version;
+    header.key = key;
+
+    GLenum binary_format = 0;
+    GLsizei binary_size = 0;
+    g_glGetProgramBinary (program, length, &binary_size, &binary_format, contents + sizeof (header));
+
+    header.binary_format = binary_format;
+    header.binary_size = binary_size;
+    memcpy (contents, &header, sizeof (header));
+
+    char filename[256];
+    GetProgramCacheFilename (key, filename, sizeof (filename));
+
+    if (!MakeDirectory (GL_Program_Cache_Dir) || !WriteEntireFile (filename, contents, sizeof (header) + binary_size))
+        LogWarning ("Could not write program cache file '%s'", filename);
 }
 
-void GfxDestroyTexture (GfxTexture *texture)
+// The defines go right after the #version line, which has to come first
+static void SetShaderSourceWithDefines (GLuint shader, const String &source, const char *defines)
 {
-    glDeleteTextures (1, texture);
-    *texture = 0;
+    const char *version_end = strchr (source.data, '\n');
+    GLint version_length = version_end ? (GLint)(version_end - source.data + 1) : 0;
+
+    const char *strings[3] = {source.data, defines, source.data + version_length};
+    GLint lengths[3] = {version_length, -1, (GLint)(source.length - version_length)};
+
+    glShaderSource (shader, 3, strings, lengths);
 }
 
-void GfxRenderFrame (const RenderFrameParams &params)
+static GLuint CompileShaderProgram (const String &vs_source, const String &fs_source, const char *defines)
 {
-    int viewport_width, viewport_height;
-    glfwGetFramebufferSize (g_main_window, &viewport_width, &viewport_height);
+    GLuint vs = glCreateShader (GL_VERTEX_SHADER);
+    defer (glDeleteShader (vs));
 
-    glViewport (0, 0, viewport_width, viewport_height);
-    glClearColor (0.1, 0.1, 0.1, 1);
-    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    SetShaderSourceWithDefines (vs, vs_source, defines);
+    glCompileShader (vs);
+
+    if (!CheckShader (vs, "Could not compile vertex shader"))
+        return 0;
+
+    GLuint fs = glCreateShader (GL_FRAGMENT_SHADER);
+    defer (glDeleteShader (fs));
+
+    SetShaderSourceWithDefines (fs, fs_source, defines);
+    glCompileShader (fs);
+
+    if (!CheckShader (fs, "Could not compile fragment shader"))
+        return 0;
+
+    GLuint program = glCreateProgram ();
+
+    if (g_glProgramParameteri)
+        g_glProgramParameteri (program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    glAttachShader (program, vs);
+    glAttachShader (program, fs);
+    glLinkProgram (program);
 
-    glEnable (GL_DEPTH_TEST);
-    glDepthFunc (GL_LESS);
+    if (!CheckShaderProgram (program, "Could not link shader program"))
+    {
+        glDeleteProgram (program);
+
+        return 0;
+    }
+
+    return program;
+}
+
+static bool LoadShaderSources (const char *vs_filename, const char *fs_filename)
+{
+    auto vs_read_res = ReadEntireFile (vs_filename);
+    if (!vs_read_res.ok)
+    {
+        LogError ("Could not read file '%s'", vs_filename);
+        return false;
+    }
 
-    glUseProgram (g_shader);
-    glUniformMatrix4fv (
-        glGetUniformLocation (g_shader, "u_View_Projection_Matrix"),
-        1, GL_TRUE, &g_camera.view_projection_matrix.r0c0
-    );
+    g_vs_source = vs_read_res.value;
 
-    glUniformMatrix4fv (
-        glGetUniformLocation (g_shader, "u_Model_Matrix"),
-        1, GL_TRUE, &params.model_matrix.r0c0
-    );
+    auto fs_read_res = ReadEntireFile (fs_filename);
+    if (!fs_read_res.ok)
+    {
+        LogError ("Could not read file '%s'", fs_filename);
+        return false;
+    }
 
-    glUniform3f (
-        glGetUniformLocation (g_shader, "u_Light_Position"),
-        params.light_position.x, params.light_position.y, params.light_position.z
-    );
+    g_fs_source = fs_read_res.value;
 
-    glUniform3f (
-        glGetUniformLocation (g_shader, "u_Light_Color"),
-        params.light_color.x, params.light_color.y, params.light_color.z
-    );
+    return true;
+}
 
-    glUniform3f (
-        glGetUniformLocation (g_shader, "u_Model_Color"),
-        params.model_color.x, params.model_color.y, params.model_color.z
-    );
+static GLuint CreateShaderProgram (u32 features)
+{
+    char defines[512] = "";
+    for (int i = 0; i < GL_Shader_Feature_Count; i += 1)
+    {
+        if (features & (1 << i))
+            snprintf (defines + strlen (defines), sizeof (defines) - strlen (defines), "#define %s\n", GL_Shader_Feature_Defines[i]);
+    }
 
-    glUniform1f (glGetUniformLocation (g_shader, "u_Texture_Alpha"), params.texture_alpha);
+    // Keep the line numbers of compile errors matching the files
+    snprintf (defines + strlen (defines), sizeof (defines) - strlen (defines), "#line 2\n");
 
-    glBindTexture (GL_TEXTURE_2D, params.texture);
+    u64 cache_key = GetProgramCacheKey (g_vs_source, g_fs_source, defines);
 
-    glBindVertexArray (params.mesh->gfx_objects.vao);
-    glBindBuffer (GL_ARRAY_BUFFER, params.mesh->gfx_objects.vbo);
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, params.mesh->gfx_objects.ibo);
+    f64 start_time = GetTimeInSeconds ();
 
-    glDrawElements (GL_TRIANGLES, params.mesh->index_count, GL_UNSIGNED_INT, null);
+    GLuint program = LoadCachedProgram (cache_key);
+    if (!program)
+    {
+        program = CompileShaderProgram (g_vs_source, g_fs_source, defines);
+        if (!program)
+            return 0;
 
-    glBindTexture (GL_TEXTURE_2D, 0);
+        SaveCachedProgram (program, cache_key);
 
-    glBindBuffer (GL_ARRAY_BUFFER, 0);
-    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindVertexArray (0);
+        LogMessage ("Compiled shader variant %u in %.3f ms", features, (GetTimeInSeconds () - start_time) * 1000);
+    }
+    else
+    {
+        LogMessage ("Loaded shader variant %u from the program binary cache in %.3f ms", features, (GetTimeInSeconds () - start_time) * 1000);
+    }
 
-    glfwSwapBuffers (g_main_window);
+    // Resolve the block and sampler locations once, nothing is looked up by name when drawing.
+    // A program loaded from a binary starts with default uniform state, so this is done either way
+    GLuint draw_uniforms_index = glGetUniformBlockIndex (program, "Draw_Uniforms");
+    if (draw_uniforms_index != GL_INVALID_INDEX)
+        glUniformBlockBinding (program, draw_uniforms_index, GL_Block_Draw_Uniforms);
+
+    GLint texture_location = glGetUniformLocation (program, "u_Texture");
+    if (texture_location >= 0)
+    {
+        GLStateUseProgram (program);
+        glUniform1i (texture_location, 0);
+    }
+
+    return program;
+}
+
+// Falls back to the variant compiled at startup if another one fails to compile
+static GLuint GetShaderVariant (u32 features)
+{
+    if (!g_shader_variants[features] && !g_shader_variant_failed[features])
+    {
+        g_shader_variants[features] = CreateShaderProgram (features);
+        g_shader_variant_failed[features] = g_shader_variants[features] == 0;
+    }
+
+    if (g_shader_variant_failed[features])
+        return g_shader_variants[GL_Shader_Fallback_Features];
+
+    return g_shader_variants[features];
+}
+
+// Dynamic resolution stretches frames into the window with a blit, which cannot write to
+// a multisampled framebuffer. The frames are multisampled before being stretched instead
+static void SetWindowHints (bool offscreen)
+{
+    glfwWindowHint (GLFW_CLIENT_API, GLFW_OPENGL_API);
+    glfwWindowHint (GLFW_SAMPLES, offscreen || g_dynamic_resolution ? 0 : 4);
+    glfwWindowHint (GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint (GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint (GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+    glfwWindowHint (GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint (GLFW_VISIBLE, offscreen ? GLFW_FALSE : GLFW_TRUE);
+}
+
+static bool CreateRenderTarget (GLOffscreenTarget *target, int width, int height)
+{
+    target->width = width;
+    target->height = height;
+
+    glGenRenderbuffers (1, &target->color_renderbuffer);
+    glBindRenderbuffer (GL_RENDERBUFFER, target->color_renderbuffer);
+    glRenderbufferStorageMultisample (GL_RENDERBUFFER, GL_Offscreen_Samples, GL_RGBA8, width, height);
+
+    glGenRenderbuffers (1, &target->depth_renderbuffer);
+    glBindRenderbuffer (GL_RENDERBUFFER, target->depth_renderbuffer);
+    glRenderbufferStorageMultisample (GL_RENDERBUFFER, GL_Offscreen_Samples, GL_DEPTH_COMPONENT24, width, height);
+
+    glGenRenderbuffers (1, &target->resolve_renderbuffer);
+    glBindRenderbuffer (GL_RENDERBUFFER, target->resolve_renderbuffer);
+    glRenderbufferStorage (GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glBindRenderbuffer (GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers (1, &target->resolve_framebuffer);
+    glBindFramebuffer (GL_FRAMEBUFFER, target->resolve_framebuffer);
+    glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->resolve_renderbuffer);
+
+    if (glCheckFramebufferStatus (GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        LogError ("Offscreen resolve framebuffer is incomplete");
+        return false;
+    }
+
+    glGenFramebuffers (1, &target->framebuffer);
+    glBindFramebuffer (GL_FRAMEBUFFER, target->framebuffer);
+    glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->color_renderbuffer);
+    glFramebufferRenderbuffer (GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target->depth_renderbuffer);
+
+    if (glCheckFramebufferStatus (GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        LogError ("Offscreen framebuffer is incomplete");
+        return false;
+    }
+
+    return true;
+}
+
+static void DestroyRenderTarget (GLOffscreenTarget *target)
+{
+    glDeleteFramebuffers (1, &target->framebuffer);
+    glDeleteFramebuffers (1, &target->resolve_framebuffer);
+    glDeleteRenderbuffers (1, &target->color_renderbuffer);
+    glDeleteRenderbuffers (1, &target->depth_renderbuffer);
+    glDeleteRenderbuffers (1, &target->resolve_renderbuffer);
+    memset (target, 0, sizeof (GLOffscreenTarget));
+}
+
+static bool CreateOffscreenTarget (int width, int height)
+{
+    GLOffscreenTarget *target = &g_offscreen_target;
+
+    // The framebuffer stays bound for the lifetime of the context, everything is drawn into it
+    if (!CreateRenderTarget (target, width, height))
+        return false;
+
+    for (int i = 0; i < GL_Readback_Ring_Size; i += 1)
+    {
+        glGenBuffers (1, &g_readbacks[i].pixel_buffer);
+        glBindBuffer (GL_PIXEL_PACK_BUFFER, g_readbacks[i].pixel_buffer);
+        glBufferData (GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, null, GL_STREAM_READ);
+    }
+
+    glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+
+    return true;
+}
+
+static void DestroyOffscreenTarget ()
+{
+    glBindFramebuffer (GL_FRAMEBUFFER, 0);
+    DestroyRenderTarget (&g_offscreen_target);
+
+    for (int i = 0; i < GL_Readback_Ring_Size; i += 1)
+    {
+        glDeleteBuffers (1, &g_readbacks[i].pixel_buffer);
+        g_readbacks[i].pixel_buffer = 0;
+    }
+}
+
+bool GfxInitBackend (int offscreen_width, int offscreen_height, const GfxDynamicResolution *dynamic_resolution)
+{
+    g_offscreen = offscreen_width > 0 && offscreen_height > 0;
+
+    g_dynamic_resolution = dynamic_resolution != null;
+    if (dynamic_resolution)
+    {
+        g_dynamic_resolution_settings = *dynamic_resolution;
+        g_resolution_scale = dynamic_resolution->max_scale;
+    }
+
+    glfwSetErrorCallback (GLFWErrorCallback);
+
+    char window_title[100];
+    snprintf (window_title, sizeof (window_title), "Scop (%s)", SCOP_BACKEND_NAME);
+
+    // The window of an offscreen context is never shown, its size does not matter
+    int window_width = g_offscreen ? offscreen_width : SCOP_WINDOW_WIDTH;
+    int window_height = g_offscreen ? offscreen_height : SCOP_WINDOW_HEIGHT;
+
+    if (glfwInit ())
+    {
+        SetWindowHints (g_offscreen);
+        g_main_window = glfwCreateWindow (window_width, window_height, window_title, null, null);
+    }
+
+    // Render nodes usually have no display server, and often no GPU. GLFW's null platform
+    // needs neither, and gets its context from OSMesa which renders on the CPU with llvmpipe
+    if (!g_main_window && g_offscreen)
+    {
+        LogMessage ("No window system available, falling back to an OSMesa context");
+
+        glfwTerminate ();
+        glfwInitHint (GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
+        if (glfwInit ())
+        {
+            SetWindowHints (true);
+            glfwWindowHint (GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+            glfwWindowHint (GLFW_OPENGL_DEBUG_CONTEXT, GLFW_FALSE);
+
+            g_main_window = glfwCreateWindow (window_width, window_height, window_title, null, null);
+        }
+    }
+
+    if (!g_main_window)
+    {
+        LogError ("Could not create GLFW window");
+        return false;
+    }
+
+    glfwMakeContextCurrent (g_main_window);
+
+    int ok = gladLoadGLLoader ((GLADloadproc) glfwGetProcAddress);
+    if (!ok)
+    {
+        LogError ("Failed to initialize OpenGL context");
+        return false;
+    }
+
+    LogMessage ("OpenGL verson: %d.%d", GLVersion.major, GLVersion.minor);
+
+    if (g_offscreen)
+    {
+        LogMessage ("Rendering offscreen at %d by %d on %s", offscreen_width, offscreen_height, glGetString (GL_RENDERER));
+
+        if (!CreateOffscreenTarget (offscreen_width, offscreen_height))
+            return false;
+    }
+
+    if (g_dynamic_resolution)
+    {
+        LogMessage ("Dynamic resolution between %.2f and %.2f of the framebuffer, targeting %.2f ms of GPU time per frame",
+            g_dynamic_resolution_settings.min_scale, g_dynamic_resolution_settings.max_scale,
+            g_dynamic_resolution_settings.target_frame_time * 1000);
+    }
+
+    ResetStateCache ();
+
+    LoadProgramBinaryFunctions ();
+
+    if (!LoadShaderSources ("Shaders/Mesh_VS.glsl", "Shaders/Mesh_FS.glsl"))
+        return false;
+
+    // The other variants are compiled when first drawn with, this one is the fallback
+    if (!GetShaderVariant (GL_Shader_Fallback_Features))
+        return false;
+
+    LoadBufferStorageFunction ();
+
+    // Uniform blocks are bound at offsets that are a multiple of the alignment
+    GLint uniform_alignment = 0;
+    glGetIntegerv (GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+    uniform_alignment = Max (uniform_alignment, 1);
+
+    s64 uniforms_region_size = (sizeof (GLDrawUniforms) + uniform_alignment - 1) / uniform_alignment * uniform_alignment;
+    CreateDynamicBuffer (&g_draw_uniforms_buffer, GL_UNIFORM_BUFFER, uniforms_region_size);
+
+    // Every vertex array object reads its instance attributes from this buffer
+    CreateDynamicBuffer (&g_instance_buffer, GL_ARRAY_BUFFER, sizeof (GLInstance) * GL_Instance_Region_Initial_Count);
+
+    for (int i = 0; i < GL_Timer_Frame_Latency; i += 1)
+    {
+        glGenQueries (GL_Timer_Pass_Count, g_timer_frames[i].queries);
+        g_timer_frames[i].pending = false;
+    }
+
+    // Offscreen frames are never presented, there is nothing to wait for
+    glfwSwapInterval (g_offscreen ? 0 : 1);
+
+    return true;
+}
+
+void GfxTerminateBackend ()
+{
+    if (g_offscreen)
+    {
+        GfxFlushReadbacks ();
+        DestroyOffscreenTarget ();
+    }
+
+    DestroyRenderTarget (&g_scaled_target);
+    g_scaled_target_framebuffer_width = 0;
+    g_scaled_target_framebuffer_height = 0;
+    g_dynamic_resolution = false;
+
+    for (int i = 0; i < GL_Timer_Frame_Latency; i += 1)
+        glDeleteQueries (GL_Timer_Pass_Count, g_timer_frames[i].queries);
+
+    for (int i = 0; i < GL_Stream_Segment_Count; i += 1)
+    {
+        if (g_stream_ring.fences[i])
+            glDeleteSync (g_stream_ring.fences[i]);
+    }
+
+    glDeleteBuffers (1, &g_stream_ring.buffer);
+    g_stream_ring = {};
+
+    for (int i = 0; i < GL_Frames_In_Flight; i += 1)
+    {
+        if (g_frame_fences[i])
+            glDeleteSync (g_frame_fences[i]);
+        g_frame_fences[i] = null;
+    }
+
+    DestroyDynamicBuffer (&g_instance_buffer);
+    ArrayFree (&g_instances);
+
+    ArrayFree (&g_multi_draw_counts);
+    ArrayFree (&g_multi_draw_offsets);
+    ArrayFree (&g_multi_draw_base_vertices);
+
+    DestroyDynamicBuffer (&g_draw_uniforms_buffer);
+    g_glBufferStorage = null;
+
+    for (int i = 0; i < GL_Shader_Variant_Count; i += 1)
+    {
+        glDeleteProgram (g_shader_variants[i]);
+        g_shader_variants[i] = 0;
+        g_shader_variant_failed[i] = false;
+    }
+
+    free (g_vs_source.data);
+    free (g_fs_source.data);
+    g_vs_source = String{};
+    g_fs_source = String{};
+
+    glfwDestroyWindow (g_main_window);
+    g_main_window = null;
+
+    glfwTerminate ();
+}
+
+void GfxAcquireContext ()
+{
+    glfwMakeContextCurrent (g_main_window);
+}
+
+void GfxReleaseContext ()
+{
+    glfwMakeContextCurrent (null);
+}
+
+void GfxGetFramebufferSize (int *width, int *height)
+{
+    if (g_offscreen)
+    {
+        *width = g_offscreen_target.width;
+        *height = g_offscreen_target.height;
+    }
+    else
+    {
+        glfwGetFramebufferSize (g_main_window, width, height);
+    }
+}
+
+const GfxStats &GfxGetStats ()
+{
+    return g_stats;
+}
+
+bool GfxGetPassTimings (GfxPassTimings *timings)
+{
+    if (!g_has_new_pass_timings)
+        return false;
+
+    *timings = g_pass_timings;
+    g_has_new_pass_timings = false;
+
+    return true;
+}
+
+// GPU time grows with the number of pixels, that is with the square of the scale
+static void UpdateResolutionScale (f64 gpu_time, float measured_scale)
+{
+    if (gpu_time <= 0)
+        return;
+
+    const GfxDynamicResolution &settings = g_dynamic_resolution_settings;
+
+    float ideal_scale = measured_scale * sqrtf ((float)(settings.target_frame_time / gpu_time));
+    float scale = g_resolution_scale + (ideal_scale - g_resolution_scale) * GL_Resolution_Scale_Rate;
+    scale = Clamp (scale, settings.min_scale, settings.max_scale);
+
+    if (Abs (scale - g_resolution_scale) >= GL_Resolution_Scale_Step
+    || scale == settings.min_scale || scale == settings.max_scale)
+        g_resolution_scale = scale;
+}
+
+// Returns false if the queries of the frame that last used this slot are still in flight,
+// in which case the current frame is not timed rather than waiting for them
+static bool BeginTimerFrame (GLTimerFrame *frame)
+{
+    if (frame->pending)
+    {
+        // Queries complete in order, if the last one is available all of them are
+        GLint available = 0;
+        glGetQueryObjectiv (frame->queries[GL_Timer_Pass_Count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            return false;
+
+        g_pass_timings.frame_index = frame->frame_index;
+        g_pass_timings.pass_count = GL_Timer_Pass_Count;
+        for (int i = 0; i < GL_Timer_Pass_Count; i += 1)
+        {
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v (frame->queries[i], GL_QUERY_RESULT, &nanoseconds);
+
+            g_pass_timings.pass_names[i] = GL_Timer_Pass_Names[i];
+            g_pass_timings.pass_times[i] = nanoseconds / 1000000000.0;
+        }
+
+        g_has_new_pass_timings = true;
+        frame->pending = false;
+
+        if (g_dynamic_resolution)
+        {
+            f64 gpu_time = 0;
+            for (int i = 0; i < GL_Timer_Pass_Count; i += 1)
+                gpu_time += g_pass_timings.pass_times[i];
+
+            UpdateResolutionScale (gpu_time, frame->resolution_scale);
+        }
+    }
+
+    frame->frame_index = g_stats.frame_count;
+    frame->resolution_scale = g_resolution_scale;
+    frame->pending = true;
+
+    return true;
+}
+
+// Point the instance attributes of the bound vertex array object to the instance buffer.
+// With buffer storage the offset and even the buffer change, this is called before each draw
+static void SetupInstanceAttributes (s64 offset)
+{
+    GLStateBindBuffer (GL_ARRAY_BUFFER, g_instance_buffer.buffer);
+
+    for (int i = 0; i < 4; i += 1)
+    {
+        GLuint index = GL_Attrib_Instance_Model_Matrix + i;
+        glEnableVertexAttribArray (index);
+        glVertexAttribPointer (index, 4, GL_FLOAT, GL_FALSE, sizeof (GLInstance), (void *)(offset + offsetof (GLInstance, model_matrix) + sizeof (float) * 4 * i));
+        glVertexAttribDivisor (index, 1);
+    }
+
+    for (int i = 0; i < 3; i += 1)
+    {
+        GLuint index = GL_Attrib_Instance_Normal_Matrix + i;
+        glEnableVertexAttribArray (index);
+        glVertexAttribPointer (index, 3, GL_FLOAT, GL_FALSE, sizeof (GLInstance), (void *)(offset + offsetof (GLInstance, normal_matrix_rows) + sizeof (Vec3f) * i));
+        glVertexAttribDivisor (index, 1);
+    }
+
+    glEnableVertexAttribArray (GL_Attrib_Instance_Color);
+    glVertexAttribPointer (GL_Attrib_Instance_Color, 3, GL_FLOAT, GL_FALSE, sizeof (GLInstance), (void *)(offset + offsetof (GLInstance, color)));
+    glVertexAttribDivisor (GL_Attrib_Instance_Color, 1);
+}
+
+// Point the attributes of the bound vertex array object to a vertex buffer and to the instance buffer
+static void SetupVertexAttributes (GLuint vbo)
+{
+    GLStateBindBuffer (GL_ARRAY_BUFFER, vbo);
+
+    glEnableVertexAttribArray (GL_Attrib_Position);
+    glVertexAttribPointer (GL_Attrib_Position, 3, GL_FLOAT, GL_FALSE, sizeof (Vertex), (void *)offsetof (Vertex, position));
+
+    glEnableVertexAttribArray (GL_Attrib_Normal);
+    glVertexAttribPointer (GL_Attrib_Normal, 3, GL_FLOAT, GL_FALSE, sizeof (Vertex), (void *)offsetof (Vertex, normal));
+
+    glEnableVertexAttribArray (GL_Attrib_Tex_Coords);
+    glVertexAttribPointer (GL_Attrib_Tex_Coords, 2, GL_FLOAT, GL_FALSE, sizeof (Vertex), (void *)offsetof (Vertex, tex_coords));
+
+    SetupInstanceAttributes (0);
+}
+
+void GfxCreateMeshObjects (Mesh *mesh)
+{
+    glGenVertexArrays (1, &mesh->gfx_objects.vao);
+    glGenBuffers (2, mesh->gfx_objects.buffers);
+
+    GLStateBindVertexArray (mesh->gfx_objects.vao);
+
+    GLStateBindBuffer (GL_ARRAY_BUFFER, mesh->gfx_objects.vbo);
+    glBufferData (GL_ARRAY_BUFFER, sizeof (Vertex) * mesh->vertex_count, mesh->vertices, GL_STATIC_DRAW);
+
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, mesh->gfx_objects.ibo);
+    glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (u32) * mesh->index_count, mesh->indices, GL_STATIC_DRAW);
+
+    SetupVertexAttributes (mesh->gfx_objects.vbo);
+
+    // The index buffer stays bound, it is recorded in the vertex array object.
+    // Unbinding the vertex array object first means later buffer binds cannot modify it
+    GLStateBindVertexArray (0);
+
+    mesh->gfx_objects.uploaded_size = sizeof (Vertex) * mesh->vertex_count + sizeof (u32) * mesh->index_count;
+    mesh->gfx_objects.drawable_index_count = mesh->index_count;
+
+    g_stats.mesh_objects_created += 1;
+    g_stats.bytes_uploaded += sizeof (Vertex) * mesh->vertex_count + sizeof (u32) * mesh->index_count;
+}
+
+void GfxCreateMeshObjectsStreamed (Mesh *mesh)
+{
+    glGenVertexArrays (1, &mesh->gfx_objects.vao);
+    glGenBuffers (2, mesh->gfx_objects.buffers);
+
+    GLStateBindVertexArray (mesh->gfx_objects.vao);
+
+    GLStateBindBuffer (GL_ARRAY_BUFFER, mesh->gfx_objects.vbo);
+    glBufferData (GL_ARRAY_BUFFER, sizeof (Vertex) * mesh->vertex_count, null, GL_STATIC_DRAW);
+
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, mesh->gfx_objects.ibo);
+    glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (u32) * mesh->index_count, null, GL_STATIC_DRAW);
+
+    SetupVertexAttributes (mesh->gfx_objects.vbo);
+
+    GLStateBindVertexArray (0);
+
+    mesh->gfx_objects.uploaded_size = 0;
+    mesh->gfx_objects.drawable_index_count = 0;
+
+    if (!g_stream_ring.buffer)
+    {
+        s64 ring_size = (s64)GL_Stream_Segment_Size * GL_Stream_Segment_Count;
+
+        g_stream_ring.mapped = CreateStreamingBuffer (&g_stream_ring.buffer, GL_COPY_READ_BUFFER, ring_size, ring_size);
+    }
+
+    g_stats.mesh_objects_created += 1;
+}
+
+// When the streaming ring cannot be mapped, everything left is uploaded at once instead
+static void UploadRemainingMeshData (Mesh *mesh)
+{
+    GfxMeshObjects *objects = &mesh->gfx_objects;
+
+    s64 vertices_size = sizeof (Vertex) * mesh->vertex_count;
+    s64 total_size = vertices_size + sizeof (u32) * mesh->index_count;
+
+    s64 offset = objects->uploaded_size;
+    if (offset < vertices_size)
+    {
+        glBindBuffer (GL_COPY_WRITE_BUFFER, objects->vbo);
+        glBufferSubData (GL_COPY_WRITE_BUFFER, offset, vertices_size - offset, (const u8 *)mesh->vertices + offset);
+        offset = vertices_size;
+    }
+
+    s64 index_offset = offset - vertices_size;
+    glBindBuffer (GL_COPY_WRITE_BUFFER, objects->ibo);
+    glBufferSubData (GL_COPY_WRITE_BUFFER, index_offset, total_size - offset, (const u8 *)mesh->indices + index_offset);
+
+    g_stats.bytes_uploaded += total_size - objects->uploaded_size;
+    objects->uploaded_size = total_size;
+}
+
+bool GfxStreamMeshObjects (Mesh *mesh, f64 time_budget)
+{
+    GfxMeshObjects *objects = &mesh->gfx_objects;
+
+    s64 vertices_size = sizeof (Vertex) * mesh->vertex_count;
+    s64 total_size = vertices_size + sizeof (u32) * mesh->index_count;
+
+    glBindBuffer (GL_COPY_READ_BUFFER, g_stream_ring.buffer);
+
+    // At least one chunk per call, so that a budget that is too small still makes progress
+    f64 start_time = GetTimeInSeconds ();
+    int chunk_count = 0;
+    while (objects->uploaded_size < total_size)
+    {
+        if (chunk_count > 0 && GetTimeInSeconds () - start_time >= time_budget)
+            break;
+
+        // The segment is still being copied from, it will be free in a later frame
+        GLsync *fence = &g_stream_ring.fences[g_stream_ring.next_segment];
+        if (*fence)
+        {
+            if (glClientWaitSync (*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+                break;
+
+            glDeleteSync (*fence);
+            *fence = 0;
+        }
+
+        // A chunk does not straddle the end of the vertices, the two go to different buffers
+        s64 offset = objects->uploaded_size;
+        bool is_vertices = offset < vertices_size;
+        s64 size = Min ((is_vertices ? vertices_size : total_size) - offset, (s64)GL_Stream_Segment_Size);
+        s64 dst_offset = is_vertices ? offset : offset - vertices_size;
+        const u8 *src = is_vertices ? (const u8 *)mesh->vertices + offset : (const u8 *)mesh->indices + dst_offset;
+
+        s64 segment_offset = (s64)g_stream_ring.next_segment * GL_Stream_Segment_Size;
+        if (g_stream_ring.mapped)
+        {
+            memcpy (g_stream_ring.mapped + segment_offset, src, size);
+        }
+        else
+        {
+            // Unsynchronized, the fence already guarantees that the GPU is done with the segment
+            void *staging = glMapBufferRange (GL_COPY_READ_BUFFER, segment_offset, size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (!staging)
+            {
+                LogWarning ("Could not map the mesh streaming buffer, uploading the rest of the mesh at once");
+                UploadRemainingMeshData (mesh);
+                break;
+            }
+
+            memcpy (staging, src, size);
+            glUnmapBuffer (GL_COPY_READ_BUFFER);
+        }
+
+        glBindBuffer (GL_COPY_WRITE_BUFFER, is_vertices ? objects->vbo : objects->ibo);
+        glCopyBufferSubData (GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, segment_offset, dst_offset, size);
+
+        *fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        g_stream_ring.next_segment = (g_stream_ring.next_segment + 1) % GL_Stream_Segment_Count;
+
+        objects->uploaded_size += size;
+        chunk_count += 1;
+
+        g_stats.bytes_uploaded += size;
+    }
+
+    s64 uploaded_index_count = Max (objects->uploaded_size - vertices_size, (s64)0) / (s64)sizeof (u32);
+    objects->drawable_index_count = uploaded_index_count - uploaded_index_count % 3;
+
+    return objects->uploaded_size == total_size;
+}
+
+void GfxDestroyMeshObjects (Mesh *mesh)
+{
+    // Deleting bound objects unbinds them
+    if (g_state.vertex_array == mesh->gfx_objects.vao)
+        g_state.vertex_array = 0;
+    if (g_state.array_buffer == mesh->gfx_objects.vbo)
+        g_state.array_buffer = 0;
+
+    glDeleteBuffers (2, mesh->gfx_objects.buffers);
+    glDeleteVertexArrays (1, &mesh->gfx_objects.vao);
+
+    if (mesh->gfx_objects.vao)
+        g_stats.mesh_objects_destroyed += 1;
+
+    mesh->gfx_objects.vao = 0;
+    mesh->gfx_objects.vbo = 0;
+    mesh->gfx_objects.ibo = 0;
+}
+
+void GfxCreateScenePool (GfxScenePool *pool, s64 vertex_capacity, s64 index_capacity)
+{
+    glGenVertexArrays (1, &pool->vao);
+    glGenBuffers (1, &pool->vbo);
+    glGenBuffers (1, &pool->ibo);
+
+    GLStateBindVertexArray (pool->vao);
+
+    GLStateBindBuffer (GL_ARRAY_BUFFER, pool->vbo);
+    glBufferData (GL_ARRAY_BUFFER, sizeof (Vertex) * vertex_capacity, null, GL_STATIC_DRAW);
+
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, pool->ibo);
+    glBufferData (GL_ELEMENT_ARRAY_BUFFER, sizeof (u32) * index_capacity, null, GL_STATIC_DRAW);
+
+    SetupVertexAttributes (pool->vbo);
+
+    GLStateBindVertexArray (0);
+
+    g_stats.mesh_objects_created += 1;
+}
+
+void GfxDestroyScenePool (GfxScenePool *pool)
+{
+    if (g_state.vertex_array == pool->vao)
+        g_state.vertex_array = 0;
+    if (g_state.array_buffer == pool->vbo)
+        g_state.array_buffer = 0;
+
+    glDeleteBuffers (1, &pool->vbo);
+    glDeleteBuffers (1, &pool->ibo);
+    glDeleteVertexArrays (1, &pool->vao);
+
+    if (pool->vao)
+        g_stats.mesh_objects_destroyed += 1;
+
+    pool->vao = 0;
+    pool->vbo = 0;
+    pool->ibo = 0;
+}
+
+void GfxResizeScenePool (GfxScenePool *pool, s64 old_vertex_capacity, s64 old_index_capacity, s64 vertex_capacity, s64 index_capacity)
+{
+    GLuint buffers[2];
+    glGenBuffers (2, buffers);
+
+    // The copy targets are not part of the vertex array object or of the state cache,
+    // so the copies do not disturb anything
+    glBindBuffer (GL_COPY_READ_BUFFER, pool->vbo);
+    glBindBuffer (GL_COPY_WRITE_BUFFER, buffers[0]);
+    glBufferData (GL_COPY_WRITE_BUFFER, sizeof (Vertex) * vertex_capacity, null, GL_STATIC_DRAW);
+    glCopyBufferSubData (GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof (Vertex) * Min (old_vertex_capacity, vertex_capacity));
+
+    glBindBuffer (GL_COPY_READ_BUFFER, pool->ibo);
+    glBindBuffer (GL_COPY_WRITE_BUFFER, buffers[1]);
+    glBufferData (GL_COPY_WRITE_BUFFER, sizeof (u32) * index_capacity, null, GL_STATIC_DRAW);
+    glCopyBufferSubData (GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, sizeof (u32) * Min (old_index_capacity, index_capacity));
+
+    glBindBuffer (GL_COPY_READ_BUFFER, 0);
+    glBindBuffer (GL_COPY_WRITE_BUFFER, 0);
+
+    if (g_state.array_buffer == pool->vbo)
+        g_state.array_buffer = 0;
+
+    glDeleteBuffers (1, &pool->vbo);
+    glDeleteBuffers (1, &pool->ibo);
+    pool->vbo = buffers[0];
+    pool->ibo = buffers[1];
+
+    // Keep the vertex array object, the attributes only need to point to the new buffer
+    GLStateBindVertexArray (pool->vao);
+    glBindBuffer (GL_ELEMENT_ARRAY_BUFFER, pool->ibo);
+    SetupVertexAttributes (pool->vbo);
+    GLStateBindVertexArray (0);
+}
+
+void GfxUploadToScenePool (GfxScenePool *pool, s64 first_vertex, const Vertex *vertices, s64 vertex_count, s64 first_index, const u32 *indices, s64 index_count)
+{
+    GLStateBindBuffer (GL_ARRAY_BUFFER, pool->vbo);
+    glBufferSubData (GL_ARRAY_BUFFER, sizeof (Vertex) * first_vertex, sizeof (Vertex) * vertex_count, vertices);
+
+    // Binding GL_ELEMENT_ARRAY_BUFFER would modify the bound vertex array object
+    glBindBuffer (GL_COPY_WRITE_BUFFER, pool->ibo);
+    glBufferSubData (GL_COPY_WRITE_BUFFER, sizeof (u32) * first_index, sizeof (u32) * index_count, indices);
+    glBindBuffer (GL_COPY_WRITE_BUFFER, 0);
+
+    g_stats.bytes_uploaded += sizeof (Vertex) * vertex_count + sizeof (u32) * index_count;
+}
+
+bool GfxSupportsTextureFormat (TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat_RGBA8: return true;
+    case TextureFormat_BC1: return HasGLExtension ("GL_EXT_texture_compression_s3tc");
+    case TextureFormat_BC3: return HasGLExtension ("GL_EXT_texture_compression_s3tc");
+    case TextureFormat_BC4: return true; // RGTC is core in 3.0
+    case TextureFormat_BC5: return true;
+    case TextureFormat_BC7: return GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 2)
+        || HasGLExtension ("GL_ARB_texture_compression_bptc");
+    default: return false;
+    }
+}
+
+static GLenum GetCompressedInternalFormat (TextureFormat format)
+{
+    switch (format)
+    {
+    case TextureFormat_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TextureFormat_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case TextureFormat_BC4: return GL_COMPRESSED_RED_RGTC1;
+    case TextureFormat_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case TextureFormat_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: Panic ("Texture format %d is not block compressed", format);
+    }
+
+    return 0;
+}
+
+GfxTexture GfxCreateTexture (const TextureData &data)
+{
+    GLuint tex;
+    glGenTextures (1, &tex);
+    GLStateBindTexture2D (tex);
+
+    for (int i = 0; i < data.level_count; i += 1)
+    {
+        const TextureLevel &level = data.levels[i];
+        if (data.format == TextureFormat_RGBA8)
+            glTexImage2D (GL_TEXTURE_2D, i, GL_RGBA, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level.data);
+        else
+            glCompressedTexImage2D (GL_TEXTURE_2D, i, GetCompressedInternalFormat (data.format), level.width, level.height, 0, (GLsizei)level.size, level.data);
+
+        g_stats.bytes_uploaded += level.size;
+    }
+
+    // Gray formats only store the channels they use
+    if (data.format == TextureFormat_BC4)
+    {
+        GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    else if (data.format == TextureFormat_BC5)
+    {
+        GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_GREEN};
+        glTexParameteriv (GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // Trilinear filtering, over the levels that were supplied only
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, data.level_count - 1);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, data.level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    g_stats.textures_created += 1;
+
+    return tex;
+}
+
+void GfxDestroyTexture (GfxTexture *texture)
+{
+    if (*texture)
+        g_stats.textures_destroyed += 1;
+
+    if (*texture && g_state.texture_2d == *texture)
+        g_state.texture_2d = 0;
+
+    glDeleteTextures (1, texture);
+    *texture = 0;
+}
+
+// Frames are presented from the default framebuffer, or read back from the offscreen target
+static GLuint GetPresentFramebuffer ()
+{
+    return g_offscreen ? g_offscreen_target.framebuffer : 0;
+}
+
+static bool ResizeScaledTarget (int framebuffer_width, int framebuffer_height)
+{
+    if (g_scaled_target.framebuffer
+    && g_scaled_target_framebuffer_width == framebuffer_width && g_scaled_target_framebuffer_height == framebuffer_height)
+        return true;
+
+    DestroyRenderTarget (&g_scaled_target);
+
+    float max_scale = g_dynamic_resolution_settings.max_scale;
+    int width = Max ((int)ceilf (framebuffer_width * max_scale), 1);
+    int height = Max ((int)ceilf (framebuffer_height * max_scale), 1);
+
+    bool ok = CreateRenderTarget (&g_scaled_target, width, height);
+    glBindFramebuffer (GL_FRAMEBUFFER, GetPresentFramebuffer ());
+
+    if (!ok)
+    {
+        LogError ("Could not create the dynamic resolution target, rendering at full resolution");
+
+        DestroyRenderTarget (&g_scaled_target);
+        g_dynamic_resolution = false;
+
+        return false;
+    }
+
+    g_scaled_target_framebuffer_width = framebuffer_width;
+    g_scaled_target_framebuffer_height = framebuffer_height;
+
+    return true;
+}
+
+void GfxRenderFrame (const RenderFrameParams &params)
+{
+    int framebuffer_width = params.framebuffer_width;
+    int framebuffer_height = params.framebuffer_height;
+    int viewport_width = framebuffer_width;
+    int viewport_height = framebuffer_height;
+
+    GLTimerFrame *timer_frame = &g_timer_frames[g_stats.frame_count % GL_Timer_Frame_Latency];
+    bool timed = BeginTimerFrame (timer_frame);
+
+    // A minimized window has an empty framebuffer, there is nothing to scale
+    bool scaled = g_dynamic_resolution && framebuffer_width > 0 && framebuffer_height > 0
+        && ResizeScaledTarget (framebuffer_width, framebuffer_height);
+
+    if (scaled)
+    {
+        viewport_width = Clamp ((int)(framebuffer_width * g_resolution_scale + 0.5f), 1, g_scaled_target.width);
+        viewport_height = Clamp ((int)(framebuffer_height * g_resolution_scale + 0.5f), 1, g_scaled_target.height);
+
+        glBindFramebuffer (GL_FRAMEBUFFER, g_scaled_target.framebuffer);
+
+        g_stats.resolution_scale = g_resolution_scale;
+        g_stats.resolution_scale_sum += g_resolution_scale;
+    }
+
+    if (timed)
+        glBeginQuery (GL_TIME_ELAPSED, timer_frame->queries[GL_Timer_Pass_Clear]);
+
+    GLStateViewport (0, 0, viewport_width, viewport_height);
+    GLStateClearColor (0.1, 0.1, 0.1, 1);
+    glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    if (timed)
+    {
+        glEndQuery (GL_TIME_ELAPSED);
+        glBeginQuery (GL_TIME_ELAPSED, timer_frame->queries[GL_Timer_Pass_Draw]);
+    }
+
+    GLStateSetDepthTest (true);
+    GLStateDepthFunc (GL_LESS);
+
+    GLDrawUniforms uniforms;
+    uniforms.view_projection_matrix = params.view_projection_matrix;
+    uniforms.light_position = params.light_position;
+    uniforms.pad0 = 0;
+    uniforms.light_color = params.light_color;
+    uniforms.texture_alpha = params.texture_alpha;
+
+    // The regions of this frame were last read GL_Frames_In_Flight frames ago
+    WaitForFence (&g_frame_fences[g_stats.frame_count % GL_Frames_In_Flight]);
+
+    s64 uniforms_offset = WriteDynamicBuffer (&g_draw_uniforms_buffer, &uniforms, sizeof (GLDrawUniforms));
+
+    // Also binds the buffer to the generic GL_UNIFORM_BUFFER target
+    GLStateBindBuffer (GL_UNIFORM_BUFFER, g_draw_uniforms_buffer.buffer);
+    glBindBufferRange (GL_UNIFORM_BUFFER, GL_Block_Draw_Uniforms, g_draw_uniforms_buffer.buffer, uniforms_offset, sizeof (GLDrawUniforms));
+
+    // Without instances the mesh is drawn as a single instance with an identity transform.
+    // A scene is always drawn as a single instance
+    const RenderInstance *instances = params.scene ? null : params.instances;
+    s64 instance_count = instances ? params.instance_count : 1;
+
+    ArrayClear (&g_instances);
+    ArrayReserve (&g_instances, instance_count);
+    for (s64 i = 0; i < instance_count; i += 1)
+    {
+        Mat4f model_matrix = params.model_matrix;
+        Vec3f color = params.model_color;
+        if (instances)
+        {
+            model_matrix = params.model_matrix * instances[i].model_matrix;
+            color = Vec3f{
+                color.x * instances[i].color.x,
+                color.y * instances[i].color.y,
+                color.z * instances[i].color.z
+            };
+        }
+
+        Mat3f normal_matrix = NormalMatrix (model_matrix);
+
+        GLInstance *instance = ArrayPush (&g_instances);
+        instance->model_matrix = model_matrix;
+        instance->normal_matrix_rows[0] = Vec3f{normal_matrix.r0c0, normal_matrix.r0c1, normal_matrix.r0c2};
+        instance->normal_matrix_rows[1] = Vec3f{normal_matrix.r1c0, normal_matrix.r1c1, normal_matrix.r1c2};
+        instance->normal_matrix_rows[2] = Vec3f{normal_matrix.r2c0, normal_matrix.r2c1, normal_matrix.r2c2};
+        instance->color = color;
+    }
+
+    s64 instances_offset = 0;
+    if (instance_count > 0)
+    {
+        instances_offset = WriteDynamicBuffer (&g_instance_buffer, g_instances.data, sizeof (GLInstance) * instance_count);
+        g_stats.bytes_uploaded += sizeof (GLInstance) * instance_count;
+    }
+
+    // Texture and random colors are blended by texture_alpha, skip whichever does not show
+    u32 shader_features = 0;
+    if (params.texture_alpha != 0)
+        shader_features |= GL_Shader_Texture;
+    if (params.texture_alpha != 1)
+        shader_features |= GL_Shader_Random_Color;
+    if (params.flat_shading)
+        shader_features |= GL_Shader_Flat_Shading;
+
+    GLStateUseProgram (GetShaderVariant (shader_features));
+
+    GLStateBindTexture2D (params.texture);
+
+    if (params.scene)
+    {
+        const Scene *scene = params.scene;
+
+        ArrayClear (&g_multi_draw_counts);
+        ArrayClear (&g_multi_draw_offsets);
+        ArrayClear (&g_multi_draw_base_vertices);
+
+        s64 index_count = 0;
+        for (s64 i = 0; i < scene->objects.count; i += 1)
+        {
+            const SceneObject &object = scene->objects[i];
+            if (!object.alive || (params.scene_visibility && !params.scene_visibility[i]))
+                continue;
+
+            ArrayPush (&g_multi_draw_counts, (GLsizei)object.index_count);
+            ArrayPush (&g_multi_draw_offsets, (void *)(sizeof (u32) * object.first_index));
+            ArrayPush (&g_multi_draw_base_vertices, (GLint)object.base_vertex);
+
+            index_count += object.index_count;
+        }
+
+        // One vertex array object for the whole scene, every object is a sub draw of a single call
+        GLStateBindVertexArray (scene->gfx_pool.vao);
+        if (g_glBufferStorage)
+            SetupInstanceAttributes (instances_offset);
+
+        if (g_multi_draw_counts.count > 0)
+        {
+            glMultiDrawElementsBaseVertex (GL_TRIANGLES, g_multi_draw_counts.data, GL_UNSIGNED_INT,
+                g_multi_draw_offsets.data, (GLsizei)g_multi_draw_counts.count, g_multi_draw_base_vertices.data);
+
+            g_stats.draw_calls += 1;
+            g_stats.triangles_submitted += index_count / 3;
+        }
+    }
+    else if (instance_count > 0)
+    {
+        // The vertex array object brings the vertex and index buffers with it
+        GLStateBindVertexArray (params.mesh->gfx_objects.vao);
+        if (g_glBufferStorage)
+            SetupInstanceAttributes (instances_offset);
+
+        s64 index_count = params.mesh->gfx_objects.drawable_index_count;
+        if (index_count > 0)
+        {
+            glDrawElementsInstanced (GL_TRIANGLES, (GLsizei)index_count, GL_UNSIGNED_INT, null, instance_count);
+
+            g_stats.draw_calls += 1;
+            g_stats.triangles_submitted += index_count / 3 * instance_count;
+        }
+    }
+
+    // Also timed when there is nothing to resolve, BeginTimerFrame expects every query to be issued
+    if (timed)
+    {
+        glEndQuery (GL_TIME_ELAPSED);
+        glBeginQuery (GL_TIME_ELAPSED, timer_frame->queries[GL_Timer_Pass_Resolve]);
+    }
+
+    if (scaled)
+    {
+        // Samples are resolved at the rendered size, only single sampled images can be stretched.
+        // Offscreen, the stretched frame goes where the resolved frames are read back from
+        glBindFramebuffer (GL_DRAW_FRAMEBUFFER, g_scaled_target.resolve_framebuffer);
+        glBlitFramebuffer (0, 0, viewport_width, viewport_height, 0, 0, viewport_width, viewport_height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+
+        glBindFramebuffer (GL_READ_FRAMEBUFFER, g_scaled_target.resolve_framebuffer);
+        glBindFramebuffer (GL_DRAW_FRAMEBUFFER, g_offscreen ? g_offscreen_target.resolve_framebuffer : 0);
+        glBlitFramebuffer (0, 0, viewport_width, viewport_height, 0, 0, framebuffer_width, framebuffer_height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+
+        glBindFramebuffer (GL_FRAMEBUFFER, GetPresentFramebuffer ());
+    }
+    else if (g_offscreen)
+    {
+        const GLOffscreenTarget &target = g_offscreen_target;
+
+        glBindFramebuffer (GL_DRAW_FRAMEBUFFER, target.resolve_framebuffer);
+        glBlitFramebuffer (0, 0, target.width, target.height, 0, 0, target.width, target.height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer (GL_DRAW_FRAMEBUFFER, target.framebuffer);
+    }
+
+    if (timed)
+        glEndQuery (GL_TIME_ELAPSED);
+
+    if (!g_offscreen)
+        glfwSwapBuffers (g_main_window);
+
+    if (g_glBufferStorage)
+        g_frame_fences[g_stats.frame_count % GL_Frames_In_Flight] = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    g_stats.frame_count += 1;
+}
+
+static void CompleteReadback (GLReadback *readback)
+{
+    if (!WaitForFence (&readback->fence))
+    {
+        LogError ("Could not wait for offscreen frame readback");
+        return;
+    }
+
+    const GLOffscreenTarget &target = g_offscreen_target;
+    GLsizeiptr size = (GLsizeiptr)target.width * target.height * 4;
+
+    glBindBuffer (GL_PIXEL_PACK_BUFFER, readback->pixel_buffer);
+
+    const u8 *pixels = (const u8 *)glMapBufferRange (GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (pixels)
+    {
+        readback->proc (pixels, target.width, target.height, readback->data);
+        glUnmapBuffer (GL_PIXEL_PACK_BUFFER);
+    }
+    else
+    {
+        LogError ("Could not map offscreen frame readback buffer");
+    }
+
+    glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+}
+
+static bool IsReadbackDone (const GLReadback &readback)
+{
+    return glClientWaitSync (readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) != GL_TIMEOUT_EXPIRED;
+}
+
+void GfxReadbackFrame (GfxReadbackProc proc, void *data)
+{
+    if (!g_offscreen)
+    {
+        LogWarning ("Frames can only be read back when rendering offscreen");
+        return;
+    }
+
+    // Readbacks complete in the order they were queued
+    while (g_readbacks_completed < g_readbacks_queued
+    && IsReadbackDone (g_readbacks[g_readbacks_completed % GL_Readback_Ring_Size]))
+    {
+        CompleteReadback (&g_readbacks[g_readbacks_completed % GL_Readback_Ring_Size]);
+        g_readbacks_completed += 1;
+    }
+
+    // Every buffer of the ring is in flight, the oldest one has to be waited on
+    if (g_readbacks_queued - g_readbacks_completed == GL_Readback_Ring_Size)
+    {
+        CompleteReadback (&g_readbacks[g_readbacks_completed % GL_Readback_Ring_Size]);
+        g_readbacks_completed += 1;
+    }
+
+    GLReadback *readback = &g_readbacks[g_readbacks_queued % GL_Readback_Ring_Size];
+    readback->proc = proc;
+    readback->data = data;
+
+    const GLOffscreenTarget &target = g_offscreen_target;
+
+    glBindFramebuffer (GL_READ_FRAMEBUFFER, target.resolve_framebuffer);
+    glBindBuffer (GL_PIXEL_PACK_BUFFER, readback->pixel_buffer);
+
+    glReadPixels (0, 0, target.width, target.height, GL_RGBA, GL_UNSIGNED_BYTE, null);
+
+    glBindBuffer (GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer (GL_READ_FRAMEBUFFER, target.framebuffer);
+
+    readback->fence = glFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    g_readbacks_queued += 1;
+}
+
+void GfxFlushReadbacks ()
+{
+    while (g_readbacks_completed < g_readbacks_queued)
+    {
+        CompleteReadback (&g_readbacks[g_readbacks_completed % GL_Readback_Ring_Size]);
+        g_readbacks_completed += 1;
+    }
 }
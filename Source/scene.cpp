@@ -0,0 +1,378 @@
+#include "Scop_Core.h"
+#include "Scop_Math.h"
+#include "Scop_Graphics.h"
+
+void InitRangeAllocator (RangeAllocator *allocator, s64 capacity)
+{
+    allocator->capacity = capacity;
+    ArrayClear (&allocator->free_ranges);
+
+    if (capacity > 0)
+    {
+        FreeRange *range = ArrayPush (&allocator->free_ranges);
+        range->offset = 0;
+        range->size = capacity;
+    }
+}
+
+void DestroyRangeAllocator (RangeAllocator *allocator)
+{
+    ArrayFree (&allocator->free_ranges);
+    allocator->capacity = 0;
+}
+
+s64 RangeAllocate (RangeAllocator *allocator, s64 size)
+{
+    Assert (size > 0);
+
+    for (s64 i = 0; i < allocator->free_ranges.count; i += 1)
+    {
+        FreeRange *range = &allocator->free_ranges[i];
+        if (range->size < size)
+            continue;
+
+        s64 offset = range->offset;
+        range->offset += size;
+        range->size -= size;
+
+        if (range->size == 0)
+            ArrayOrderedRemove (&allocator->free_ranges, i);
+
+        return offset;
+    }
+
+    return -1;
+}
+
+void RangeFree (RangeAllocator *allocator, s64 offset, s64 size)
+{
+    Assert (offset >= 0 && size > 0 && offset + size <= allocator->capacity);
+
+    s64 index = 0;
+    while (index < allocator->free_ranges.count && allocator->free_ranges[index].offset < offset)
+        index += 1;
+
+    bool merge_prev = index > 0
+        && allocator->free_ranges[index - 1].offset + allocator->free_ranges[index - 1].size == offset;
+    bool merge_next = index < allocator->free_ranges.count
+        && offset + size == allocator->free_ranges[index].offset;
+
+    if (merge_prev && merge_next)
+    {
+        allocator->free_ranges[index - 1].size += size + allocator->free_ranges[index].size;
+        ArrayOrderedRemove (&allocator->free_ranges, index);
+    }
+    else if (merge_prev)
+    {
+        allocator->free_ranges[index - 1].size += size;
+    }
+    else if (merge_next)
+    {
+        allocator->free_ranges[index].offset = offset;
+        allocator->free_ranges[index].size += size;
+    }
+    else
+    {
+        FreeRange range = {};
+        range.offset = offset;
+        range.size = size;
+        ArrayInsert (&allocator->free_ranges, index, range);
+    }
+}
+
+void GrowRangeAllocator (RangeAllocator *allocator, s64 new_capacity)
+{
+    Assert (new_capacity >= allocator->capacity);
+
+    s64 old_capacity = allocator->capacity;
+    allocator->capacity = new_capacity;
+
+    if (new_capacity > old_capacity)
+        RangeFree (allocator, old_capacity, new_capacity - old_capacity);
+}
+
+void InitScene (Scene *scene, s64 vertex_capacity, s64 index_capacity)
+{
+    memset (scene, 0, sizeof (Scene));
+
+    InitRangeAllocator (&scene->vertex_allocator, vertex_capacity);
+    InitRangeAllocator (&scene->index_allocator, index_capacity);
+    GfxCreateScenePool (&scene->gfx_pool, vertex_capacity, index_capacity);
+
+    ArrayReserve (&scene->positions, vertex_capacity);
+    ArrayReserve (&scene->indices, index_capacity);
+    scene->positions.count = vertex_capacity;
+    scene->indices.count = index_capacity;
+}
+
+void DestroyScene (Scene *scene)
+{
+    GfxDestroyScenePool (&scene->gfx_pool);
+    DestroyRangeAllocator (&scene->vertex_allocator);
+    DestroyRangeAllocator (&scene->index_allocator);
+    ArrayFree (&scene->objects);
+    FreeCullBoxes (&scene->object_bounds);
+    ArrayFree (&scene->positions);
+    ArrayFree (&scene->indices);
+
+    memset (scene, 0, sizeof (Scene));
+}
+
+static void GrowScene (Scene *scene, s64 vertex_count, s64 index_count)
+{
+    s64 old_vertex_capacity = scene->vertex_allocator.capacity;
+    s64 old_index_capacity = scene->index_allocator.capacity;
+
+    // Double the capacity so that adding many objects only copies the pool a few times
+    s64 vertex_capacity = Max (old_vertex_capacity * 2, old_vertex_capacity + vertex_count);
+    s64 index_capacity = Max (old_index_capacity * 2, old_index_capacity + index_count);
+
+    // Vertices are indexed with 32 bit indices relative to the base vertex of each object
+    vertex_capacity = Min (vertex_capacity, (s64)UINT_MAX);
+
+    GrowRangeAllocator (&scene->vertex_allocator, vertex_capacity);
+    GrowRangeAllocator (&scene->index_allocator, index_capacity);
+    GfxResizeScenePool (&scene->gfx_pool, old_vertex_capacity, old_index_capacity, vertex_capacity, index_capacity);
+
+    ArrayReserve (&scene->positions, vertex_capacity);
+    ArrayReserve (&scene->indices, index_capacity);
+    scene->positions.count = vertex_capacity;
+    scene->indices.count = index_capacity;
+}
+
+s64 AddMeshToScene (Scene *scene, const Mesh *mesh, const Mat4f &transform)
+{
+    Assert (mesh->vertex_count > 0 && mesh->index_count > 0);
+
+    s64 base_vertex = RangeAllocate (&scene->vertex_allocator, mesh->vertex_count);
+    s64 first_index = RangeAllocate (&scene->index_allocator, mesh->index_count);
+
+    if (base_vertex < 0 || first_index < 0)
+    {
+        if (base_vertex >= 0)
+            RangeFree (&scene->vertex_allocator, base_vertex, mesh->vertex_count);
+        if (first_index >= 0)
+            RangeFree (&scene->index_allocator, first_index, mesh->index_count);
+
+        GrowScene (scene, mesh->vertex_count, mesh->index_count);
+
+        base_vertex = RangeAllocate (&scene->vertex_allocator, mesh->vertex_count);
+        first_index = RangeAllocate (&scene->index_allocator, mesh->index_count);
+        if (base_vertex < 0 || first_index < 0)
+        {
+            LogError ("Could not allocate %ld vertices and %ld indices in the scene", mesh->vertex_count, mesh->index_count);
+
+            if (base_vertex >= 0)
+                RangeFree (&scene->vertex_allocator, base_vertex, mesh->vertex_count);
+            if (first_index >= 0)
+                RangeFree (&scene->index_allocator, first_index, mesh->index_count);
+
+            return -1;
+        }
+    }
+
+    Vertex *vertices = (Vertex *)malloc (sizeof (Vertex) * mesh->vertex_count);
+    if (!vertices)
+        return -1;
+
+    defer (free (vertices));
+
+    SceneObject object;
+    object.alive = true;
+    object.base_vertex = base_vertex;
+    object.vertex_count = mesh->vertex_count;
+    object.first_index = first_index;
+    object.index_count = mesh->index_count;
+    object.aabb_min = Vec3f{FLT_MAX, FLT_MAX, FLT_MAX};
+    object.aabb_max = Vec3f{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+
+    // Bake the transform so that every object is drawn with the same matrices
+    Mat3f normal_matrix = NormalMatrix (transform);
+    for (s64 i = 0; i < mesh->vertex_count; i += 1)
+    {
+        const Vertex &src = mesh->vertices[i];
+        Vertex *dst = &vertices[i];
+
+        Vec4f position = transform * Vec4f{src.position.x, src.position.y, src.position.z, 1};
+        Vec4f tangent = transform * Vec4f{src.tangent.x, src.tangent.y, src.tangent.z, 0};
+
+        dst->position = Vec3f{position.x, position.y, position.z};
+        dst->normal = Normalized (normal_matrix * src.normal, src.normal);
+        dst->tangent = Vec4f{tangent.x, tangent.y, tangent.z, src.tangent.w};
+        dst->tex_coords = src.tex_coords;
+
+        scene->positions[base_vertex + i] = dst->position;
+
+        object.aabb_min.x = Min (object.aabb_min.x, dst->position.x);
+        object.aabb_min.y = Min (object.aabb_min.y, dst->position.y);
+        object.aabb_min.z = Min (object.aabb_min.z, dst->position.z);
+
+        object.aabb_max.x = Max (object.aabb_max.x, dst->position.x);
+        object.aabb_max.y = Max (object.aabb_max.y, dst->position.y);
+        object.aabb_max.z = Max (object.aabb_max.z, dst->position.z);
+    }
+
+    GfxUploadToScenePool (&scene->gfx_pool, base_vertex, vertices, mesh->vertex_count, first_index, mesh->indices, mesh->index_count);
+    memcpy (scene->indices.data + first_index, mesh->indices, sizeof (u32) * mesh->index_count);
+
+    // Reuse the slot of a removed object so that object indices stay small
+    s64 object_index = scene->objects.count;
+    for (s64 i = 0; i < scene->objects.count; i += 1)
+    {
+        if (!scene->objects[i].alive)
+        {
+            object_index = i;
+            break;
+        }
+    }
+
+    if (object_index == scene->objects.count)
+    {
+        ArrayPush (&scene->objects);
+        PushCullBox (&scene->object_bounds, object.aabb_min, object.aabb_max);
+    }
+
+    scene->objects[object_index] = object;
+    SetCullBox (&scene->object_bounds, object_index, object.aabb_min, object.aabb_max);
+    scene->alive_object_count += 1;
+
+    return object_index;
+}
+
+void RemoveObjectFromScene (Scene *scene, s64 object_index)
+{
+    SceneObject *object = &scene->objects[object_index];
+    if (!object->alive)
+        return;
+
+    // The stale contents of the pool are left in place, they are overwritten by the next object
+    RangeFree (&scene->vertex_allocator, object->base_vertex, object->vertex_count);
+    RangeFree (&scene->index_allocator, object->first_index, object->index_count);
+
+    object->alive = false;
+    scene->alive_object_count -= 1;
+
+    // An inverted box is behind every frustum plane, so removed objects are always culled
+    SetCullBox (&scene->object_bounds, object_index, Vec3f{FLT_MAX, FLT_MAX, FLT_MAX}, Vec3f{-FLT_MAX, -FLT_MAX, -FLT_MAX});
+}
+
+void CalculateSceneBoundingBox (const Scene *scene, Vec3f *aabb_min, Vec3f *aabb_max)
+{
+    *aabb_min = Vec3f{FLT_MAX, FLT_MAX, FLT_MAX};
+    *aabb_max = Vec3f{-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (s64 i = 0; i < scene->objects.count; i += 1)
+    {
+        const SceneObject &object = scene->objects[i];
+        if (!object.alive)
+            continue;
+
+        aabb_min->x = Min (aabb_min->x, object.aabb_min.x);
+        aabb_min->y = Min (aabb_min->y, object.aabb_min.y);
+        aabb_min->z = Min (aabb_min->z, object.aabb_min.z);
+
+        aabb_max->x = Max (aabb_max->x, object.aabb_max.x);
+        aabb_max->y = Max (aabb_max->y, object.aabb_max.y);
+        aabb_max->z = Max (aabb_max->z, object.aabb_max.z);
+    }
+}
+
+struct LoadedSceneMesh
+{
+    char *filename;
+    Mesh mesh;
+};
+
+// One object per line: an OBJ filename optionally followed by the x y z position of the object.
+// Lines starting with # are comments. Every file is loaded once, however many objects use it
+bool LoadSceneFromFile (const char *filename, Scene *scene)
+{
+    auto read_result = ReadEntireFile (filename);
+    if (!read_result.ok)
+        return false;
+
+    String file_contents = read_result.value;
+    defer (free (file_contents.data));
+
+    Array<LoadedSceneMesh> meshes = {};
+    defer (
+        for (s64 i = 0; i < meshes.count; i += 1)
+        {
+            free (meshes[i].filename);
+            DestroyMesh (&meshes[i].mesh);
+        }
+        ArrayFree (&meshes);
+    );
+
+    InitScene (scene);
+
+    int line_number = 0;
+    char *line = file_contents.data;
+    while (line && *line)
+    {
+        char *next_line = strchr (line, '\n');
+        if (next_line)
+        {
+            *next_line = 0;
+            next_line += 1;
+        }
+
+        line_number += 1;
+
+        char mesh_filename[4096];
+        Vec3f position = Vec3f{};
+        int field_count = sscanf (line, " %4095s %f %f %f", mesh_filename, &position.x, &position.y, &position.z);
+
+        if (field_count <= 0 || mesh_filename[0] == '#')
+        {
+            line = next_line;
+            continue;
+        }
+
+        if (field_count != 1 && field_count != 4)
+        {
+            LogError ("%s:%d: expected a mesh filename optionally followed by a position", filename, line_number);
+            DestroyScene (scene);
+            return false;
+        }
+
+        Mesh *mesh = null;
+        for (s64 i = 0; i < meshes.count; i += 1)
+        {
+            if (strcmp (meshes[i].filename, mesh_filename) == 0)
+            {
+                mesh = &meshes[i].mesh;
+                break;
+            }
+        }
+
+        if (!mesh)
+        {
+            LoadedSceneMesh *loaded = ArrayPush (&meshes);
+            memset (&loaded->mesh, 0, sizeof (Mesh));
+            loaded->filename = strdup (mesh_filename);
+
+            if (!LoadMeshFromObjFile (mesh_filename, &loaded->mesh, (LoadMeshFlags)(LoadMesh_DefaultFlags | LoadMesh_NoGfxObjects)))
+            {
+                LogError ("%s:%d: could not load mesh '%s'", filename, line_number, mesh_filename);
+                DestroyScene (scene);
+                return false;
+            }
+
+            mesh = &loaded->mesh;
+        }
+
+        if (AddMeshToScene (scene, mesh, Mat4fTranslate (position)) < 0)
+        {
+            DestroyScene (scene);
+            return false;
+        }
+
+        line = next_line;
+    }
+
+    LogMessage ("Loaded scene %s, %ld objects from %ld meshes, %ld vertices and %ld indices of capacity",
+        filename, scene->alive_object_count, meshes.count,
+        scene->vertex_allocator.capacity, scene->index_allocator.capacity);
+
+    return true;
+}
@@ -0,0 +1,1441 @@
+#include "Scop_Core.h"
+#include "Scop_Graphics.h"
+
+// Frame pipeline:
+// 1. Vertex shading, in parallel over batches of vertices
+// 2. Triangle setup (near plane clipping, window transform) and binning into screen tiles,
+//    in parallel over batches of triangles. Each batch owns its bins so no locking is needed
+// 3. Rasterization, in parallel over tiles. A tile walks the bins of every batch in submission
+//    order, so the result does not depend on the number of threads
+//
+// Rasterization has a scalar reference path and an AVX2 path. The AVX2 path evaluates rows of
+// 8 pixels at once and keeps the maximum depth of every 8 by 8 block, so that triangles and
+// blocks that are entirely behind what was already drawn are skipped. Both paths do the same
+// float operations in the same order and produce the same image
+
+#ifdef SCOP_AVX2_AVAILABLE
+    #include <immintrin.h>
+#endif
+
+#define Sw_Tile_Size 64
+#define Sw_Depth_Block_Size 8 // Matches the width of an AVX2 register
+#define Sw_Vertex_Batch_Size 4096
+#define Sw_Min_Triangles_Per_Batch 1024
+#define Sw_Max_Setup_Batches 256
+
+struct SwVertex
+{
+    Vec4f clip_position;
+    Vec3f world_position;
+    Vec3f normal;
+    Vec2f tex_coords;
+};
+
+struct SwTriangle
+{
+    // Window coordinates, y up, pixel centers are at .5
+    float x[3];
+    float y[3];
+    float z[3];
+    float inv_w[3];
+
+    Vec3f world_position[3];
+    Vec3f normal[3];
+    Vec2f tex_coords[3];
+
+    int min_x, min_y;
+    int max_x, max_y;
+
+    // Interpolated depth is clamped to this range, rounding in the edge functions could otherwise
+    // push it in front of the nearest vertex and defeat hierarchical depth rejection
+    float min_z, max_z;
+
+    bool front_facing;
+    Vec3f random_color;
+    Vec3f instance_color;
+};
+
+// Edge i is opposite to vertex i. E(x, y) = a * x + b * y + c is positive inside
+struct SwEdges
+{
+    float a[3];
+    float b[3];
+    float c[3];
+    bool top_left[3];
+    float inv_area;
+};
+
+struct SwInstance
+{
+    Mat4f model_matrix;
+    Mat3f normal_matrix;
+    Vec3f color;
+};
+
+// A range of the frame's vertex and triangle lists, drawn from one vertex and index array.
+// Indices are relative to vertices
+struct SwDraw
+{
+    const Vertex *vertices;
+    const u32 *indices;
+    s64 vertex_count;
+    s64 triangle_count;
+    s64 first_vertex;
+    s64 first_triangle;
+    s64 instance;
+};
+
+struct SwSetupBatch
+{
+    Array<SwTriangle> triangles;
+    Array<Array<u32>> bins;
+};
+
+struct SwFrame
+{
+    const RenderFrameParams *params;
+    Mat4f view_projection_matrix;
+
+    // Draws (instances of the mesh or objects of the scene) are shaded and set up as
+    // one long list of vertices and triangles
+    s64 instance_count;
+    s64 vertex_count;
+    s64 triangle_count;
+    s64 triangles_per_batch;
+    s64 batch_count;
+
+    int tiles_x;
+    int tiles_y;
+};
+
+static_assert (Sw_Tile_Size % Sw_Depth_Block_Size == 0, "Depth blocks must not straddle tiles");
+
+static SwFramebuffer g_framebuffer;
+static float *g_depth_block_max;
+static int g_depth_blocks_x;
+static SwRasterPath g_raster_path = SwRasterPath_Scalar;
+static Array<SwVertex> g_vertices;
+static Array<SwInstance> g_instances;
+static Array<SwDraw> g_draws;
+static Array<SwSetupBatch> g_setup_batches;
+static SwFrame g_frame;
+static GfxStats g_stats;
+static int g_offscreen_width;
+static int g_offscreen_height;
+static GfxPassTimings g_pass_timings;
+static bool g_has_new_pass_timings;
+static u32 g_next_object_id = 1;
+
+static void ResizeFramebuffer (u32 width, u32 height)
+{
+    if (g_framebuffer.width == width && g_framebuffer.height == height)
+        return;
+
+    free (g_framebuffer.color);
+    free (g_framebuffer.depth);
+    free (g_depth_block_max);
+
+    g_framebuffer.width = width;
+    g_framebuffer.height = height;
+    g_framebuffer.color = (u32 *)malloc (sizeof (u32) * width * height);
+    g_framebuffer.depth = (float *)malloc (sizeof (float) * width * height);
+
+    g_depth_blocks_x = (width + Sw_Depth_Block_Size - 1) / Sw_Depth_Block_Size;
+    int depth_blocks_y = (height + Sw_Depth_Block_Size - 1) / Sw_Depth_Block_Size;
+    g_depth_block_max = (float *)malloc (sizeof (float) * g_depth_blocks_x * depth_blocks_y);
+
+    Assert (g_framebuffer.color && g_framebuffer.depth && g_depth_block_max, "Could not allocate %u by %u framebuffer", width, height);
+}
+
+bool SwSetRasterPath (SwRasterPath path)
+{
+    if (path == SwRasterPath_AVX2 && !CPUSupportsAVX2 ())
+        return false;
+
+    g_raster_path = path;
+
+    return true;
+}
+
+SwRasterPath SwGetRasterPath ()
+{
+    return g_raster_path;
+}
+
+const char *SwGetRasterPathName (SwRasterPath path)
+{
+    switch (path)
+    {
+    case SwRasterPath_Scalar: return "scalar";
+    case SwRasterPath_AVX2: return "avx2";
+    }
+
+    return "unknown";
+}
+
+bool GfxInitBackend (int offscreen_width, int offscreen_height, const GfxDynamicResolution *dynamic_resolution)
+{
+    if (dynamic_resolution)
+        LogWarning ("Dynamic resolution is not supported by the %s backend", SCOP_BACKEND_NAME);
+
+    if (offscreen_width > 0 && offscreen_height > 0)
+    {
+        g_offscreen_width = offscreen_width;
+        g_offscreen_height = offscreen_height;
+    }
+
+#ifdef SCOP_SOFTWARE_WINDOW
+    glfwInit ();
+
+    glfwSetErrorCallback (GLFWErrorCallback);
+
+    glfwWindowHint (GLFW_CLIENT_API, GLFW_OPENGL_API);
+    glfwWindowHint (GLFW_VISIBLE, g_offscreen_width > 0 ? GLFW_FALSE : GLFW_TRUE);
+
+    char window_title[100];
+    snprintf (window_title, sizeof (window_title), "Scop (%s)", SCOP_BACKEND_NAME);
+
+    g_main_window = glfwCreateWindow (SCOP_WINDOW_WIDTH, SCOP_WINDOW_HEIGHT, window_title, null, null);
+    if (!g_main_window)
+    {
+        LogError ("Could not create GLFW window");
+        return false;
+    }
+
+    glfwMakeContextCurrent (g_main_window);
+    glfwSwapInterval (1);
+#endif
+
+    int width, height;
+    GfxGetFramebufferSize (&width, &height);
+    ResizeFramebuffer (width, height);
+
+    if (!SwSetRasterPath (SwRasterPath_AVX2))
+        SwSetRasterPath (SwRasterPath_Scalar);
+
+    LogMessage ("Software rasterizer: %d worker threads, %d by %d tiles, %s rasterization",
+        GetWorkerCount (), Sw_Tile_Size, Sw_Tile_Size, SwGetRasterPathName (g_raster_path));
+
+    return true;
+}
+
+void GfxTerminateBackend ()
+{
+    for (s64 i = 0; i < g_setup_batches.count; i += 1)
+    {
+        SwSetupBatch *batch = &g_setup_batches[i];
+        for (s64 j = 0; j < batch->bins.count; j += 1)
+            ArrayFree (&batch->bins[j]);
+
+        ArrayFree (&batch->bins);
+        ArrayFree (&batch->triangles);
+    }
+
+    ArrayFree (&g_setup_batches);
+    ArrayFree (&g_vertices);
+    ArrayFree (&g_instances);
+    ArrayFree (&g_draws);
+
+    free (g_framebuffer.color);
+    free (g_framebuffer.depth);
+    memset (&g_framebuffer, 0, sizeof (g_framebuffer));
+
+    free (g_depth_block_max);
+    g_depth_block_max = null;
+    g_depth_blocks_x = 0;
+
+#ifdef SCOP_SOFTWARE_WINDOW
+    glfwDestroyWindow (g_main_window);
+    g_main_window = null;
+
+    glfwTerminate ();
+#endif
+}
+
+// The window context is only used to present, without a window there is nothing to hand over
+void GfxAcquireContext ()
+{
+#ifdef SCOP_SOFTWARE_WINDOW
+    glfwMakeContextCurrent (g_main_window);
+#endif
+}
+
+void GfxReleaseContext ()
+{
+#ifdef SCOP_SOFTWARE_WINDOW
+    glfwMakeContextCurrent (null);
+#endif
+}
+
+void GfxGetFramebufferSize (int *width, int *height)
+{
+    if (g_offscreen_width > 0)
+    {
+        *width = g_offscreen_width;
+        *height = g_offscreen_height;
+        return;
+    }
+
+#ifdef SCOP_SOFTWARE_WINDOW
+    glfwGetFramebufferSize (g_main_window, width, height);
+#else
+    *width = SCOP_WINDOW_WIDTH;
+    *height = SCOP_WINDOW_HEIGHT;
+#endif
+}
+
+const GfxStats &GfxGetStats ()
+{
+    return g_stats;
+}
+
+// Every pass runs on the CPU and is done by the time GfxRenderFrame returns, so the
+// timings are for the last frame
+bool GfxGetPassTimings (GfxPassTimings *timings)
+{
+    if (!g_has_new_pass_timings)
+        return false;
+
+    *timings = g_pass_timings;
+    g_has_new_pass_timings = false;
+
+    return true;
+}
+
+static void PushPassTiming (const char *name, f64 start_time, f64 end_time)
+{
+    if (g_pass_timings.pass_count >= Gfx_Max_Passes)
+        return;
+
+    g_pass_timings.pass_names[g_pass_timings.pass_count] = name;
+    g_pass_timings.pass_times[g_pass_timings.pass_count] = end_time - start_time;
+    g_pass_timings.pass_count += 1;
+}
+
+const SwFramebuffer &SwGetFramebuffer ()
+{
+    return g_framebuffer;
+}
+
+bool SwWriteFramebufferToFile (const char *filename)
+{
+    return WritePNGFile (filename, (const u8 *)g_framebuffer.color, g_framebuffer.width, g_framebuffer.height, true);
+}
+
+void GfxCreateMeshObjects (Mesh *mesh)
+{
+    // Vertices and indices are read straight from the mesh, there is nothing to upload
+    mesh->gfx_objects.id = g_next_object_id;
+    g_next_object_id += 1;
+
+    g_stats.mesh_objects_created += 1;
+}
+
+// The mesh is read in place, there is nothing to stream
+void GfxCreateMeshObjectsStreamed (Mesh *mesh)
+{
+    GfxCreateMeshObjects (mesh);
+}
+
+bool GfxStreamMeshObjects (Mesh *, f64)
+{
+    return true;
+}
+
+void GfxDestroyMeshObjects (Mesh *mesh)
+{
+    if (mesh->gfx_objects.id)
+        g_stats.mesh_objects_destroyed += 1;
+
+    mesh->gfx_objects.id = 0;
+}
+
+void GfxCreateScenePool (GfxScenePool *pool, s64 vertex_capacity, s64 index_capacity)
+{
+    pool->vertices = (Vertex *)malloc (sizeof (Vertex) * vertex_capacity);
+    pool->indices = (u32 *)malloc (sizeof (u32) * index_capacity);
+    Assert (pool->vertices != null && pool->indices != null);
+
+    g_stats.mesh_objects_created += 1;
+}
+
+void GfxDestroyScenePool (GfxScenePool *pool)
+{
+    if (pool->vertices)
+        g_stats.mesh_objects_destroyed += 1;
+
+    free (pool->vertices);
+    free (pool->indices);
+    pool->vertices = null;
+    pool->indices = null;
+}
+
+void GfxResizeScenePool (GfxScenePool *pool, s64 old_vertex_capacity, s64 old_index_capacity, s64 vertex_capacity, s64 index_capacity)
+{
+    (void)old_vertex_capacity;
+    (void)old_index_capacity;
+
+    pool->vertices = (Vertex *)realloc (pool->vertices, sizeof (Vertex) * vertex_capacity);
+    pool->indices = (u32 *)realloc (pool->indices, sizeof (u32) * index_capacity);
+    Assert (pool->vertices != null && pool->indices != null);
+}
+
+void GfxUploadToScenePool (GfxScenePool *pool, s64 first_vertex, const Vertex *vertices, s64 vertex_count, s64 first_index, const u32 *indices, s64 index_count)
+{
+    memcpy (pool->vertices + first_vertex, vertices, sizeof (Vertex) * vertex_count);
+    memcpy (pool->indices + first_index, indices, sizeof (u32) * index_count);
+
+    g_stats.bytes_uploaded += sizeof (Vertex) * vertex_count + sizeof (u32) * index_count;
+}
+
+// Textures are sampled from RGBA8 texels only
+bool GfxSupportsTextureFormat (TextureFormat format)
+{
+    return format == TextureFormat_RGBA8;
+}
+
+// Only level 0 is kept, the rasterizer samples it bilinearly
+GfxTexture GfxCreateTexture (const TextureData &data)
+{
+    Assert (data.format == TextureFormat_RGBA8);
+
+    u32 width = data.levels[0].width;
+    u32 height = data.levels[0].height;
+
+    SwTexture *texture = (SwTexture *)malloc (sizeof (SwTexture));
+    if (!texture)
+        return null;
+
+    texture->width = width;
+    texture->height = height;
+    texture->pixels = (u32 *)malloc (sizeof (u32) * width * height);
+    if (!texture->pixels)
+    {
+        free (texture);
+        return null;
+    }
+
+    memcpy (texture->pixels, data.levels[0].data, sizeof (u32) * width * height);
+
+    g_stats.textures_created += 1;
+    g_stats.bytes_uploaded += width * height * 4;
+
+    return texture;
+}
+
+void GfxDestroyTexture (GfxTexture *texture)
+{
+    if (*texture)
+    {
+        free ((*texture)->pixels);
+        free (*texture);
+
+        g_stats.textures_destroyed += 1;
+    }
+
+    *texture = null;
+}
+
+// Same as Random in Mesh_FS.glsl
+static float Random (float seed)
+{
+    float x = sinf (seed * 91.3458f) * 47453.5453f;
+
+    return x - floorf (x);
+}
+
+static Vec3f SampleTextureBilinear (const SwTexture *texture, Vec2f uv)
+{
+    // Bring coordinates back to [0, 1) first so that they can be converted to int safely
+    float u = uv.x - floorf (uv.x);
+    float v = uv.y - floorf (uv.y);
+    if (!(u >= 0 && u < 1))
+        u = 0;
+    if (!(v >= 0 && v < 1))
+        v = 0;
+
+    float x = u * texture->width - 0.5f;
+    float y = v * texture->height - 0.5f;
+    float fx = floorf (x);
+    float fy = floorf (y);
+    float tx = x - fx;
+    float ty = y - fy;
+
+    // GL_REPEAT wrapping
+    int w = (int)texture->width;
+    int h = (int)texture->height;
+    int x0 = (int)fx;
+    int y0 = (int)fy;
+    if (x0 < 0)
+        x0 += w;
+    if (y0 < 0)
+        y0 += h;
+
+    int x1 = x0 + 1 == w ? 0 : x0 + 1;
+    int y1 = y0 + 1 == h ? 0 : y0 + 1;
+
+    u32 texels[4] = {
+        texture->pixels[y0 * w + x0],
+        texture->pixels[y0 * w + x1],
+        texture->pixels[y1 * w + x0],
+        texture->pixels[y1 * w + x1],
+    };
+
+    float weights[4] = {
+        (1 - tx) * (1 - ty),
+        tx * (1 - ty),
+        (1 - tx) * ty,
+        tx * ty,
+    };
+
+    Vec3f result = Vec3f{};
+    for (int i = 0; i < 4; i += 1)
+    {
+        result.x += (texels[i] & 0xff) * weights[i];
+        result.y += ((texels[i] >> 8) & 0xff) * weights[i];
+        result.z += ((texels[i] >> 16) & 0xff) * weights[i];
+    }
+
+    return result / 255.0f;
+}
+
+static u32 PackColor (Vec3f color)
+{
+    u32 r = (u32)(Clamp (color.x, 0.0f, 1.0f) * 255 + 0.5f);
+    u32 g = (u32)(Clamp (color.y, 0.0f, 1.0f) * 255 + 0.5f);
+    u32 b = (u32)(Clamp (color.z, 0.0f, 1.0f) * 255 + 0.5f);
+
+    return r | (g << 8) | (b << 16) | (0xffu << 24);
+}
+
+// Index of the draw that contains a vertex (or a triangle), draws are sorted by first vertex and triangle
+static s64 FindDraw (s64 index, bool triangle)
+{
+    s64 low = 0;
+    s64 high = g_draws.count - 1;
+    while (low < high)
+    {
+        s64 mid = (low + high + 1) / 2;
+        s64 first = triangle ? g_draws.data[mid].first_triangle : g_draws.data[mid].first_vertex;
+        if (first <= index)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    return low;
+}
+
+static void ShadeVertexBatch (s64 batch_index, void *data)
+{
+    (void)data;
+
+    s64 start = batch_index * Sw_Vertex_Batch_Size;
+    s64 end = Min (start + Sw_Vertex_Batch_Size, g_frame.vertex_count);
+
+    s64 draw_index = FindDraw (start, false);
+    for (s64 i = start; i < end; i += 1)
+    {
+        while (i >= g_draws.data[draw_index].first_vertex + g_draws.data[draw_index].vertex_count)
+            draw_index += 1;
+
+        const SwDraw &draw = g_draws.data[draw_index];
+        const SwInstance &instance = g_instances.data[draw.instance];
+        const Vertex &in = draw.vertices[i - draw.first_vertex];
+        SwVertex *out = &g_vertices.data[i];
+
+        Vec4f world = instance.model_matrix * Vec4f{in.position.x, in.position.y, in.position.z, 1};
+
+        out->clip_position = g_frame.view_projection_matrix * world;
+        out->world_position = Vec3f{world.x, world.y, world.z};
+        out->normal = instance.normal_matrix * in.normal;
+        out->tex_coords = in.tex_coords;
+    }
+}
+
+static SwVertex LerpVertex (const SwVertex &a, const SwVertex &b, float t)
+{
+    SwVertex result;
+    result.clip_position = a.clip_position + (b.clip_position - a.clip_position) * t;
+    result.world_position = a.world_position + (b.world_position - a.world_position) * t;
+    result.normal = a.normal + (b.normal - a.normal) * t;
+    result.tex_coords = a.tex_coords + (b.tex_coords - a.tex_coords) * t;
+
+    return result;
+}
+
+static void SetupTriangle (SwSetupBatch *batch, const SwVertex *v0, const SwVertex *v1, const SwVertex *v2, Vec3f random_color, Vec3f instance_color)
+{
+    const SwVertex *v[3] = {v0, v1, v2};
+
+    SwTriangle tri;
+
+    float width = (float)g_framebuffer.width;
+    float height = (float)g_framebuffer.height;
+
+    for (int i = 0; i < 3; i += 1)
+    {
+        float inv_w = 1 / v[i]->clip_position.w;
+
+        tri.x[i] = (v[i]->clip_position.x * inv_w * 0.5f + 0.5f) * width;
+        tri.y[i] = (v[i]->clip_position.y * inv_w * 0.5f + 0.5f) * height;
+        tri.z[i] = v[i]->clip_position.z * inv_w * 0.5f + 0.5f;
+        tri.inv_w[i] = inv_w;
+        tri.world_position[i] = v[i]->world_position;
+        tri.normal[i] = v[i]->normal;
+        tri.tex_coords[i] = v[i]->tex_coords;
+    }
+
+    float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+    if (!(area != 0))
+        return;
+
+    // Counter clockwise is front facing, like the default glFrontFace. Store every triangle
+    // counter clockwise so that the rasterizer only has to handle one winding
+    tri.front_facing = area > 0;
+    if (!tri.front_facing)
+    {
+        float tmp;
+        tmp = tri.x[1]; tri.x[1] = tri.x[2]; tri.x[2] = tmp;
+        tmp = tri.y[1]; tri.y[1] = tri.y[2]; tri.y[2] = tmp;
+        tmp = tri.z[1]; tri.z[1] = tri.z[2]; tri.z[2] = tmp;
+        tmp = tri.inv_w[1]; tri.inv_w[1] = tri.inv_w[2]; tri.inv_w[2] = tmp;
+
+        Vec3f tmp3;
+        tmp3 = tri.world_position[1]; tri.world_position[1] = tri.world_position[2]; tri.world_position[2] = tmp3;
+        tmp3 = tri.normal[1]; tri.normal[1] = tri.normal[2]; tri.normal[2] = tmp3;
+
+        Vec2f tmp2 = tri.tex_coords[1]; tri.tex_coords[1] = tri.tex_coords[2]; tri.tex_coords[2] = tmp2;
+    }
+
+    // Counter clockwise on screen, the normal of the plane faces the camera. The rasterizer
+    // flips the normal of back faces, which is undone here
+    if (g_frame.params->flat_shading)
+    {
+        Vec3f normal = Normalized (Cross (
+            tri.world_position[1] - tri.world_position[0],
+            tri.world_position[2] - tri.world_position[0]
+        ));
+
+        if (!tri.front_facing)
+            normal = -normal;
+
+        tri.normal[0] = normal;
+        tri.normal[1] = normal;
+        tri.normal[2] = normal;
+    }
+
+    float min_x = Min (tri.x[0], Min (tri.x[1], tri.x[2]));
+    float min_y = Min (tri.y[0], Min (tri.y[1], tri.y[2]));
+    float max_x = Max (tri.x[0], Max (tri.x[1], tri.x[2]));
+    float max_y = Max (tri.y[0], Max (tri.y[1], tri.y[2]));
+
+    // Pixels whose center is covered, clamped to the framebuffer
+    tri.min_x = (int)Max (ceilf (min_x - 0.5f), 0.0f);
+    tri.min_y = (int)Max (ceilf (min_y - 0.5f), 0.0f);
+    tri.max_x = (int)Min (floorf (max_x - 0.5f), width - 1);
+    tri.max_y = (int)Min (floorf (max_y - 0.5f), height - 1);
+
+    if (tri.min_x > tri.max_x || tri.min_y > tri.max_y)
+        return;
+
+    tri.min_z = Min (tri.z[0], Min (tri.z[1], tri.z[2]));
+    tri.max_z = Max (tri.z[0], Max (tri.z[1], tri.z[2]));
+    tri.random_color = random_color;
+    tri.instance_color = instance_color;
+
+    u32 index = (u32)batch->triangles.count;
+    ArrayPush (&batch->triangles, tri);
+
+    int tile_min_x = tri.min_x / Sw_Tile_Size;
+    int tile_min_y = tri.min_y / Sw_Tile_Size;
+    int tile_max_x = tri.max_x / Sw_Tile_Size;
+    int tile_max_y = tri.max_y / Sw_Tile_Size;
+
+    for (int ty = tile_min_y; ty <= tile_max_y; ty += 1)
+    {
+        for (int tx = tile_min_x; tx <= tile_max_x; tx += 1)
+            ArrayPush (&batch->bins[ty * g_frame.tiles_x + tx], index);
+    }
+}
+
+static void SetupTriangleBatch (s64 batch_index, void *data)
+{
+    (void)data;
+
+    SwSetupBatch *batch = &g_setup_batches[batch_index];
+
+    ArrayClear (&batch->triangles);
+    for (s64 i = 0; i < batch->bins.count; i += 1)
+        ArrayClear (&batch->bins[i]);
+
+    s64 start = batch_index * g_frame.triangles_per_batch;
+    s64 end = Min (start + g_frame.triangles_per_batch, g_frame.triangle_count);
+
+    s64 draw_index = start < end ? FindDraw (start, true) : 0;
+    for (s64 t = start; t < end; t += 1)
+    {
+        while (t >= g_draws.data[draw_index].first_triangle + g_draws.data[draw_index].triangle_count)
+            draw_index += 1;
+
+        const SwDraw &draw = g_draws.data[draw_index];
+        s64 triangle = t - draw.first_triangle;
+        Vec3f instance_color = g_instances[draw.instance].color;
+
+        const SwVertex *draw_vertices = g_vertices.data + draw.first_vertex;
+        const SwVertex *v[3] = {
+            &draw_vertices[draw.indices[triangle * 3 + 0]],
+            &draw_vertices[draw.indices[triangle * 3 + 1]],
+            &draw_vertices[draw.indices[triangle * 3 + 2]],
+        };
+
+        // Equivalent of gl_PrimitiveID, which starts over for every instance and every sub draw
+        Vec3f random_color;
+        random_color.x = Random ((float)triangle);
+        random_color.y = Random (random_color.x);
+        random_color.z = Random (random_color.y);
+
+        // Trivially reject triangles outside of one of the frustum planes
+        bool outside = false;
+        for (int axis = 0; axis < 3 && !outside; axis += 1)
+        {
+            float c[3];
+            for (int i = 0; i < 3; i += 1)
+                c[i] = axis == 0 ? v[i]->clip_position.x : axis == 1 ? v[i]->clip_position.y : v[i]->clip_position.z;
+
+            if (c[0] > v[0]->clip_position.w && c[1] > v[1]->clip_position.w && c[2] > v[2]->clip_position.w)
+                outside = true;
+            if (c[0] < -v[0]->clip_position.w && c[1] < -v[1]->clip_position.w && c[2] < -v[2]->clip_position.w)
+                outside = true;
+        }
+
+        if (outside)
+            continue;
+
+        // Clip against the near plane (z = -w), the projection has no far plane
+        float d[3];
+        int inside_count = 0;
+        for (int i = 0; i < 3; i += 1)
+        {
+            d[i] = v[i]->clip_position.z + v[i]->clip_position.w;
+            inside_count += d[i] >= 0;
+        }
+
+        if (inside_count == 3)
+        {
+            SetupTriangle (batch, v[0], v[1], v[2], random_color, instance_color);
+            continue;
+        }
+
+        SwVertex polygon[4];
+        int polygon_count = 0;
+        for (int i = 0; i < 3; i += 1)
+        {
+            int j = (i + 1) % 3;
+
+            if (d[i] >= 0)
+            {
+                polygon[polygon_count] = *v[i];
+                polygon_count += 1;
+            }
+
+            if ((d[i] >= 0) != (d[j] >= 0))
+            {
+                polygon[polygon_count] = LerpVertex (*v[i], *v[j], d[i] / (d[i] - d[j]));
+                polygon_count += 1;
+            }
+        }
+
+        for (int i = 1; i + 1 < polygon_count; i += 1)
+            SetupTriangle (batch, &polygon[0], &polygon[i], &polygon[i + 1], random_color, instance_color);
+    }
+}
+
+static void SetupEdges (const SwTriangle &tri, SwEdges *edges)
+{
+    for (int i = 0; i < 3; i += 1)
+    {
+        int j = (i + 1) % 3;
+        int k = (i + 2) % 3;
+
+        float dx = tri.x[k] - tri.x[j];
+        float dy = tri.y[k] - tri.y[j];
+
+        edges->a[i] = -dy;
+        edges->b[i] = dx;
+        edges->c[i] = dy * tri.x[j] - dx * tri.y[j];
+
+        // Counter clockwise with y up: top edges go left, left edges go down
+        edges->top_left[i] = (dy == 0 && dx < 0) || dy < 0;
+    }
+
+    float area = edges->c[0] + edges->c[1] + edges->c[2];
+    edges->inv_area = 1 / area;
+}
+
+// Reference rasterizer, one pixel at a time
+static void RasterizeTriangle (const SwTriangle &tri, int tile_x0, int tile_y0, int tile_x1, int tile_y1)
+{
+    const RenderFrameParams &params = *g_frame.params;
+
+    int min_x = Max (tri.min_x, tile_x0);
+    int min_y = Max (tri.min_y, tile_y0);
+    int max_x = Min (tri.max_x, tile_x1);
+    int max_y = Min (tri.max_y, tile_y1);
+
+    if (min_x > max_x || min_y > max_y)
+        return;
+
+    SwEdges edges;
+    SetupEdges (tri, &edges);
+
+    Vec3f light_position = params.light_position;
+    Vec3f light_color = params.light_color;
+    float texture_alpha = params.texture_alpha;
+    const SwTexture *texture = params.texture;
+    float facing = tri.front_facing ? 1.0f : -1.0f;
+
+    for (int y = min_y; y <= max_y; y += 1)
+    {
+        float py = y + 0.5f;
+
+        for (int x = min_x; x <= max_x; x += 1)
+        {
+            float px = x + 0.5f;
+
+            float e[3];
+            bool inside = true;
+            for (int i = 0; i < 3; i += 1)
+            {
+                e[i] = edges.a[i] * px + edges.b[i] * py + edges.c[i];
+                inside = inside && (e[i] > 0 || (e[i] == 0 && edges.top_left[i]));
+            }
+
+            if (!inside)
+                continue;
+
+            float b0 = e[0] * edges.inv_area;
+            float b1 = e[1] * edges.inv_area;
+            float b2 = e[2] * edges.inv_area;
+
+            float z = b0 * tri.z[0] + b1 * tri.z[1] + b2 * tri.z[2];
+            z = Clamp (z, tri.min_z, tri.max_z);
+
+            s64 pixel_index = (s64)y * g_framebuffer.width + x;
+            if (!(z < g_framebuffer.depth[pixel_index]))
+                continue;
+
+            g_framebuffer.depth[pixel_index] = z;
+
+            // Perspective correct barycentrics
+            float p0 = b0 * tri.inv_w[0];
+            float p1 = b1 * tri.inv_w[1];
+            float p2 = b2 * tri.inv_w[2];
+            float inv_sum = 1 / (p0 + p1 + p2);
+            p0 *= inv_sum;
+            p1 *= inv_sum;
+            p2 *= inv_sum;
+
+            Vec3f world_position = tri.world_position[0] * p0 + tri.world_position[1] * p1 + tri.world_position[2] * p2;
+            Vec3f normal = tri.normal[0] * p0 + tri.normal[1] * p1 + tri.normal[2] * p2;
+
+            // Same as Mesh_FS.glsl
+            normal = Normalized (normal * facing);
+
+            Vec3f vertex_to_light = Normalized (light_position - world_position);
+            float diffuse_factor = Max (Dot (vertex_to_light, normal), 0.1f);
+
+            Vec3f texture_color = Vec3f{};
+            if (texture_alpha != 0 && texture)
+            {
+                Vec2f uv = tri.tex_coords[0] * p0 + tri.tex_coords[1] * p1 + tri.tex_coords[2] * p2;
+                texture_color = SampleTextureBilinear (texture, uv);
+            }
+
+            Vec3f diffuse = tri.random_color * (1 - texture_alpha) + texture_color * texture_alpha;
+
+            Vec3f color = Vec3f{
+                diffuse.x * light_color.x * diffuse_factor * tri.instance_color.x,
+                diffuse.y * light_color.y * diffuse_factor * tri.instance_color.y,
+                diffuse.z * light_color.z * diffuse_factor * tri.instance_color.z
+            };
+
+            g_framebuffer.color[pixel_index] = PackColor (color);
+        }
+    }
+}
+
+#ifdef SCOP_AVX2_AVAILABLE
+
+struct SwVec3x8
+{
+    __m256 x;
+    __m256 y;
+    __m256 z;
+};
+
+SCOP_TARGET_AVX2
+static inline __m256 Interpolate8 (float v0, float v1, float v2, __m256 p0, __m256 p1, __m256 p2)
+{
+    __m256 result = _mm256_mul_ps (_mm256_set1_ps (v0), p0);
+    result = _mm256_add_ps (result, _mm256_mul_ps (_mm256_set1_ps (v1), p1));
+    result = _mm256_add_ps (result, _mm256_mul_ps (_mm256_set1_ps (v2), p2));
+
+    return result;
+}
+
+SCOP_TARGET_AVX2
+static inline SwVec3x8 Interpolate8 (const Vec3f *v, __m256 p0, __m256 p1, __m256 p2)
+{
+    SwVec3x8 result;
+    result.x = Interpolate8 (v[0].x, v[1].x, v[2].x, p0, p1, p2);
+    result.y = Interpolate8 (v[0].y, v[1].y, v[2].y, p0, p1, p2);
+    result.z = Interpolate8 (v[0].z, v[1].z, v[2].z, p0, p1, p2);
+
+    return result;
+}
+
+SCOP_TARGET_AVX2
+static inline __m256 Dot8 (const SwVec3x8 &a, const SwVec3x8 &b)
+{
+    __m256 result = _mm256_mul_ps (a.x, b.x);
+    result = _mm256_add_ps (result, _mm256_mul_ps (a.y, b.y));
+    result = _mm256_add_ps (result, _mm256_mul_ps (a.z, b.z));
+
+    return result;
+}
+
+// Same as Normalized, lanes with a length of approximately zero become zero
+SCOP_TARGET_AVX2
+static inline SwVec3x8 Normalized8 (const SwVec3x8 &v)
+{
+    __m256 length = _mm256_sqrt_ps (Dot8 (v, v));
+    __m256 valid = _mm256_cmp_ps (length, _mm256_set1_ps (0.00001f), _CMP_GT_OQ);
+
+    SwVec3x8 result;
+    result.x = _mm256_and_ps (_mm256_div_ps (v.x, length), valid);
+    result.y = _mm256_and_ps (_mm256_div_ps (v.y, length), valid);
+    result.z = _mm256_and_ps (_mm256_div_ps (v.z, length), valid);
+
+    return result;
+}
+
+SCOP_TARGET_AVX2
+static inline float HorizontalMax8 (__m256 v)
+{
+    __m128 m = _mm_max_ps (_mm256_castps256_ps128 (v), _mm256_extractf128_ps (v, 1));
+    m = _mm_max_ps (m, _mm_movehl_ps (m, m));
+    m = _mm_max_ss (m, _mm_shuffle_ps (m, m, 1));
+
+    return _mm_cvtss_f32 (m);
+}
+
+// Same as SampleTextureBilinear, for 8 texture coordinates at once
+SCOP_TARGET_AVX2
+static SwVec3x8 SampleTextureBilinear8 (const SwTexture *texture, __m256 u, __m256 v)
+{
+    __m256 zero = _mm256_setzero_ps ();
+    __m256 one = _mm256_set1_ps (1);
+
+    u = _mm256_sub_ps (u, _mm256_floor_ps (u));
+    v = _mm256_sub_ps (v, _mm256_floor_ps (v));
+    u = _mm256_and_ps (u, _mm256_and_ps (_mm256_cmp_ps (u, zero, _CMP_GE_OQ), _mm256_cmp_ps (u, one, _CMP_LT_OQ)));
+    v = _mm256_and_ps (v, _mm256_and_ps (_mm256_cmp_ps (v, zero, _CMP_GE_OQ), _mm256_cmp_ps (v, one, _CMP_LT_OQ)));
+
+    __m256 x = _mm256_sub_ps (_mm256_mul_ps (u, _mm256_set1_ps ((float)texture->width)), _mm256_set1_ps (0.5f));
+    __m256 y = _mm256_sub_ps (_mm256_mul_ps (v, _mm256_set1_ps ((float)texture->height)), _mm256_set1_ps (0.5f));
+    __m256 fx = _mm256_floor_ps (x);
+    __m256 fy = _mm256_floor_ps (y);
+    __m256 tx = _mm256_sub_ps (x, fx);
+    __m256 ty = _mm256_sub_ps (y, fy);
+
+    // GL_REPEAT wrapping
+    __m256i w = _mm256_set1_epi32 ((int)texture->width);
+    __m256i h = _mm256_set1_epi32 ((int)texture->height);
+    __m256i int_one = _mm256_set1_epi32 (1);
+    __m256i x0 = _mm256_cvttps_epi32 (fx);
+    __m256i y0 = _mm256_cvttps_epi32 (fy);
+    x0 = _mm256_add_epi32 (x0, _mm256_and_si256 (_mm256_cmpgt_epi32 (_mm256_setzero_si256 (), x0), w));
+    y0 = _mm256_add_epi32 (y0, _mm256_and_si256 (_mm256_cmpgt_epi32 (_mm256_setzero_si256 (), y0), h));
+
+    __m256i x1 = _mm256_add_epi32 (x0, int_one);
+    __m256i y1 = _mm256_add_epi32 (y0, int_one);
+    x1 = _mm256_andnot_si256 (_mm256_cmpeq_epi32 (x1, w), x1);
+    y1 = _mm256_andnot_si256 (_mm256_cmpeq_epi32 (y1, h), y1);
+
+    __m256i row0 = _mm256_mullo_epi32 (y0, w);
+    __m256i row1 = _mm256_mullo_epi32 (y1, w);
+
+    const int *pixels = (const int *)texture->pixels;
+    __m256i texels[4] = {
+        _mm256_i32gather_epi32 (pixels, _mm256_add_epi32 (row0, x0), 4),
+        _mm256_i32gather_epi32 (pixels, _mm256_add_epi32 (row0, x1), 4),
+        _mm256_i32gather_epi32 (pixels, _mm256_add_epi32 (row1, x0), 4),
+        _mm256_i32gather_epi32 (pixels, _mm256_add_epi32 (row1, x1), 4),
+    };
+
+    __m256 one_minus_tx = _mm256_sub_ps (one, tx);
+    __m256 one_minus_ty = _mm256_sub_ps (one, ty);
+    __m256 weights[4] = {
+        _mm256_mul_ps (one_minus_tx, one_minus_ty),
+        _mm256_mul_ps (tx, one_minus_ty),
+        _mm256_mul_ps (one_minus_tx, ty),
+        _mm256_mul_ps (tx, ty),
+    };
+
+    __m256i byte_mask = _mm256_set1_epi32 (0xff);
+
+    SwVec3x8 result = {zero, zero, zero};
+    for (int i = 0; i < 4; i += 1)
+    {
+        __m256 r = _mm256_cvtepi32_ps (_mm256_and_si256 (texels[i], byte_mask));
+        __m256 g = _mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (texels[i], 8), byte_mask));
+        __m256 b = _mm256_cvtepi32_ps (_mm256_and_si256 (_mm256_srli_epi32 (texels[i], 16), byte_mask));
+
+        result.x = _mm256_add_ps (result.x, _mm256_mul_ps (r, weights[i]));
+        result.y = _mm256_add_ps (result.y, _mm256_mul_ps (g, weights[i]));
+        result.z = _mm256_add_ps (result.z, _mm256_mul_ps (b, weights[i]));
+    }
+
+    __m256 max_value = _mm256_set1_ps (255.0f);
+    result.x = _mm256_div_ps (result.x, max_value);
+    result.y = _mm256_div_ps (result.y, max_value);
+    result.z = _mm256_div_ps (result.z, max_value);
+
+    return result;
+}
+
+// Same as PackColor
+SCOP_TARGET_AVX2
+static inline __m256i PackColor8 (const SwVec3x8 &color)
+{
+    __m256 zero = _mm256_setzero_ps ();
+    __m256 one = _mm256_set1_ps (1);
+    __m256 scale = _mm256_set1_ps (255);
+    __m256 half = _mm256_set1_ps (0.5f);
+
+    __m256i r = _mm256_cvttps_epi32 (_mm256_add_ps (_mm256_mul_ps (_mm256_min_ps (_mm256_max_ps (color.x, zero), one), scale), half));
+    __m256i g = _mm256_cvttps_epi32 (_mm256_add_ps (_mm256_mul_ps (_mm256_min_ps (_mm256_max_ps (color.y, zero), one), scale), half));
+    __m256i b = _mm256_cvttps_epi32 (_mm256_add_ps (_mm256_mul_ps (_mm256_min_ps (_mm256_max_ps (color.z, zero), one), scale), half));
+
+    __m256i result = _mm256_or_si256 (r, _mm256_slli_epi32 (g, 8));
+    result = _mm256_or_si256 (result, _mm256_slli_epi32 (b, 16));
+    result = _mm256_or_si256 (result, _mm256_set1_epi32 ((int)0xff000000));
+
+    return result;
+}
+
+// Rasterize rows of 8 pixels, one depth block at a time. Returns true if any pixel was written
+SCOP_TARGET_AVX2
+static bool RasterizeTriangleAVX2 (const SwTriangle &tri, int tile_x0, int tile_y0, int tile_x1, int tile_y1)
+{
+    const RenderFrameParams &params = *g_frame.params;
+
+    int min_x = Max (tri.min_x, tile_x0);
+    int min_y = Max (tri.min_y, tile_y0);
+    int max_x = Min (tri.max_x, tile_x1);
+    int max_y = Min (tri.max_y, tile_y1);
+
+    if (min_x > max_x || min_y > max_y)
+        return false;
+
+    SwEdges edges;
+    SetupEdges (tri, &edges);
+
+    __m256 zero = _mm256_setzero_ps ();
+    __m256 all_set = _mm256_castsi256_ps (_mm256_set1_epi32 (-1));
+
+    __m256 a[3], b[3], c[3], top_left[3], z[3], inv_w[3];
+    for (int i = 0; i < 3; i += 1)
+    {
+        a[i] = _mm256_set1_ps (edges.a[i]);
+        b[i] = _mm256_set1_ps (edges.b[i]);
+        c[i] = _mm256_set1_ps (edges.c[i]);
+        top_left[i] = edges.top_left[i] ? all_set : zero;
+        z[i] = _mm256_set1_ps (tri.z[i]);
+        inv_w[i] = _mm256_set1_ps (tri.inv_w[i]);
+    }
+
+    __m256 inv_area = _mm256_set1_ps (edges.inv_area);
+    __m256 min_z = _mm256_set1_ps (tri.min_z);
+    __m256 max_z = _mm256_set1_ps (tri.max_z);
+
+    float texture_alpha = params.texture_alpha;
+    const SwTexture *texture = texture_alpha != 0 ? params.texture : null;
+    __m256 alpha = _mm256_set1_ps (texture_alpha);
+    __m256 facing = _mm256_set1_ps (tri.front_facing ? 1.0f : -1.0f);
+
+    SwVec3x8 base_color;
+    base_color.x = _mm256_set1_ps (tri.random_color.x * (1 - texture_alpha));
+    base_color.y = _mm256_set1_ps (tri.random_color.y * (1 - texture_alpha));
+    base_color.z = _mm256_set1_ps (tri.random_color.z * (1 - texture_alpha));
+
+    SwVec3x8 light_position;
+    light_position.x = _mm256_set1_ps (params.light_position.x);
+    light_position.y = _mm256_set1_ps (params.light_position.y);
+    light_position.z = _mm256_set1_ps (params.light_position.z);
+
+    SwVec3x8 light_color;
+    light_color.x = _mm256_set1_ps (params.light_color.x);
+    light_color.y = _mm256_set1_ps (params.light_color.y);
+    light_color.z = _mm256_set1_ps (params.light_color.z);
+
+    SwVec3x8 instance_color;
+    instance_color.x = _mm256_set1_ps (tri.instance_color.x);
+    instance_color.y = _mm256_set1_ps (tri.instance_color.y);
+    instance_color.z = _mm256_set1_ps (tri.instance_color.z);
+
+    __m256 one = _mm256_set1_ps (1);
+    __m256 min_diffuse = _mm256_set1_ps (0.1f);
+    __m256i lane_offsets = _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7);
+
+    int width = (int)g_framebuffer.width;
+    int height = (int)g_framebuffer.height;
+    bool wrote_triangle = false;
+
+    for (int block_y = min_y - min_y % Sw_Depth_Block_Size; block_y <= max_y; block_y += Sw_Depth_Block_Size)
+    {
+        for (int block_x = min_x - min_x % Sw_Depth_Block_Size; block_x <= max_x; block_x += Sw_Depth_Block_Size)
+        {
+            float *block_max_depth = &g_depth_block_max[(block_y / Sw_Depth_Block_Size) * g_depth_blocks_x + block_x / Sw_Depth_Block_Size];
+
+            // Every pixel of the block is already nearer than the nearest point of the triangle
+            if (tri.min_z >= *block_max_depth)
+                continue;
+
+            __m256i x = _mm256_add_epi32 (_mm256_set1_epi32 (block_x), lane_offsets);
+            __m256i in_span = _mm256_and_si256 (
+                _mm256_cmpgt_epi32 (x, _mm256_set1_epi32 (min_x - 1)),
+                _mm256_cmpgt_epi32 (_mm256_set1_epi32 (max_x + 1), x)
+            );
+            __m256 px = _mm256_add_ps (_mm256_cvtepi32_ps (x), _mm256_set1_ps (0.5f));
+
+            bool wrote_block = false;
+            for (int y = Max (block_y, min_y); y <= Min (block_y + Sw_Depth_Block_Size - 1, max_y); y += 1)
+            {
+                __m256 py = _mm256_set1_ps (y + 0.5f);
+
+                __m256 e[3];
+                __m256 inside = _mm256_castsi256_ps (in_span);
+                for (int i = 0; i < 3; i += 1)
+                {
+                    e[i] = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (a[i], px), _mm256_mul_ps (b[i], py)), c[i]);
+
+                    __m256 on_edge = _mm256_and_ps (_mm256_cmp_ps (e[i], zero, _CMP_EQ_OQ), top_left[i]);
+                    inside = _mm256_and_ps (inside, _mm256_or_ps (_mm256_cmp_ps (e[i], zero, _CMP_GT_OQ), on_edge));
+                }
+
+                if (_mm256_movemask_ps (inside) == 0)
+                    continue;
+
+                __m256 b0 = _mm256_mul_ps (e[0], inv_area);
+                __m256 b1 = _mm256_mul_ps (e[1], inv_area);
+                __m256 b2 = _mm256_mul_ps (e[2], inv_area);
+
+                __m256 depth = _mm256_add_ps (_mm256_add_ps (_mm256_mul_ps (b0, z[0]), _mm256_mul_ps (b1, z[1])), _mm256_mul_ps (b2, z[2]));
+                depth = _mm256_min_ps (_mm256_max_ps (depth, min_z), max_z);
+
+                s64 pixel_index = (s64)y * width + block_x;
+                float *depth_row = g_framebuffer.depth + pixel_index;
+
+                __m256 old_depth = _mm256_maskload_ps (depth_row, in_span);
+                __m256 pass = _mm256_and_ps (inside, _mm256_cmp_ps (depth, old_depth, _CMP_LT_OQ));
+                if (_mm256_movemask_ps (pass) == 0)
+                    continue;
+
+                __m256i pass_mask = _mm256_castps_si256 (pass);
+                _mm256_maskstore_ps (depth_row, pass_mask, depth);
+                wrote_block = true;
+
+                // Perspective correct barycentrics
+                __m256 p0 = _mm256_mul_ps (b0, inv_w[0]);
+                __m256 p1 = _mm256_mul_ps (b1, inv_w[1]);
+                __m256 p2 = _mm256_mul_ps (b2, inv_w[2]);
+                __m256 inv_sum = _mm256_div_ps (one, _mm256_add_ps (_mm256_add_ps (p0, p1), p2));
+                p0 = _mm256_mul_ps (p0, inv_sum);
+                p1 = _mm256_mul_ps (p1, inv_sum);
+                p2 = _mm256_mul_ps (p2, inv_sum);
+
+                SwVec3x8 world_position = Interpolate8 (tri.world_position, p0, p1, p2);
+                SwVec3x8 normal = Interpolate8 (tri.normal, p0, p1, p2);
+
+                // Same as Mesh_FS.glsl
+                normal.x = _mm256_mul_ps (normal.x, facing);
+                normal.y = _mm256_mul_ps (normal.y, facing);
+                normal.z = _mm256_mul_ps (normal.z, facing);
+                normal = Normalized8 (normal);
+
+                SwVec3x8 vertex_to_light;
+                vertex_to_light.x = _mm256_sub_ps (light_position.x, world_position.x);
+                vertex_to_light.y = _mm256_sub_ps (light_position.y, world_position.y);
+                vertex_to_light.z = _mm256_sub_ps (light_position.z, world_position.z);
+                vertex_to_light = Normalized8 (vertex_to_light);
+
+                __m256 diffuse_factor = _mm256_max_ps (Dot8 (vertex_to_light, normal), min_diffuse);
+
+                SwVec3x8 diffuse = base_color;
+                if (texture)
+                {
+                    __m256 u = Interpolate8 (tri.tex_coords[0].x, tri.tex_coords[1].x, tri.tex_coords[2].x, p0, p1, p2);
+                    __m256 v = Interpolate8 (tri.tex_coords[0].y, tri.tex_coords[1].y, tri.tex_coords[2].y, p0, p1, p2);
+                    SwVec3x8 texture_color = SampleTextureBilinear8 (texture, u, v);
+
+                    diffuse.x = _mm256_add_ps (diffuse.x, _mm256_mul_ps (texture_color.x, alpha));
+                    diffuse.y = _mm256_add_ps (diffuse.y, _mm256_mul_ps (texture_color.y, alpha));
+                    diffuse.z = _mm256_add_ps (diffuse.z, _mm256_mul_ps (texture_color.z, alpha));
+                }
+
+                SwVec3x8 color;
+                color.x = _mm256_mul_ps (_mm256_mul_ps (_mm256_mul_ps (diffuse.x, light_color.x), diffuse_factor), instance_color.x);
+                color.y = _mm256_mul_ps (_mm256_mul_ps (_mm256_mul_ps (diffuse.y, light_color.y), diffuse_factor), instance_color.y);
+                color.z = _mm256_mul_ps (_mm256_mul_ps (_mm256_mul_ps (diffuse.z, light_color.z), diffuse_factor), instance_color.z);
+
+                _mm256_maskstore_epi32 ((int *)(g_framebuffer.color + pixel_index), pass_mask, PackColor8 (color));
+            }
+
+            if (!wrote_block)
+                continue;
+
+            wrote_triangle = true;
+
+            // Lanes past the right edge of the framebuffer load 0, which never raises the maximum
+            __m256i in_framebuffer = _mm256_cmpgt_epi32 (_mm256_set1_epi32 (width), x);
+            __m256 block_max = zero;
+            for (int y = block_y; y <= Min (block_y + Sw_Depth_Block_Size - 1, height - 1); y += 1)
+            {
+                __m256 row = _mm256_maskload_ps (g_framebuffer.depth + (s64)y * width + block_x, in_framebuffer);
+                block_max = _mm256_max_ps (block_max, row);
+            }
+
+            *block_max_depth = HorizontalMax8 (block_max);
+        }
+    }
+
+    return wrote_triangle;
+}
+
+#endif
+
+static void RasterizeTile (s64 tile_index, void *data)
+{
+    (void)data;
+
+    int tile_x = (int)(tile_index % g_frame.tiles_x);
+    int tile_y = (int)(tile_index / g_frame.tiles_x);
+
+    int x0 = tile_x * Sw_Tile_Size;
+    int y0 = tile_y * Sw_Tile_Size;
+    int x1 = Min (x0 + Sw_Tile_Size, (int)g_framebuffer.width) - 1;
+    int y1 = Min (y0 + Sw_Tile_Size, (int)g_framebuffer.height) - 1;
+
+    // Clear color and depth of this tile, same as glClearColor (0.1, 0.1, 0.1, 1)
+    u32 clear_color = PackColor (Vec3f{0.1, 0.1, 0.1});
+    for (int y = y0; y <= y1; y += 1)
+    {
+        for (int x = x0; x <= x1; x += 1)
+        {
+            s64 pixel_index = (s64)y * g_framebuffer.width + x;
+            g_framebuffer.color[pixel_index] = clear_color;
+            g_framebuffer.depth[pixel_index] = 1;
+        }
+    }
+
+    int block_x0 = x0 / Sw_Depth_Block_Size;
+    int block_y0 = y0 / Sw_Depth_Block_Size;
+    int block_x1 = x1 / Sw_Depth_Block_Size;
+    int block_y1 = y1 / Sw_Depth_Block_Size;
+    for (int y = block_y0; y <= block_y1; y += 1)
+    {
+        for (int x = block_x0; x <= block_x1; x += 1)
+            g_depth_block_max[y * g_depth_blocks_x + x] = 1;
+    }
+
+    float tile_max_depth = 1;
+
+    for (s64 b = 0; b < g_frame.batch_count; b += 1)
+    {
+        const SwSetupBatch &batch = g_setup_batches[b];
+        const Array<u32> &bin = batch.bins[tile_index];
+
+        for (s64 i = 0; i < bin.count; i += 1)
+        {
+            const SwTriangle &tri = batch.triangles.data[bin.data[i]];
+
+#ifdef SCOP_AVX2_AVAILABLE
+            if (g_raster_path == SwRasterPath_AVX2)
+            {
+                // The whole triangle is behind everything drawn in this tile so far
+                if (tri.min_z >= tile_max_depth)
+                    continue;
+
+                if (!RasterizeTriangleAVX2 (tri, x0, y0, x1, y1))
+                    continue;
+
+                tile_max_depth = 0;
+                for (int y = block_y0; y <= block_y1; y += 1)
+                {
+                    for (int x = block_x0; x <= block_x1; x += 1)
+                        tile_max_depth = Max (tile_max_depth, g_depth_block_max[y * g_depth_blocks_x + x]);
+                }
+
+                continue;
+            }
+#endif
+
+            RasterizeTriangle (tri, x0, y0, x1, y1);
+        }
+    }
+}
+
+void GfxRenderFrame (const RenderFrameParams &params)
+{
+    int width = params.framebuffer_width;
+    int height = params.framebuffer_height;
+    if (width <= 0 || height <= 0)
+        return;
+
+    f64 frame_start_time = GetTimeInSeconds ();
+
+    g_pass_timings.frame_index = g_stats.frame_count;
+    g_pass_timings.pass_count = 0;
+
+    ResizeFramebuffer (width, height);
+
+    g_frame.params = &params;
+    g_frame.view_projection_matrix = params.view_projection_matrix;
+    g_frame.tiles_x = (width + Sw_Tile_Size - 1) / Sw_Tile_Size;
+    g_frame.tiles_y = (height + Sw_Tile_Size - 1) / Sw_Tile_Size;
+
+    // Without instances the mesh is drawn as a single instance with an identity transform.
+    // A scene is always drawn as a single instance
+    const RenderInstance *instances = params.scene ? null : params.instances;
+    g_frame.instance_count = instances ? params.instance_count : 1;
+
+    ArrayClear (&g_instances);
+    ArrayReserve (&g_instances, g_frame.instance_count);
+    for (s64 i = 0; i < g_frame.instance_count; i += 1)
+    {
+        SwInstance *instance = ArrayPush (&g_instances);
+        instance->model_matrix = params.model_matrix;
+        instance->color = params.model_color;
+
+        if (instances)
+        {
+            instance->model_matrix = params.model_matrix * instances[i].model_matrix;
+            instance->color = Vec3f{
+                instance->color.x * instances[i].color.x,
+                instance->color.y * instances[i].color.y,
+                instance->color.z * instances[i].color.z
+            };
+        }
+
+        instance->normal_matrix = NormalMatrix (instance->model_matrix);
+    }
+
+    g_frame.vertex_count = 0;
+    g_frame.triangle_count = 0;
+    ArrayClear (&g_draws);
+
+    if (params.scene)
+    {
+        const Scene *scene = params.scene;
+        for (s64 i = 0; i < scene->objects.count; i += 1)
+        {
+            const SceneObject &object = scene->objects[i];
+            if (!object.alive || (params.scene_visibility && !params.scene_visibility[i]))
+                continue;
+
+            SwDraw *draw = ArrayPush (&g_draws);
+            draw->vertices = scene->gfx_pool.vertices + object.base_vertex;
+            draw->indices = scene->gfx_pool.indices + object.first_index;
+            draw->vertex_count = object.vertex_count;
+            draw->triangle_count = object.index_count / 3;
+            draw->instance = 0;
+        }
+    }
+    else
+    {
+        for (s64 i = 0; i < g_frame.instance_count; i += 1)
+        {
+            SwDraw *draw = ArrayPush (&g_draws);
+            draw->vertices = params.mesh->vertices;
+            draw->indices = params.mesh->indices;
+            draw->vertex_count = params.mesh->vertex_count;
+            draw->triangle_count = params.mesh->index_count / 3;
+            draw->instance = i;
+        }
+    }
+
+    for (s64 i = 0; i < g_draws.count; i += 1)
+    {
+        g_draws[i].first_vertex = g_frame.vertex_count;
+        g_draws[i].first_triangle = g_frame.triangle_count;
+        g_frame.vertex_count += g_draws[i].vertex_count;
+        g_frame.triangle_count += g_draws[i].triangle_count;
+    }
+
+    ArrayReserve (&g_vertices, g_frame.vertex_count);
+    g_vertices.count = g_frame.vertex_count;
+
+    s64 vertex_batch_count = (g_frame.vertex_count + Sw_Vertex_Batch_Size - 1) / Sw_Vertex_Batch_Size;
+    ParallelFor (vertex_batch_count, ShadeVertexBatch, null);
+
+    f64 vertex_end_time = GetTimeInSeconds ();
+    PushPassTiming ("Vertex", frame_start_time, vertex_end_time);
+
+    g_frame.batch_count = (g_frame.triangle_count + Sw_Min_Triangles_Per_Batch - 1) / Sw_Min_Triangles_Per_Batch;
+    g_frame.batch_count = Clamp (g_frame.batch_count, (s64)1, (s64)Sw_Max_Setup_Batches);
+    g_frame.triangles_per_batch = (g_frame.triangle_count + g_frame.batch_count - 1) / g_frame.batch_count;
+
+    s64 tile_count = (s64)g_frame.tiles_x * g_frame.tiles_y;
+    while (g_setup_batches.count < g_frame.batch_count)
+        ArrayPush (&g_setup_batches);
+
+    for (s64 i = 0; i < g_frame.batch_count; i += 1)
+    {
+        SwSetupBatch *batch = &g_setup_batches[i];
+        while (batch->bins.count < tile_count)
+            ArrayPush (&batch->bins);
+    }
+
+    ParallelFor (g_frame.batch_count, SetupTriangleBatch, null);
+
+    f64 setup_end_time = GetTimeInSeconds ();
+    PushPassTiming ("Setup", vertex_end_time, setup_end_time);
+
+    ParallelFor (tile_count, RasterizeTile, null);
+
+    f64 raster_end_time = GetTimeInSeconds ();
+    PushPassTiming ("Raster", setup_end_time, raster_end_time);
+
+    g_stats.frame_count += 1;
+    g_stats.draw_calls += 1;
+    g_stats.triangles_submitted += g_frame.triangle_count;
+
+#ifdef SCOP_SOFTWARE_WINDOW
+    // Offscreen frames are only read back, never presented
+    if (g_offscreen_width == 0)
+    {
+        // Presenting only needs legacy glDrawPixels, from the GL header that GLFW includes
+        glViewport (0, 0, width, height);
+        glRasterPos2f (-1, -1);
+        glDrawPixels (width, height, GL_RGBA, GL_UNSIGNED_BYTE, g_framebuffer.color);
+
+        glfwSwapBuffers (g_main_window);
+
+        PushPassTiming ("Present", raster_end_time, GetTimeInSeconds ());
+    }
+#endif
+
+    g_has_new_pass_timings = true;
+}
+
+// The framebuffer is in memory and complete when GfxRenderFrame returns, readbacks never wait
+void GfxReadbackFrame (GfxReadbackProc proc, void *data)
+{
+    proc ((const u8 *)g_framebuffer.color, g_framebuffer.width, g_framebuffer.height, data);
+}
+
+void GfxFlushReadbacks ()
+{
+}
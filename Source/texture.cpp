@@ -0,0 +1,529 @@
+#include "Scop_Core.h"
+#include "Scop_Math.h"
+#include "Scop_Graphics.h"
+
+#ifdef SCOP_AVX2_AVAILABLE
+    #include <immintrin.h>
+#endif
+
+// Number of destination pixels filtered by a single job
+#define Mip_Pixels_Per_Batch 16384
+
+// The linear encoding table has this many entries per channel, enough to round trip every sRGB value
+#define Mip_Linear_Steps 4096
+
+// Both tables hold the color channels first and alpha, which is not gamma encoded, second.
+// The channel picks its half with an offset so that the AVX2 path can gather 2 pixels at once
+static float g_srgb_to_linear[256 * 2];
+static s32 g_linear_to_srgb[Mip_Linear_Steps * 2];
+
+static bool InitMipTables ()
+{
+    for (int i = 0; i < 256; i += 1)
+    {
+        float c = i / 255.0f;
+        g_srgb_to_linear[i] = c <= 0.04045f ? c / 12.92f : powf ((c + 0.055f) / 1.055f, 2.4f);
+        g_srgb_to_linear[256 + i] = c;
+    }
+
+    for (int i = 0; i < Mip_Linear_Steps; i += 1)
+    {
+        float l = i / (float)(Mip_Linear_Steps - 1);
+        float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf (l, 1 / 2.4f) - 0.055f;
+        g_linear_to_srgb[i] = (s32)(c * 255 + 0.5f);
+        g_linear_to_srgb[Mip_Linear_Steps + i] = (s32)(l * 255 + 0.5f);
+    }
+
+    return true;
+}
+
+static inline u8 EncodeMipChannel (float value, int channel)
+{
+    s32 index = (s32)(value * (Mip_Linear_Steps - 1) + 0.5f);
+
+    return (u8)g_linear_to_srgb[index + (channel == 3 ? Mip_Linear_Steps : 0)];
+}
+
+static inline float DecodeMipChannel (u8 value, int channel)
+{
+    return g_srgb_to_linear[value + (channel == 3 ? 256 : 0)];
+}
+
+// Same operations in the same order as the AVX2 path, both give the same bytes
+static void DownsampleScalar (const u8 *row0, const u8 *row1, u32 src_width, u8 *dst, u32 start_x, u32 end_x)
+{
+    for (u32 x = start_x; x < end_x; x += 1)
+    {
+        u32 x0 = x * 2;
+        u32 x1 = Min (x * 2 + 1, src_width - 1);
+
+        for (int c = 0; c < 4; c += 1)
+        {
+            float left = DecodeMipChannel (row0[x0 * 4 + c], c) + DecodeMipChannel (row1[x0 * 4 + c], c);
+            float right = DecodeMipChannel (row0[x1 * 4 + c], c) + DecodeMipChannel (row1[x1 * 4 + c], c);
+
+            dst[x * 4 + c] = EncodeMipChannel ((left + right) * 0.25f, c);
+        }
+    }
+}
+
+#ifdef SCOP_AVX2_AVAILABLE
+
+// Two destination pixels per iteration, from 4 pixels of each source row
+SCOP_TARGET_AVX2
+static void DownsampleAVX2 (const u8 *row0, const u8 *row1, u8 *dst, u32 pair_count)
+{
+    const __m256i decode_offset = _mm256_setr_epi32 (0, 0, 0, 256, 0, 0, 0, 256);
+    const __m256i encode_offset = _mm256_setr_epi32 (0, 0, 0, Mip_Linear_Steps, 0, 0, 0, Mip_Linear_Steps);
+
+    for (u32 i = 0; i < pair_count; i += 1)
+    {
+        __m128i top = _mm_loadu_si128 ((const __m128i *)(row0 + i * 16));
+        __m128i bottom = _mm_loadu_si128 ((const __m128i *)(row1 + i * 16));
+
+        __m256i top01 = _mm256_add_epi32 (_mm256_cvtepu8_epi32 (top), decode_offset);
+        __m256i top23 = _mm256_add_epi32 (_mm256_cvtepu8_epi32 (_mm_srli_si128 (top, 8)), decode_offset);
+        __m256i bottom01 = _mm256_add_epi32 (_mm256_cvtepu8_epi32 (bottom), decode_offset);
+        __m256i bottom23 = _mm256_add_epi32 (_mm256_cvtepu8_epi32 (_mm_srli_si128 (bottom, 8)), decode_offset);
+
+        // Columns 0 and 1, then 2 and 3, with both rows added together
+        __m256 sum01 = _mm256_add_ps (_mm256_i32gather_ps (g_srgb_to_linear, top01, 4), _mm256_i32gather_ps (g_srgb_to_linear, bottom01, 4));
+        __m256 sum23 = _mm256_add_ps (_mm256_i32gather_ps (g_srgb_to_linear, top23, 4), _mm256_i32gather_ps (g_srgb_to_linear, bottom23, 4));
+
+        __m256 left = _mm256_permute2f128_ps (sum01, sum23, 0x20);
+        __m256 right = _mm256_permute2f128_ps (sum01, sum23, 0x31);
+        __m256 average = _mm256_mul_ps (_mm256_add_ps (left, right), _mm256_set1_ps (0.25f));
+
+        __m256 scaled = _mm256_add_ps (_mm256_mul_ps (average, _mm256_set1_ps (Mip_Linear_Steps - 1)), _mm256_set1_ps (0.5f));
+        __m256i index = _mm256_add_epi32 (_mm256_cvttps_epi32 (scaled), encode_offset);
+        __m256i encoded = _mm256_i32gather_epi32 ((const int *)g_linear_to_srgb, index, 4);
+
+        __m128i words = _mm_packus_epi32 (_mm256_castsi256_si128 (encoded), _mm256_extracti128_si256 (encoded, 1));
+        _mm_storel_epi64 ((__m128i *)(dst + i * 8), _mm_packus_epi16 (words, words));
+    }
+}
+
+#endif
+
+struct MipJob
+{
+    const TextureLevel *src;
+    TextureLevel *dst;
+    s64 rows_per_batch;
+    bool use_avx2;
+};
+
+static void DownsampleRows (s64 batch_index, void *data)
+{
+    MipJob *job = (MipJob *)data;
+    const TextureLevel &src = *job->src;
+    const TextureLevel &dst = *job->dst;
+
+    u32 start_y = (u32)(batch_index * job->rows_per_batch);
+    u32 end_y = (u32)Min ((s64)start_y + job->rows_per_batch, (s64)dst.height);
+
+    for (u32 y = start_y; y < end_y; y += 1)
+    {
+        const u8 *row0 = src.data + (s64)src.width * 4 * (y * 2);
+        const u8 *row1 = src.data + (s64)src.width * 4 * Min (y * 2 + 1, src.height - 1);
+        u8 *dst_row = (u8 *)dst.data + (s64)dst.width * 4 * y;
+
+        u32 simd_end = 0;
+
+#ifdef SCOP_AVX2_AVAILABLE
+        // Every source column of a pair is in bounds, even with an odd source width
+        if (job->use_avx2 && src.width > 1)
+        {
+            u32 pair_count = dst.width / 2;
+            DownsampleAVX2 (row0, row1, dst_row, pair_count);
+            simd_end = pair_count * 2;
+        }
+#endif
+
+        DownsampleScalar (row0, row1, src.width, dst_row, simd_end, dst.width);
+    }
+}
+
+bool BuildMipChain (const u8 *rgba, u32 width, u32 height, TextureData *result)
+{
+    static bool tables_initialized = InitMipTables ();
+    (void)tables_initialized;
+
+#ifdef SCOP_AVX2_AVAILABLE
+    static bool avx2_supported = CPUSupportsAVX2 ();
+#else
+    bool avx2_supported = false;
+#endif
+
+    memset (result, 0, sizeof (TextureData));
+    result->format = TextureFormat_RGBA8;
+
+    // Halve each dimension until both are 1, odd sizes round down
+    s64 total_size = 0;
+    u32 level_width = width;
+    u32 level_height = height;
+    while (result->level_count < Max_Texture_Levels)
+    {
+        TextureLevel *level = &result->levels[result->level_count];
+        level->width = level_width;
+        level->height = level_height;
+        level->size = (s64)level_width * level_height * 4;
+        total_size += level->size;
+        result->level_count += 1;
+
+        if (level_width == 1 && level_height == 1)
+            break;
+
+        level_width = Max (level_width / 2, 1u);
+        level_height = Max (level_height / 2, 1u);
+    }
+
+    u8 *memory = (u8 *)malloc (total_size);
+    if (!memory)
+    {
+        LogError ("Could not allocate %ld bytes of mip levels", total_size);
+        return false;
+    }
+
+    result->memory = memory;
+
+    s64 offset = 0;
+    for (int i = 0; i < result->level_count; i += 1)
+    {
+        result->levels[i].data = memory + offset;
+        offset += result->levels[i].size;
+    }
+
+    memcpy (memory, rgba, result->levels[0].size);
+
+    for (int i = 1; i < result->level_count; i += 1)
+    {
+        MipJob job;
+        job.src = &result->levels[i - 1];
+        job.dst = &result->levels[i];
+        job.rows_per_batch = Max ((s64)Mip_Pixels_Per_Batch / job.dst->width, (s64)1);
+        job.use_avx2 = avx2_supported;
+
+        s64 batch_count = (job.dst->height + job.rows_per_batch - 1) / job.rows_per_batch;
+        ParallelFor (batch_count, DownsampleRows, &job);
+    }
+
+    return true;
+}
+
+void FreeTextureData (TextureData *data)
+{
+    free (data->memory);
+    memset (data, 0, sizeof (TextureData));
+}
+
+#define Texture_Cache_Dir "Cache"
+#define Texture_Cache_Magic 0x43545353 // "SSTC"
+#define Texture_Cache_Version 1
+
+static const char *const Texture_Format_Names[TextureFormat_Count] = {"RGBA8", "BC1", "BC3", "BC4", "BC5", "BC7"};
+
+// Header of a texture cache file, followed by the data of every level
+struct TextureCacheHeader
+{
+    u32 magic;
+    u32 version;
+    u64 key;
+    u32 format;
+    u32 level_count;
+    u32 width;
+    u32 height;
+};
+
+static bool IsTextureOpaque (const u8 *rgba, u32 width, u32 height)
+{
+    s64 count = (s64)width * height;
+    for (s64 i = 0; i < count; i += 1)
+    {
+        if (rgba[i * 4 + 3] != 255)
+            return false;
+    }
+
+    return true;
+}
+
+// The first supported of the formats that keep all the information the image has
+static TextureFormat ChooseTextureFormat (u32 supported_formats, int channel_count, bool opaque)
+{
+    TextureFormat candidates[2];
+    int candidate_count = 0;
+
+    if (channel_count <= 2)
+    {
+        candidates[candidate_count++] = opaque ? TextureFormat_BC4 : TextureFormat_BC5;
+    }
+    else if (opaque)
+    {
+        candidates[candidate_count++] = TextureFormat_BC1;
+    }
+    else
+    {
+        candidates[candidate_count++] = TextureFormat_BC7;
+        candidates[candidate_count++] = TextureFormat_BC3;
+    }
+
+    for (int i = 0; i < candidate_count; i += 1)
+    {
+        if (supported_formats & (1 << candidates[i]))
+            return candidates[i];
+    }
+
+    return TextureFormat_RGBA8;
+}
+
+// The chosen format depends on what the backend supports, which is part of the key
+static u64 GetTextureCacheKey (const MappedFile &file, u32 supported_formats)
+{
+    u64 key = HashBytes (file.data, file.size);
+    key = HashBytes (&supported_formats, sizeof (supported_formats), key);
+
+    return key;
+}
+
+static void GetTextureCacheFilename (u64 key, char *result, s64 size)
+{
+    snprintf (result, size, Texture_Cache_Dir "/texture_%016llx.bin", (unsigned long long)key);
+}
+
+// On success the data points into the contents of the cache file, which it owns
+static bool LoadCachedTexture (u64 key, TextureData *result)
+{
+    char filename[256];
+    GetTextureCacheFilename (key, filename, sizeof (filename));
+
+    auto read_res = ReadEntireFile (filename);
+    if (!read_res.ok)
+        return false;
+
+    String contents = read_res.value;
+
+    TextureCacheHeader header;
+    bool valid = contents.length >= (s64)sizeof (header);
+    if (valid)
+    {
+        memcpy (&header, contents.data, sizeof (header));
+        valid = header.magic == Texture_Cache_Magic && header.version == Texture_Cache_Version && header.key == key
+            && header.format < TextureFormat_Count && header.level_count > 0 && header.level_count <= Max_Texture_Levels
+            && header.width > 0 && header.height > 0;
+    }
+
+    if (valid)
+    {
+        memset (result, 0, sizeof (TextureData));
+        result->format = (TextureFormat)header.format;
+        result->level_count = header.level_count;
+        result->memory = contents.data;
+
+        s64 offset = sizeof (header);
+        u32 level_width = header.width;
+        u32 level_height = header.height;
+        for (int i = 0; i < result->level_count; i += 1)
+        {
+            TextureLevel *level = &result->levels[i];
+            level->width = level_width;
+            level->height = level_height;
+            level->size = GetTextureLevelSize (result->format, level_width, level_height);
+            level->data = (const u8 *)contents.data + offset;
+            offset += level->size;
+
+            level_width = Max (level_width / 2, 1u);
+            level_height = Max (level_height / 2, 1u);
+        }
+
+        valid = offset == contents.length;
+    }
+
+    if (!valid)
+    {
+        LogWarning ("Ignoring invalid texture cache file '%s'", filename);
+        free (contents.data);
+
+        return false;
+    }
+
+    return true;
+}
+
+static void SaveCachedTexture (u64 key, const TextureData &data)
+{
+    TextureCacheHeader header;
+    header.magic = Texture_Cache_Magic;
+    header.version = Texture_Cache_Version;
+    header.key = key;
+    header.format = data.format;
+    header.level_count = data.level_count;
+    header.width = data.levels[0].width;
+    header.height = data.levels[0].height;
+
+    // The levels are contiguous in memory, see CompressTextureData
+    const TextureLevel &last_level = data.levels[data.level_count - 1];
+    s64 data_size = (last_level.data + last_level.size) - data.levels[0].data;
+
+    u8 *contents = (u8 *)malloc (sizeof (header) + data_size);
+    Assert (contents != null);
+    defer (free (contents));
+
+    memcpy (contents, &header, sizeof (header));
+    memcpy (contents + sizeof (header), data.levels[0].data, data_size);
+
+    char filename[256];
+    GetTextureCacheFilename (key, filename, sizeof (filename));
+
+    if (!MakeDirectory (Texture_Cache_Dir) || !WriteEntireFile (filename, contents, sizeof (header) + data_size))
+        LogWarning ("Could not write texture cache file '%s'", filename);
+}
+
+// Decodes the image, or reads the result of a previous load from the cache
+static bool LoadImageTextureData (const MappedFile &file, u32 supported_formats, TextureData *result, bool *cached)
+{
+    u64 key = GetTextureCacheKey (file, supported_formats);
+
+    *cached = LoadCachedTexture (key, result);
+    if (*cached)
+        return true;
+
+    int x, y, channel_count;
+    u8 *pixels = stbi_load_from_memory ((const u8 *)file.data, (int)file.size, &x, &y, &channel_count, 4);
+    if (!pixels)
+        return false;
+
+    defer (stbi_image_free (pixels));
+
+    TextureData mips;
+    if (!BuildMipChain (pixels, x, y, &mips))
+        return false;
+
+    bool opaque = channel_count == 3 || IsTextureOpaque (pixels, x, y);
+    TextureFormat format = ChooseTextureFormat (supported_formats, channel_count, opaque);
+    if (format == TextureFormat_RGBA8)
+    {
+        *result = mips;
+
+        return true;
+    }
+
+    bool compressed = CompressTextureData (mips, format, result);
+    FreeTextureData (&mips);
+
+    if (!compressed)
+        return false;
+
+    SaveCachedTexture (key, *result);
+
+    return true;
+}
+
+u32 GetSupportedTextureFormats ()
+{
+    u32 result = 0;
+    for (int i = 0; i < TextureFormat_Count; i += 1)
+    {
+        if (GfxSupportsTextureFormat ((TextureFormat)i))
+            result |= 1 << i;
+    }
+
+    return result;
+}
+
+void BeginTextureLoad (TextureLoad *load, const char *filename)
+{
+    memset (load, 0, sizeof (TextureLoad));
+    load->filename = filename;
+    load->supported_formats = GetSupportedTextureFormats ();
+}
+
+void LoadTextureData (TextureLoad *load)
+{
+    f64 start_time = GetTimeInSeconds ();
+    defer (load->load_time = GetTimeInSeconds () - start_time);
+
+    auto map_res = MapFile (load->filename);
+    if (!map_res.ok)
+        return;
+
+    // Container levels point into the mapping, which is kept until the upload
+    load->file = map_res.value;
+
+    if (IsTextureContainer (load->file.data, load->file.size))
+    {
+        if (!ParseTextureContainer (load->filename, load->file.data, load->file.size, &load->data))
+            return;
+
+        if (!(load->supported_formats & (1 << load->data.format)))
+        {
+            LogError ("Texture format %s of '%s' is not supported by the backend", Texture_Format_Names[load->data.format], load->filename);
+            return;
+        }
+
+        load->source = "uploaded from the file";
+    }
+    else
+    {
+        bool cached;
+        if (!LoadImageTextureData (load->file, load->supported_formats, &load->data, &cached))
+            return;
+
+        load->source = cached ? "read from the cache" : "built";
+    }
+
+    load->ok = true;
+}
+
+bool UploadTextureData (TextureLoad *load, GfxTexture *texture)
+{
+    *texture = 0;
+    if (!load->ok)
+        return false;
+
+    f64 start_time = GetTimeInSeconds ();
+
+    const TextureData &data = load->data;
+    *texture = GfxCreateTexture (data);
+    if (!*texture)
+        return false;
+
+    f64 upload_time = GetTimeInSeconds () - start_time;
+
+    LogMessage ("Loaded texture %s, %u by %u px, %d mip levels in %s %s in %.3f ms, uploaded in %.3f ms",
+        load->filename, data.levels[0].width, data.levels[0].height, data.level_count,
+        Texture_Format_Names[data.format], load->source, load->load_time * 1000, upload_time * 1000);
+
+    return true;
+}
+
+void FreeTextureLoad (TextureLoad *load)
+{
+    FreeTextureData (&load->data);
+    UnmapFile (&load->file);
+}
+
+bool LoadTextureFromFile (const char *filename, GfxTexture *texture, u32 *width, u32 *height)
+{
+    if (width)
+        *width = 0;
+    if (height)
+        *height = 0;
+
+    TextureLoad load;
+    BeginTextureLoad (&load, filename);
+    defer (FreeTextureLoad (&load));
+
+    LoadTextureData (&load);
+    if (!UploadTextureData (&load, texture))
+        return false;
+
+    if (width)
+        *width = load.data.levels[0].width;
+    if (height)
+        *height = load.data.levels[0].height;
+
+    return true;
+}
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
@@ -0,0 +1,470 @@
+#include "Scop_Core.h"
+#include "Scop_Math.h"
+#include "Scop_Graphics.h"
+
+// Number of 4 by 4 blocks encoded by a single job
+#define Bc_Blocks_Per_Batch 256
+
+// Interpolation weights of the 16 color BC7 palette, out of 64
+static const s32 Bc7_Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+s64 GetTextureLevelSize (TextureFormat format, u32 width, u32 height)
+{
+    s64 block_count = (s64)((width + 3) / 4) * ((height + 3) / 4);
+
+    switch (format)
+    {
+    case TextureFormat_RGBA8: return (s64)width * height * 4;
+    case TextureFormat_BC1: return block_count * 8;
+    case TextureFormat_BC4: return block_count * 8;
+    case TextureFormat_BC3: return block_count * 16;
+    case TextureFormat_BC5: return block_count * 16;
+    case TextureFormat_BC7: return block_count * 16;
+    default: Panic ("Invalid texture format %d", format);
+    }
+
+    return 0;
+}
+
+// Texels past the edge of levels whose size is not a multiple of 4 repeat the last row and column
+static void GetBlockTexels (const TextureLevel &level, u32 block_x, u32 block_y, u8 texels[16][4])
+{
+    for (u32 y = 0; y < 4; y += 1)
+    {
+        u32 src_y = Min (block_y * 4 + y, level.height - 1);
+        for (u32 x = 0; x < 4; x += 1)
+        {
+            u32 src_x = Min (block_x * 4 + x, level.width - 1);
+            memcpy (texels[y * 4 + x], level.data + ((s64)src_y * level.width + src_x) * 4, 4);
+        }
+    }
+}
+
+// The endpoints are the extremes of the texels projected on the direction they vary the most
+// along, found with a few power iterations on their covariance matrix
+static void GetPrincipalEndpoints (const u8 texels[16][4], int channel_count, float *endpoint0, float *endpoint1)
+{
+    float mean[4] = {};
+    for (int i = 0; i < 16; i += 1)
+    {
+        for (int c = 0; c < channel_count; c += 1)
+            mean[c] += texels[i][c];
+    }
+
+    for (int c = 0; c < channel_count; c += 1)
+        mean[c] /= 16;
+
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; i += 1)
+    {
+        for (int a = 0; a < channel_count; a += 1)
+        {
+            for (int b = 0; b < channel_count; b += 1)
+                covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+        }
+    }
+
+    // Starting from the row of the channel that varies the most, so that the first
+    // iteration does not vanish when the texels vary along an axis orthogonal to the start
+    int largest = 0;
+    for (int c = 1; c < channel_count; c += 1)
+    {
+        if (covariance[c][c] > covariance[largest][largest])
+            largest = c;
+    }
+
+    float axis[4] = {};
+    for (int c = 0; c < channel_count; c += 1)
+        axis[c] = covariance[largest][c];
+
+    for (int iteration = 0; iteration < 8; iteration += 1)
+    {
+        float next[4] = {};
+        float length = 0;
+        for (int a = 0; a < channel_count; a += 1)
+        {
+            for (int b = 0; b < channel_count; b += 1)
+                next[a] += covariance[a][b] * axis[b];
+
+            length += next[a] * next[a];
+        }
+
+        if (length < 1e-12f)
+            break;
+
+        length = sqrtf (length);
+        for (int c = 0; c < channel_count; c += 1)
+            axis[c] = next[c] / length;
+    }
+
+    float axis_length = 0;
+    for (int c = 0; c < channel_count; c += 1)
+        axis_length += axis[c] * axis[c];
+
+    // All the texels are the same
+    if (axis_length < 1e-12f)
+    {
+        for (int c = 0; c < channel_count; c += 1)
+        {
+            endpoint0[c] = mean[c];
+            endpoint1[c] = mean[c];
+        }
+
+        return;
+    }
+
+    axis_length = sqrtf (axis_length);
+    for (int c = 0; c < channel_count; c += 1)
+        axis[c] /= axis_length;
+
+    float min_t = FLT_MAX;
+    float max_t = -FLT_MAX;
+    for (int i = 0; i < 16; i += 1)
+    {
+        float t = 0;
+        for (int c = 0; c < channel_count; c += 1)
+            t += (texels[i][c] - mean[c]) * axis[c];
+
+        min_t = Min (min_t, t);
+        max_t = Max (max_t, t);
+    }
+
+    for (int c = 0; c < channel_count; c += 1)
+    {
+        endpoint0[c] = Clamp (mean[c] + axis[c] * max_t, 0.0f, 255.0f);
+        endpoint1[c] = Clamp (mean[c] + axis[c] * min_t, 0.0f, 255.0f);
+    }
+}
+
+static u32 FindNearestPaletteEntry (const u8 *texel, const s32 (*palette)[4], u32 palette_size, int channel_count)
+{
+    u32 best = 0;
+    s32 best_distance = 0;
+    for (u32 i = 0; i < palette_size; i += 1)
+    {
+        s32 distance = 0;
+        for (int c = 0; c < channel_count; c += 1)
+        {
+            s32 delta = texel[c] - palette[i][c];
+            distance += delta * delta;
+        }
+
+        if (i == 0 || distance < best_distance)
+        {
+            best = i;
+            best_distance = distance;
+        }
+    }
+
+    return best;
+}
+
+static u16 PackRGB565 (const float *color)
+{
+    u32 r = (u32)(color[0] * 31 / 255 + 0.5f);
+    u32 g = (u32)(color[1] * 63 / 255 + 0.5f);
+    u32 b = (u32)(color[2] * 31 / 255 + 0.5f);
+
+    return (u16)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565 (u16 packed, s32 *color)
+{
+    s32 r = (packed >> 11) & 0x1f;
+    s32 g = (packed >> 5) & 0x3f;
+    s32 b = packed & 0x1f;
+
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+    color[3] = 255;
+}
+
+static void EncodeBC1Block (const u8 texels[16][4], u8 *block)
+{
+    float endpoint0[4], endpoint1[4];
+    GetPrincipalEndpoints (texels, 3, endpoint0, endpoint1);
+
+    u16 color0 = PackRGB565 (endpoint0);
+    u16 color1 = PackRGB565 (endpoint1);
+
+    // color0 > color1 selects the 4 color mode, which is the only one of the color block of BC3
+    if (color0 < color1)
+    {
+        u16 tmp = color0;
+        color0 = color1;
+        color1 = tmp;
+    }
+
+    u32 indices = 0;
+    if (color0 != color1)
+    {
+        s32 palette[4][4];
+        UnpackRGB565 (color0, palette[0]);
+        UnpackRGB565 (color1, palette[1]);
+        for (int c = 0; c < 3; c += 1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+
+        for (int i = 0; i < 16; i += 1)
+            indices |= FindNearestPaletteEntry (texels[i], palette, 4, 3) << (i * 2);
+    }
+
+    block[0] = (u8)color0;
+    block[1] = (u8)(color0 >> 8);
+    block[2] = (u8)color1;
+    block[3] = (u8)(color1 >> 8);
+    for (int i = 0; i < 4; i += 1)
+        block[4 + i] = (u8)(indices >> (i * 8));
+}
+
+// A single channel with 8 interpolated values, used for alpha in BC3 and for BC4 and BC5
+static void EncodeBC4Block (const u8 texels[16][4], int channel, u8 *block)
+{
+    s32 max_value = 0;
+    s32 min_value = 255;
+    for (int i = 0; i < 16; i += 1)
+    {
+        max_value = Max (max_value, (s32)texels[i][channel]);
+        min_value = Min (min_value, (s32)texels[i][channel]);
+    }
+
+    u64 indices = 0;
+    if (max_value > min_value)
+    {
+        s32 palette[8];
+        palette[0] = max_value;
+        palette[1] = min_value;
+        for (int i = 1; i < 7; i += 1)
+            palette[i + 1] = ((7 - i) * max_value + i * min_value + 3) / 7;
+
+        for (int i = 0; i < 16; i += 1)
+        {
+            u64 best = 0;
+            s32 best_distance = 256;
+            for (int j = 0; j < 8; j += 1)
+            {
+                s32 distance = Abs (texels[i][channel] - palette[j]);
+                if (distance < best_distance)
+                {
+                    best = j;
+                    best_distance = distance;
+                }
+            }
+
+            indices |= best << (i * 3);
+        }
+    }
+
+    block[0] = (u8)max_value;
+    block[1] = (u8)min_value;
+    for (int i = 0; i < 6; i += 1)
+        block[2 + i] = (u8)(indices >> (i * 8));
+}
+
+static void WriteBits (u8 *block, int *position, u32 value, int count)
+{
+    for (int i = 0; i < count; i += 1)
+    {
+        int bit = *position + i;
+        block[bit / 8] |= ((value >> i) & 1) << (bit % 8);
+    }
+
+    *position += count;
+}
+
+// BC7 endpoints are 7 bits per channel followed by a low bit shared by the 4 channels
+static void QuantizeBC7Endpoint (const float *endpoint, u32 *quantized, u32 *p_bit)
+{
+    float best_error = 0;
+    for (u32 p = 0; p < 2; p += 1)
+    {
+        u32 values[4];
+        float error = 0;
+        for (int c = 0; c < 4; c += 1)
+        {
+            s32 value = (s32)((endpoint[c] - p) / 2 + 0.5f);
+            values[c] = (u32)Clamp (value, 0, 127);
+
+            float delta = (float)(values[c] * 2 + p) - endpoint[c];
+            error += delta * delta;
+        }
+
+        if (p == 0 || error < best_error)
+        {
+            best_error = error;
+            memcpy (quantized, values, sizeof (values));
+            *p_bit = p;
+        }
+    }
+}
+
+// Mode 6 only: a single pair of RGBA endpoints and 16 palette entries, which handles
+// color and alpha together and does not need a partition search
+static void EncodeBC7Block (const u8 texels[16][4], u8 *block)
+{
+    float endpoint0[4], endpoint1[4];
+    GetPrincipalEndpoints (texels, 4, endpoint0, endpoint1);
+
+    u32 quantized0[4], quantized1[4];
+    u32 p_bit0, p_bit1;
+    QuantizeBC7Endpoint (endpoint0, quantized0, &p_bit0);
+    QuantizeBC7Endpoint (endpoint1, quantized1, &p_bit1);
+
+    s32 palette[16][4];
+    for (int i = 0; i < 16; i += 1)
+    {
+        for (int c = 0; c < 4; c += 1)
+        {
+            s32 e0 = quantized0[c] * 2 + p_bit0;
+            s32 e1 = quantized1[c] * 2 + p_bit1;
+            palette[i][c] = ((64 - Bc7_Weights[i]) * e0 + Bc7_Weights[i] * e1 + 32) >> 6;
+        }
+    }
+
+    u32 indices[16];
+    for (int i = 0; i < 16; i += 1)
+        indices[i] = FindNearestPaletteEntry (texels[i], palette, 16, 4);
+
+    // The highest bit of the first index is implied to be 0. The weights are symmetric,
+    // so swapping the endpoints reverses the indices
+    if (indices[0] & 8)
+    {
+        for (int c = 0; c < 4; c += 1)
+        {
+            u32 tmp = quantized0[c];
+            quantized0[c] = quantized1[c];
+            quantized1[c] = tmp;
+        }
+
+        u32 tmp = p_bit0;
+        p_bit0 = p_bit1;
+        p_bit1 = tmp;
+
+        for (int i = 0; i < 16; i += 1)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset (block, 0, 16);
+
+    int position = 0;
+    WriteBits (block, &position, 1 << 6, 7);
+    for (int c = 0; c < 4; c += 1)
+    {
+        WriteBits (block, &position, quantized0[c], 7);
+        WriteBits (block, &position, quantized1[c], 7);
+    }
+
+    WriteBits (block, &position, p_bit0, 1);
+    WriteBits (block, &position, p_bit1, 1);
+
+    WriteBits (block, &position, indices[0], 3);
+    for (int i = 1; i < 16; i += 1)
+        WriteBits (block, &position, indices[i], 4);
+}
+
+struct CompressJob
+{
+    const TextureLevel *src;
+    TextureLevel *dst;
+    TextureFormat format;
+    u32 blocks_x;
+    s64 block_count;
+    s64 block_size;
+};
+
+static void CompressBlocks (s64 batch_index, void *data)
+{
+    CompressJob *job = (CompressJob *)data;
+
+    s64 start = batch_index * Bc_Blocks_Per_Batch;
+    s64 end = Min (start + Bc_Blocks_Per_Batch, job->block_count);
+
+    for (s64 i = start; i < end; i += 1)
+    {
+        u8 texels[16][4];
+        GetBlockTexels (*job->src, (u32)(i % job->blocks_x), (u32)(i / job->blocks_x), texels);
+
+        u8 *block = (u8 *)job->dst->data + i * job->block_size;
+        switch (job->format)
+        {
+        case TextureFormat_BC1:
+            EncodeBC1Block (texels, block);
+            break;
+
+        case TextureFormat_BC3:
+            EncodeBC4Block (texels, 3, block);
+            EncodeBC1Block (texels, block + 8);
+            break;
+
+        case TextureFormat_BC4:
+            EncodeBC4Block (texels, 0, block);
+            break;
+
+        case TextureFormat_BC5:
+            EncodeBC4Block (texels, 0, block);
+            EncodeBC4Block (texels, 3, block + 8);
+            break;
+
+        case TextureFormat_BC7:
+            EncodeBC7Block (texels, block);
+            break;
+
+        default: Panic ("Texture format %d is not block compressed", job->format);
+        }
+    }
+}
+
+bool CompressTextureData (const TextureData &src, TextureFormat format, TextureData *result)
+{
+    Assert (src.format == TextureFormat_RGBA8);
+    Assert (format != TextureFormat_RGBA8);
+
+    memset (result, 0, sizeof (TextureData));
+    result->format = format;
+    result->level_count = src.level_count;
+
+    s64 total_size = 0;
+    for (int i = 0; i < src.level_count; i += 1)
+    {
+        TextureLevel *level = &result->levels[i];
+        level->width = src.levels[i].width;
+        level->height = src.levels[i].height;
+        level->size = GetTextureLevelSize (format, level->width, level->height);
+        total_size += level->size;
+    }
+
+    u8 *memory = (u8 *)malloc (total_size);
+    if (!memory)
+    {
+        LogError ("Could not allocate %ld bytes of compressed texture", total_size);
+        return false;
+    }
+
+    result->memory = memory;
+
+    s64 offset = 0;
+    for (int i = 0; i < result->level_count; i += 1)
+    {
+        result->levels[i].data = memory + offset;
+        offset += result->levels[i].size;
+    }
+
+    for (int i = 0; i < result->level_count; i += 1)
+    {
+        CompressJob job;
+        job.src = &src.levels[i];
+        job.dst = &result->levels[i];
+        job.format = format;
+        job.blocks_x = (job.dst->width + 3) / 4;
+        job.block_count = job.blocks_x * (s64)((job.dst->height + 3) / 4);
+        job.block_size = GetTextureLevelSize (format, 4, 4);
+
+        s64 batch_count = (job.block_count + Bc_Blocks_Per_Batch - 1) / Bc_Blocks_Per_Batch;
+        ParallelFor (batch_count, CompressBlocks, &job);
+    }
+
+    return true;
+}
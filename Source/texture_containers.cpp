@@ -0,0 +1,359 @@
+#include "Scop_Core.h"
+#include "Scop_Math.h"
+#include "Scop_Graphics.h"
+
+// DDS
+
+#define DDS_Magic 0x20534444 // "DDS "
+#define DDS_Header_Size 124
+
+#define DDPF_FourCC 0x4
+#define DDPF_RGB 0x40
+#define DDSCaps2_Cubemap 0x200
+#define DDSCaps2_Volume 0x200000
+
+#define FourCC(a, b, c, d) ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+enum DXGIFormat
+{
+    DXGI_Format_R8G8B8A8_UNorm = 28,
+    DXGI_Format_R8G8B8A8_UNorm_SRGB = 29,
+    DXGI_Format_BC1_UNorm = 71,
+    DXGI_Format_BC1_UNorm_SRGB = 72,
+    DXGI_Format_BC3_UNorm = 77,
+    DXGI_Format_BC3_UNorm_SRGB = 78,
+    DXGI_Format_BC4_UNorm = 80,
+    DXGI_Format_BC5_UNorm = 83,
+    DXGI_Format_BC7_UNorm = 98,
+    DXGI_Format_BC7_UNorm_SRGB = 99,
+};
+
+struct DDSPixelFormat
+{
+    u32 size;
+    u32 flags;
+    u32 four_cc;
+    u32 rgb_bit_count;
+    u32 r_mask;
+    u32 g_mask;
+    u32 b_mask;
+    u32 a_mask;
+};
+
+struct DDSHeader
+{
+    u32 size;
+    u32 flags;
+    u32 height;
+    u32 width;
+    u32 pitch_or_linear_size;
+    u32 depth;
+    u32 mip_map_count;
+    u32 reserved1[11];
+    DDSPixelFormat pixel_format;
+    u32 caps;
+    u32 caps2;
+    u32 caps3;
+    u32 caps4;
+    u32 reserved2;
+};
+
+struct DDSHeaderDX10
+{
+    u32 dxgi_format;
+    u32 resource_dimension;
+    u32 misc_flag;
+    u32 array_size;
+    u32 misc_flags2;
+};
+
+// KTX2
+
+#define KTX2_Identifier_Size 12
+
+static const u8 KTX2_Identifier[KTX2_Identifier_Size] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+enum VkFormat
+{
+    Vk_Format_R8G8B8A8_UNorm = 37,
+    Vk_Format_R8G8B8A8_SRGB = 43,
+    Vk_Format_BC1_RGB_UNorm_Block = 131,
+    Vk_Format_BC1_RGB_SRGB_Block = 132,
+    Vk_Format_BC3_UNorm_Block = 137,
+    Vk_Format_BC3_SRGB_Block = 138,
+    Vk_Format_BC4_UNorm_Block = 139,
+    Vk_Format_BC5_UNorm_Block = 141,
+    Vk_Format_BC7_UNorm_Block = 145,
+    Vk_Format_BC7_SRGB_Block = 146,
+};
+
+struct KTX2Header
+{
+    u8 identifier[KTX2_Identifier_Size];
+    u32 vk_format;
+    u32 type_size;
+    u32 pixel_width;
+    u32 pixel_height;
+    u32 pixel_depth;
+    u32 layer_count;
+    u32 face_count;
+    u32 level_count;
+    u32 supercompression_scheme;
+    u32 dfd_byte_offset;
+    u32 dfd_byte_length;
+    u32 kvd_byte_offset;
+    u32 kvd_byte_length;
+    u64 sgd_byte_offset;
+    u64 sgd_byte_length;
+};
+
+struct KTX2LevelIndex
+{
+    u64 byte_offset;
+    u64 byte_length;
+    u64 uncompressed_byte_length;
+};
+
+bool IsTextureContainer (const void *data, s64 size)
+{
+    if (size >= 4)
+    {
+        u32 magic;
+        memcpy (&magic, data, sizeof (magic));
+        if (magic == DDS_Magic)
+            return true;
+    }
+
+    return size >= KTX2_Identifier_Size && memcmp (data, KTX2_Identifier, KTX2_Identifier_Size) == 0;
+}
+
+// sRGB variants map to the same formats, textures are sampled without conversion
+static bool GetDDSTextureFormat (const DDSPixelFormat &pixel_format, u32 dxgi_format, TextureFormat *result)
+{
+    if (pixel_format.flags & DDPF_FourCC)
+    {
+        switch (pixel_format.four_cc)
+        {
+        case FourCC ('D', 'X', 'T', '1'): *result = TextureFormat_BC1; return true;
+        case FourCC ('D', 'X', 'T', '5'): *result = TextureFormat_BC3; return true;
+        case FourCC ('A', 'T', 'I', '1'): *result = TextureFormat_BC4; return true;
+        case FourCC ('B', 'C', '4', 'U'): *result = TextureFormat_BC4; return true;
+        case FourCC ('A', 'T', 'I', '2'): *result = TextureFormat_BC5; return true;
+        case FourCC ('B', 'C', '5', 'U'): *result = TextureFormat_BC5; return true;
+        case FourCC ('D', 'X', '1', '0'): break;
+        default: return false;
+        }
+
+        switch (dxgi_format)
+        {
+        case DXGI_Format_R8G8B8A8_UNorm: *result = TextureFormat_RGBA8; return true;
+        case DXGI_Format_R8G8B8A8_UNorm_SRGB: *result = TextureFormat_RGBA8; return true;
+        case DXGI_Format_BC1_UNorm: *result = TextureFormat_BC1; return true;
+        case DXGI_Format_BC1_UNorm_SRGB: *result = TextureFormat_BC1; return true;
+        case DXGI_Format_BC3_UNorm: *result = TextureFormat_BC3; return true;
+        case DXGI_Format_BC3_UNorm_SRGB: *result = TextureFormat_BC3; return true;
+        case DXGI_Format_BC4_UNorm: *result = TextureFormat_BC4; return true;
+        case DXGI_Format_BC5_UNorm: *result = TextureFormat_BC5; return true;
+        case DXGI_Format_BC7_UNorm: *result = TextureFormat_BC7; return true;
+        case DXGI_Format_BC7_UNorm_SRGB: *result = TextureFormat_BC7; return true;
+        default: return false;
+        }
+    }
+
+    bool rgba8 = (pixel_format.flags & DDPF_RGB) && pixel_format.rgb_bit_count == 32
+        && pixel_format.r_mask == 0xff && pixel_format.g_mask == 0xff00
+        && pixel_format.b_mask == 0xff0000 && pixel_format.a_mask == 0xff000000;
+    if (rgba8)
+    {
+        *result = TextureFormat_RGBA8;
+        return true;
+    }
+
+    return false;
+}
+
+static bool GetKTX2TextureFormat (u32 vk_format, TextureFormat *result)
+{
+    switch (vk_format)
+    {
+    case Vk_Format_R8G8B8A8_UNorm: *result = TextureFormat_RGBA8; return true;
+    case Vk_Format_R8G8B8A8_SRGB: *result = TextureFormat_RGBA8; return true;
+    case Vk_Format_BC1_RGB_UNorm_Block: *result = TextureFormat_BC1; return true;
+    case Vk_Format_BC1_RGB_SRGB_Block: *result = TextureFormat_BC1; return true;
+    case Vk_Format_BC3_UNorm_Block: *result = TextureFormat_BC3; return true;
+    case Vk_Format_BC3_SRGB_Block: *result = TextureFormat_BC3; return true;
+    case Vk_Format_BC4_UNorm_Block: *result = TextureFormat_BC4; return true;
+    case Vk_Format_BC5_UNorm_Block: *result = TextureFormat_BC5; return true;
+    case Vk_Format_BC7_UNorm_Block: *result = TextureFormat_BC7; return true;
+    case Vk_Format_BC7_SRGB_Block: *result = TextureFormat_BC7; return true;
+    default: return false;
+    }
+}
+
+static void SetContainerLevelSizes (TextureData *result, u32 width, u32 height, int level_count)
+{
+    result->level_count = Min (level_count, Max_Texture_Levels);
+
+    for (int i = 0; i < result->level_count; i += 1)
+    {
+        TextureLevel *level = &result->levels[i];
+        level->width = width;
+        level->height = height;
+        level->size = GetTextureLevelSize (result->format, width, height);
+
+        width = Max (width / 2, 1u);
+        height = Max (height / 2, 1u);
+    }
+}
+
+// The levels of a DDS file follow the headers, largest first
+static bool ParseDDSFile (const char *filename, const u8 *data, s64 size, TextureData *result)
+{
+    DDSHeader header;
+    if (size < 4 + (s64)sizeof (header))
+    {
+        LogError ("DDS file '%s' is truncated", filename);
+        return false;
+    }
+
+    memcpy (&header, data + 4, sizeof (header));
+    if (header.size != DDS_Header_Size)
+    {
+        LogError ("DDS file '%s' has an invalid header", filename);
+        return false;
+    }
+
+    s64 offset = 4 + sizeof (header);
+
+    DDSHeaderDX10 dx10 = {};
+    if ((header.pixel_format.flags & DDPF_FourCC) && header.pixel_format.four_cc == FourCC ('D', 'X', '1', '0'))
+    {
+        if (size < offset + (s64)sizeof (dx10))
+        {
+            LogError ("DDS file '%s' is truncated", filename);
+            return false;
+        }
+
+        memcpy (&dx10, data + offset, sizeof (dx10));
+        offset += sizeof (dx10);
+
+        if (dx10.array_size > 1)
+        {
+            LogError ("DDS file '%s' is a texture array, which is not supported", filename);
+            return false;
+        }
+    }
+
+    if (header.caps2 & (DDSCaps2_Cubemap | DDSCaps2_Volume))
+    {
+        LogError ("DDS file '%s' is a cubemap or a volume texture, which is not supported", filename);
+        return false;
+    }
+
+    if (!GetDDSTextureFormat (header.pixel_format, dx10.dxgi_format, &result->format))
+    {
+        LogError ("DDS file '%s' has an unsupported pixel format", filename);
+        return false;
+    }
+
+    if (header.width == 0 || header.height == 0)
+    {
+        LogError ("DDS file '%s' is empty", filename);
+        return false;
+    }
+
+    SetContainerLevelSizes (result, header.width, header.height, Max (header.mip_map_count, 1u));
+
+    for (int i = 0; i < result->level_count; i += 1)
+    {
+        TextureLevel *level = &result->levels[i];
+        if (offset + level->size > size)
+        {
+            LogError ("DDS file '%s' is truncated", filename);
+            return false;
+        }
+
+        level->data = data + offset;
+        offset += level->size;
+    }
+
+    return true;
+}
+
+// The level index of a KTX2 file gives the offset of each level, largest first
+static bool ParseKTX2File (const char *filename, const u8 *data, s64 size, TextureData *result)
+{
+    KTX2Header header;
+    if (size < (s64)sizeof (header))
+    {
+        LogError ("KTX2 file '%s' is truncated", filename);
+        return false;
+    }
+
+    memcpy (&header, data, sizeof (header));
+
+    if (header.supercompression_scheme != 0)
+    {
+        LogError ("KTX2 file '%s' is supercompressed, which is not supported", filename);
+        return false;
+    }
+
+    if (header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1)
+    {
+        LogError ("KTX2 file '%s' is not a 2D texture", filename);
+        return false;
+    }
+
+    if (!GetKTX2TextureFormat (header.vk_format, &result->format))
+    {
+        LogError ("KTX2 file '%s' has an unsupported format %u", filename, header.vk_format);
+        return false;
+    }
+
+    if (header.pixel_width == 0 || header.pixel_height == 0)
+    {
+        LogError ("KTX2 file '%s' is empty", filename);
+        return false;
+    }
+
+    // A level count of 0 asks for the levels to be generated, only the first one is in the file
+    u32 file_level_count = Max (header.level_count, 1u);
+    if (size < (s64)sizeof (header) + (s64)sizeof (KTX2LevelIndex) * file_level_count)
+    {
+        LogError ("KTX2 file '%s' is truncated", filename);
+        return false;
+    }
+
+    SetContainerLevelSizes (result, header.pixel_width, header.pixel_height, file_level_count);
+
+    for (int i = 0; i < result->level_count; i += 1)
+    {
+        KTX2LevelIndex index;
+        memcpy (&index, data + sizeof (header) + sizeof (index) * i, sizeof (index));
+
+        TextureLevel *level = &result->levels[i];
+        if (index.byte_length != (u64)level->size || index.byte_offset > (u64)size || index.byte_length > (u64)size - index.byte_offset)
+        {
+            LogError ("KTX2 file '%s' has an invalid level %d", filename, i);
+            return false;
+        }
+
+        level->data = data + index.byte_offset;
+    }
+
+    return true;
+}
+
+bool ParseTextureContainer (const char *filename, const void *data, s64 size, TextureData *result)
+{
+    Assert (IsTextureContainer (data, size));
+
+    memset (result, 0, sizeof (TextureData));
+
+    u32 magic;
+    memcpy (&magic, data, sizeof (magic));
+    if (magic == DDS_Magic)
+        return ParseDDSFile (filename, (const u8 *)data, size, result);
+
+    return ParseKTX2File (filename, (const u8 *)data, size, result);
+}